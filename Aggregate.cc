@@ -0,0 +1,174 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstring>
+#include "Aggregate.h"
+
+using std::vector;
+
+// the initial # slots of a hash table
+static const int INITIAL_SLOTS = 1024;
+
+void AggregateState::output(ResultSink& sink, const vector<SelAggregate>& items, const char* value, int len) const
+{
+  sink.beginRow();
+  for (unsigned i = 0; i < items.size(); i++) {
+    switch (items[i].func) {
+    case SelAggregate::NONE:   // the value the rows are grouped by
+      sink.putValue(value, len);
+      break;
+    case SelAggregate::COUNT:
+      sink.putInt(count);
+      break;
+    case SelAggregate::MIN:
+      if (count > 0) sink.putInt(min);
+      else sink.putNull(sizeof(int));
+      break;
+    case SelAggregate::MAX:
+      if (count > 0) sink.putInt(max);
+      else sink.putNull(sizeof(int));
+      break;
+    case SelAggregate::SUM:
+      if (count > 0) sink.putLong(sum);
+      else sink.putNull(sizeof(long long));
+      break;
+    case SelAggregate::AVG:
+      if (count > 0) sink.putDouble((double)sum / count);
+      else sink.putNull(sizeof(double));
+      break;
+    }
+  }
+  sink.endRow();
+}
+
+HashAggregate::HashAggregate(int level)
+{
+  this->level = level;
+  used = 0;
+  spilling = false;
+  Group empty;
+  empty.offset = -1;
+  slots.assign(INITIAL_SLOTS, empty);
+}
+
+HashAggregate::~HashAggregate()
+{
+  for (unsigned i = 0; i < writers.size(); i++) delete writers[i];
+  for (unsigned i = 0; i < partitions.size(); i++) delete partitions[i];
+}
+
+unsigned HashAggregate::hash(const char* value, int len) const
+{
+  // FNV-1a, with the basis changed on every level so that the groups
+  // of one partition spread over all partitions of the next level
+  unsigned h = 2166136261u ^ (level * 0x9e3779b9u);
+  for (int i = 0; i < len; i++) {
+    h ^= (unsigned char)value[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void HashAggregate::grow()
+{
+  vector<Group> old;
+  old.swap(slots);
+  Group empty;
+  empty.offset = -1;
+  slots.assign(old.size() * 2, empty);
+
+  unsigned mask = slots.size() - 1;
+  for (unsigned i = 0; i < old.size(); i++) {
+    if (old[i].offset < 0) continue;
+    unsigned s = old[i].hash & mask;
+    while (slots[s].offset >= 0) s = (s + 1) & mask;
+    slots[s] = old[i];
+  }
+}
+
+RC HashAggregate::add(int key, const char* value, int len)
+{
+  unsigned h = hash(value, len);
+  unsigned mask = slots.size() - 1;
+  unsigned s = h & mask;
+
+  // probe for the group of the value
+  for (; slots[s].offset >= 0; s = (s + 1) & mask) {
+    Group& g = slots[s];
+    if (g.hash == h && g.len == len && memcmp(arena.data() + g.offset, value, len) == 0) {
+      g.state.add(key);
+      return 0;
+    }
+  }
+  if (spilling) return spill(h, key, value, len);
+
+  // a new group. the table is kept at most 3/4 full
+  if ((used + 1) * 4 > (int)slots.size() * 3) {
+    long long grown = arena.size() + len + 2LL * slots.size() * sizeof(Group);
+    if (grown > MEMORY_BUDGET && level < MAX_LEVEL) {
+      spilling = true;
+      return spill(h, key, value, len);
+    }
+    grow();
+    mask = slots.size() - 1;
+    for (s = h & mask; slots[s].offset >= 0; s = (s + 1) & mask) ;
+  }
+  else if (arena.size() + len + slots.size() * sizeof(Group) > (unsigned)MEMORY_BUDGET && level < MAX_LEVEL) {
+    spilling = true;
+    return spill(h, key, value, len);
+  }
+
+  Group& g = slots[s];
+  g.hash = h;
+  g.offset = arena.size();
+  g.len = len;
+  g.state = AggregateState();
+  g.state.add(key);
+  arena.append(value, len);
+  used++;
+  return 0;
+}
+
+RC HashAggregate::spill(unsigned h, int key, const char* value, int len)
+{
+  RC rc;
+  if (partitions.empty()) {
+    for (int i = 0; i < PARTITION_COUNT; i++) {
+      partitions.push_back(new SpillFile);
+      if ((rc = partitions.back()->create()) < 0) return rc;
+      writers.push_back(new SpillWriter(*partitions.back()));
+    }
+  }
+  if (writers.size() < (unsigned)PARTITION_COUNT) return RC_FILE_OPEN_FAILED;
+  return writers[h >> 28]->put(key, value, len);
+}
+
+RC HashAggregate::output(ResultSink& sink, const vector<SelAggregate>& items)
+{
+  RC rc;
+
+  for (unsigned i = 0; i < slots.size() && !sink.full(); i++) {
+    const Group& g = slots[i];
+    if (g.offset >= 0) g.state.output(sink, items, arena.data() + g.offset, g.len);
+  }
+
+  // aggregate every partition by itself, with the memory of this table freed
+  vector<Group>().swap(slots);
+  std::string().swap(arena);
+  for (unsigned p = 0; p < writers.size() && !sink.full(); p++) {
+    if ((rc = writers[p]->finish()) < 0) return rc;
+    HashAggregate partition(level + 1);
+    SpillReader reader(*partitions[p]);
+    while (reader.next())
+      if ((rc = partition.add(reader.key, reader.value, reader.len)) < 0) return rc;
+    if (reader.rc < 0) return reader.rc;
+    if ((rc = partition.output(sink, items)) < 0) return rc;
+    delete writers[p];
+    delete partitions[p];
+    writers[p] = NULL;
+    partitions[p] = NULL;
+  }
+  return 0;
+}
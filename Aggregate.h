@@ -0,0 +1,130 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <climits>
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "ResultSink.h"
+#include "SpillFile.h"
+#include "SqlEngine.h"
+
+/**
+ * The running COUNT, SUM, MIN and MAX of the keys of a group, from which
+ * every aggregate of the SELECT clause is computed.
+ */
+struct AggregateState {
+  int       count;   // # tuples
+  long long sum;     // the sum of their keys
+  int       min;     // the smallest key. only valid if count > 0
+  int       max;     // the largest key. only valid if count > 0
+
+  AggregateState() { count = 0; sum = 0; min = INT_MAX; max = INT_MIN; }
+
+  void add(int key)
+  {
+    count++;
+    sum += key;
+    if (key < min) min = key;
+    if (key > max) max = key;
+  }
+
+  /**
+   * output the aggregates of the SELECT clause as one row.
+   * @param items[IN] the SELECT clause
+   * @param value[IN] the value the group was formed by. NULL without GROUP BY
+   * @param len[IN] the length of value
+   */
+  void output(ResultSink& sink, const std::vector<SelAggregate>& items, const char* value, int len) const;
+};
+
+/**
+ * Aggregates all tuples of a scan into one row.
+ */
+class ScalarAggregate : public RowConsumer {
+ public:
+  AggregateState state;
+
+  RC add(int key, const char*, int) { state.add(key); return 0; }
+};
+
+/**
+ * Aggregates the tuples of a scan grouped by their value.
+ *
+ * The groups live in an open-addressing hash table with linear probing.
+ * A slot holds the hash, the aggregate state and where the value is in
+ * one arena, so a probe compares hashes in consecutive memory and
+ * touches a value only on a likely match.
+ *
+ * When the table and the arena would outgrow MEMORY_BUDGET, the groups
+ * already in memory go on aggregating, and the tuples of every other
+ * group are written to one of PARTITION_COUNT spill files, picked by the
+ * top bits of their hash. Each partition is then aggregated on its own,
+ * with another hash seed, after the groups in memory are output.
+ */
+class HashAggregate : public RowConsumer {
+ public:
+  /// the most bytes the hash table and the values of the groups may take
+  static const int MEMORY_BUDGET = 16 * 1024 * 1024;
+
+  /// # spill files the tuples of groups that do not fit are divided into
+  static const int PARTITION_COUNT = 16;
+
+  /**
+   * @param level[IN] # times the input has been partitioned already
+   */
+  HashAggregate(int level = 0);
+  ~HashAggregate();
+
+  RC add(int key, const char* value, int len);
+
+  /**
+   * output one row per group, stopping as soon as the sink is full.
+   * @param items[IN] the SELECT clause
+   * @return error code. 0 if no error
+   */
+  RC output(ResultSink& sink, const std::vector<SelAggregate>& items);
+
+ private:
+  /// a slot of the hash table. offset is -1 if the slot is empty
+  struct Group {
+    unsigned hash;
+    int      offset;   // the offset of the value in the arena
+    int      len;      // the length of the value
+    AggregateState state;
+  };
+
+  /// the deepest level that still spills. below it, the table just grows
+  static const int MAX_LEVEL = 4;
+
+  int  level;                        // # times the input has been partitioned
+  std::vector<Group> slots;          // the hash table. its size is a power of 2
+  int  used;                         // # groups in the table
+  std::string arena;                 // the values of the groups
+  bool spilling;                     // true once no new group fits in memory
+  std::vector<SpillFile*>   partitions;  // the spill files, created on first use
+  std::vector<SpillWriter*> writers;
+
+  /**
+   * @return the hash of a value, seeded with the level
+   */
+  unsigned hash(const char* value, int len) const;
+
+  /**
+   * double the hash table.
+   */
+  void grow();
+
+  /**
+   * write a tuple to the spill file of its partition.
+   * @return error code. 0 if no error
+   */
+  RC spill(unsigned h, int key, const char* value, int len);
+};
+
+#endif /* AGGREGATE_H */
@@ -7,17 +7,29 @@
  * @date 3/24/2008
  */
 #include <stdio.h> 
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
 
 using namespace std;
 
+bool operator< (const IndexEntry& e1, const IndexEntry& e2)
+{
+	if (e1.key != e2.key) return e1.key < e2.key;
+	return e1.rid < e2.rid;
+}
+
 /*
  * BTreeIndex constructor
  */
 BTreeIndex::BTreeIndex()
 {
     rootPid = -1;
+    appendRun = 0;
+    rightPending = 0;
+    scanPid = -1;
 }
 
 /*
@@ -35,16 +47,28 @@ RC BTreeIndex::open(const string& indexname, char mode)
 	//If cannot read the file or write the file, return error code -2
 	if (!pf.endPid())
 	{
+		memset(buffer, 0, PageFile::PAGE_SIZE);
 		*(PageId*)(buffer + sizeof(int)) = rootPid = -1;
 		*(int*)buffer = treeHeight = 0;
+		*(int*)(buffer + sizeof(int) + sizeof(PageId)) = FORMAT_VERSION;
 		if (pf.write(0, buffer)) return RC_FILE_WRITE_FAILED;
 	}
 	//If exist the current file, read data from PageId = 0.
+	//Files written in another node format cannot be used.
 	if (pf.read(0, buffer)) return RC_FILE_READ_FAILED;
+	if (*(int*)(buffer + sizeof(int) + sizeof(PageId)) != FORMAT_VERSION)
+	{
+		pf.close();
+		return RC_INVALID_FILE_FORMAT;
+	}
 	rootPid = *(PageId*)(buffer + sizeof(int));
 	treeHeight = *(int*)buffer;
 	isWrite = false;
 	if (mode == 'w') isWrite = true;
+	rightPath.clear();
+	rightPending = 0;
+	appendRun = 0;
+	scanPid = -1;
 	return 0;
 }
 
@@ -57,97 +81,580 @@ RC BTreeIndex::close()
 	if (isWrite)
 	{
 		char buffer[PageFile::PAGE_SIZE];
+		if (flushAppends()) return RC_FILE_WRITE_FAILED;
+		memset(buffer, 0, PageFile::PAGE_SIZE);
 		*((int*)buffer) = treeHeight;
 		*((PageId*)(buffer + sizeof(int))) = rootPid;
+		*((int*)(buffer + sizeof(int) + sizeof(PageId))) = FORMAT_VERSION;
 		if (pf.write(0, buffer)) return RC_FILE_WRITE_FAILED;
 	}
 	return pf.close();
     //return 0;
 }
 
-bool BTreeIndex::insertRecursive(int key, const RecordId& rid, PageId pid, int height, int& newKey, PageId& pageID)
+/*
+ * Insert (key, RecordId) pair to the index.
+ * @param key[IN] the key for the value inserted into the index
+ * @param rid[IN] the RecordId for the record being inserted into the index
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::insert(int key, const RecordId& rid)
 {
-	if (height >= treeHeight)
+	IndexEntry entry;
+	entry.key = key;
+	entry.rid = rid;
+	if (rootPid == -1) return insertBatch(&entry, 1);
+
+	//Keys that keep growing go straight to the rightmost leaf
+	if (rightPath.empty() && loadRightPath()) return RC_FILE_READ_FAILED;
+	if (key >= rightMaxKey)
 	{
-		BTLeafNode leafnode;
-		if (leafnode.read(pid, pf)) return RC_FILE_READ_FAILED;
-		if (leafnode.getKeyCount() < BTLeafNode::MAX_KEY_NUMBER)
-		{
-			leafnode.insert(key, rid);
-			leafnode.write(pid, pf);
-			return false;
-		}
-		else
+		//An entry of the largest key with a smaller RecordId takes the slow path
+		RC rc;
+		if (++appendRun >= APPEND_RUN_THRESHOLD && (rc = appendRightmost(key, rid)) != RC_INVALID_RID) return rc;
+	}
+	else
+		appendRun = 0;
+
+	//Any other key descends the tree as a batch of one entry. How many
+	//entries a leaf holds depends on how well they compress, so the batch
+	//path may split a leaf into more than two.
+	return insertBatch(&entry, 1);
+}
+
+RC BTreeIndex::loadRightPath()
+{
+	int key;
+	PageId pid = rootPid;
+	rightPath.clear();
+	rightPending = 0;
+	for (int i = 1; i < treeHeight; i++)
+	{
+		BTNonLeafNode nonLeaf;
+		if (nonLeaf.read(pid, pf)) return RC_FILE_READ_FAILED;
+		rightPath.push_back(pid);
+		nonLeaf.readEntry(nonLeaf.getKeyCount() - 1, key, pid);
+	}
+	BTLeafNode leafNode;
+	RecordId rid;
+	if (leafNode.read(pid, pf)) return RC_FILE_READ_FAILED;
+	rightPath.push_back(pid);
+	rightMaxKey = INT_MIN;
+	if (leafNode.getKeyCount() > 0) leafNode.readEntry(leafNode.getKeyCount() - 1, rightMaxKey, rid);
+	return 0;
+}
+
+RC BTreeIndex::flushAppends()
+{
+	for (int level = 0; rightPending > 0 && level < (int)rightPath.size() - 1; level++)
+	{
+		BTNonLeafNode nonLeaf;
+		if (nonLeaf.read(rightPath[level], pf)) return RC_FILE_READ_FAILED;
+		int last = nonLeaf.getKeyCount();
+		nonLeaf.setChildCount(last, nonLeaf.getChildCount(last) + rightPending);
+		if (nonLeaf.write(rightPath[level], pf)) return RC_FILE_WRITE_FAILED;
+	}
+	rightPending = 0;
+	return 0;
+}
+
+RC BTreeIndex::appendRightmost(int key, const RecordId& rid)
+{
+	int lastKey = INT_MIN;
+	RecordId lastRid;
+	PageId leafPid = rightPath.back();
+	BTLeafNode leafNode, tailNode;
+	if (leafNode.read(leafPid, pf)) return RC_FILE_READ_FAILED;
+
+	//The last entry of the tree is in the overflow tail if the leaf has one
+	PageId tailPid = leafNode.getOverflowTail();
+	if (tailPid != -1 && tailNode.read(tailPid, pf)) return RC_FILE_READ_FAILED;
+	BTLeafNode& lastNode = (tailPid == -1) ? leafNode : tailNode;
+	PageId lastPid = (tailPid == -1) ? leafPid : tailPid;
+	if (lastNode.getKeyCount() > 0)
+	{
+		lastNode.readEntry(lastNode.getKeyCount() - 1, lastKey, lastRid);
+		if (key == lastKey && rid < lastRid) return RC_INVALID_RID;
+	}
+	rightMaxKey = key;
+
+	//An overflow page takes only more entries of its key
+	if ((tailPid == -1 || key == lastKey) && lastNode.append(key, rid) == 0)
+	{
+		//The counts along the right edge are brought up to date
+		//only when a new leaf is started
+		rightPending++;
+		if (tailPid != -1)
 		{
-			BTLeafNode newNode;
-			leafnode.insertAndSplit(key, rid, newNode, newKey);
-			leafnode.setNextNodePtr(pf.endPid());
-			leafnode.write(pid, pf);
-			pageID = pf.endPid();
-			newNode.write(pf.endPid(), pf);
-			return true;
+			leafNode.setOverflow(leafNode.getOverflowCount() + 1, tailPid);
+			if (leafNode.write(leafPid, pf)) return RC_FILE_WRITE_FAILED;
 		}
+		return lastNode.write(lastPid, pf) ? RC_FILE_WRITE_FAILED : 0;
 	}
-	else
+
+	//The page is full. Its entries stay where they are and
+	//the new entry starts a new page behind it.
+	BTLeafNode newLeaf;
+	PageId child = pf.endPid();
+	newLeaf.append(key, rid);
+	newLeaf.setPrevNodePtr(lastPid);
+	if (newLeaf.write(child, pf)) return RC_FILE_WRITE_FAILED;
+	lastNode.setNextNodePtr(child);
+	if (key == lastKey)
 	{
-		BTNonLeafNode nonleaf;
-		if (nonleaf.read(pid, pf)) return true;
-		PageId child;
-		nonleaf.locateChildPtr(key, child);
-		if (insertRecursive(key, rid, child, height + 1, newKey, pageID))
+		//More entries of the last key go to a new overflow page
+		rightPending++;
+		leafNode.setOverflow(leafNode.getOverflowCount() + 1, child);
+		if (tailPid != -1 && tailNode.write(tailPid, pf)) return RC_FILE_WRITE_FAILED;
+		return leafNode.write(leafPid, pf) ? RC_FILE_WRITE_FAILED : 0;
+	}
+	if (lastNode.write(lastPid, pf)) return RC_FILE_WRITE_FAILED;
+	if (flushAppends()) return RC_FILE_WRITE_FAILED;
+	rightPath.back() = child;
+
+	//Hand the new node up the right edge the same way
+	int level;
+	int rootCount = leafNode.getKeyCount() + leafNode.getOverflowCount();
+	for (level = (int)rightPath.size() - 2; level >= 0; level--)
+	{
+		BTNonLeafNode nonLeaf;
+		if (nonLeaf.read(rightPath[level], pf)) return RC_FILE_READ_FAILED;
+		if (nonLeaf.getKeyCount() < BTNonLeafNode::MAX_KEY_NUMBER)
 		{
-			if (nonleaf.getKeyCount() < BTNonLeafNode::MAX_KEY_NUMBER)
+			nonLeaf.insert(key, child, 1);
+			if (nonLeaf.write(rightPath[level], pf)) return RC_FILE_WRITE_FAILED;
+			//The nodes above count the new entry below their last child
+			for (level--; level >= 0; level--)
 			{
-				nonleaf.insert(newKey, pageID);
-				nonleaf.write(pid, pf);
-				return false;
-			}
-			else
-			{
-				BTNonLeafNode newNode;
-				nonleaf.insertAndSplit(newKey, pageID, newNode, newKey);
-				nonleaf.write(pid, pf);
-				pageID = pf.endPid();
-				newNode.write(pf.endPid(), pf);
-				return true;
+				if (nonLeaf.read(rightPath[level], pf)) return RC_FILE_READ_FAILED;
+				int last = nonLeaf.getKeyCount();
+				nonLeaf.setChildCount(last, nonLeaf.getChildCount(last) + 1);
+				if (nonLeaf.write(rightPath[level], pf)) return RC_FILE_WRITE_FAILED;
 			}
+			return 0;
 		}
-		return false;
+		rootCount = nonLeaf.getTotalCount();
+		BTNonLeafNode sibling;
+		sibling.initialize(child, 1);
+		child = pf.endPid();
+		if (sibling.write(child, pf)) return RC_FILE_WRITE_FAILED;
+		rightPath[level] = child;
 	}
-}
 
+	//Even the root was full
+	BTNonLeafNode newRoot;
+	newRoot.initializeRoot(rootPid, rootCount, key, child, 1);
+	rootPid = pf.endPid();
+	treeHeight++;
+	if (newRoot.write(rootPid, pf)) return RC_FILE_WRITE_FAILED;
+	rightPath.insert(rightPath.begin(), rootPid);
+	return 0;
+}
 
 /*
- * Insert (key, RecordId) pair to the index.
- * @param key[IN] the key for the value inserted into the index
- * @param rid[IN] the RecordId for the record being inserted into the index
+ * Insert a batch of (key, RecordId) pairs to the index.
+ * @param entries[IN] the array of entries sorted by key and RecordId
+ * @param n[IN] the number of entries in the array
  * @return error code. 0 if no error
  */
-RC BTreeIndex::insert(int key, const RecordId& rid)
+RC BTreeIndex::insertBatch(const IndexEntry* entries, int n)
 {
-	int newKey;
-	PageId pageID;
-	if (rootPid==-1)
+	RC rc;
+	if (n <= 0) return 0;
+
+	if (rootPid == -1)
 	{
 		BTLeafNode leafNode;
-		leafNode.insert(key, rid);
 		rootPid = pf.endPid();
 		treeHeight = 1;
-		leafNode.write(rootPid, pf);
-		return 0;
+		if (leafNode.write(rootPid, pf)) return RC_FILE_WRITE_FAILED;
 	}
-	int height = 1;
-	if (insertRecursive(key, rid, rootPid, height, newKey, pageID))
+
+	int count;
+	vector<ChildEntry> splits;
+	PageId endPid = pf.endPid();
+	if (flushAppends()) return RC_FILE_WRITE_FAILED;
+	if ((rc = insertBatchRecursive(entries, n, rootPid, 1, count, splits)) < 0) return rc;
+
+	//A split may have moved the right edge; reload it on the next insert
+	if (pf.endPid() != endPid) rightPath.clear();
+	else if (!rightPath.empty() && entries[n - 1].key > rightMaxKey) rightMaxKey = entries[n - 1].key;
+	return growRoot(count, splits);
+}
+
+/*
+ * Build the tree bottom-up from a batch of sorted (key, RecordId) pairs.
+ * @param entries[IN] the array of entries sorted by key and RecordId
+ * @param n[IN] the number of entries in the array
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::build(const IndexEntry* entries, int n)
+{
+	RC rc;
+	if (rootPid != -1) return insertBatch(entries, n);
+	if (n <= 0) return 0;
+
+	//An empty root leaf takes all entries at once, which writes the leaves
+	//from left to right. The levels above are then written one by one.
+	BTLeafNode leafNode;
+	rootPid = pf.endPid();
+	treeHeight = 1;
+	if (leafNode.write(rootPid, pf)) return RC_FILE_WRITE_FAILED;
+
+	int count;
+	vector<ChildEntry> splits;
+	if ((rc = insertLeaf(entries, n, rootPid, count, splits)) < 0) return rc;
+	rightPath.clear();
+	return growRoot(count, splits);
+}
+
+RC BTreeIndex::growRoot(int count, vector<ChildEntry>& splits)
+{
+	RC rc;
+	//If the root split, grow the tree until one root holds all the children
+	while (!splits.empty())
 	{
-		BTNonLeafNode nonLeaf;
-		nonLeaf.initializeRoot(rootPid, newKey, pageID);
-		rootPid = pf.endPid();
+		vector<ChildEntry> children, upper;
+		ChildEntry root = { 0, rootPid, count };
+		children.push_back(root);
+		children.insert(children.end(), splits.begin(), splits.end());
+		PageId newRoot = pf.endPid();
+		if ((rc = writeNonLeafNodes(newRoot, children, count, upper)) < 0) return rc;
+		rootPid = newRoot;
 		treeHeight++;
-		nonLeaf.write(rootPid, pf);
+		splits.swap(upper);
 	}
 	return 0;
 }
 
+RC BTreeIndex::insertBatchRecursive(const IndexEntry* entries, int n, PageId pid, int height, int& count, vector<ChildEntry>& splits)
+{
+	RC rc;
+	if (height >= treeHeight) return insertLeaf(entries, n, pid, count, splits);
+
+	BTNonLeafNode nonLeaf;
+	if (nonLeaf.read(pid, pf)) return RC_FILE_READ_FAILED;
+	int keyCount = nonLeaf.getKeyCount();
+	vector<ChildEntry> children(keyCount + 1);
+	for (int i = 0; i <= keyCount; i++)
+	{
+		nonLeaf.readEntry(i - 1, children[i].key, children[i].pid);
+		children[i].count = nonLeaf.getChildCount(i);
+	}
+
+	//Child c receives the entries below the c-th key, the last child the rest.
+	//The new siblings of every child are appended right behind it.
+	vector<ChildEntry> newChildren;
+	int lo = 0;
+	for (int c = 0; c <= keyCount; c++)
+	{
+		int hi = n;
+		if (c < keyCount)
+			for (hi = lo; hi < n && entries[hi].key < children[c + 1].key; hi++);
+		int at = newChildren.size();
+		newChildren.push_back(children[c]);
+		if (hi > lo)
+		{
+			int childCount;
+			if ((rc = insertBatchRecursive(entries + lo, hi - lo, children[c].pid, height + 1, childCount, newChildren)) < 0) return rc;
+			newChildren[at].count = childCount;
+		}
+		lo = hi;
+	}
+
+	//If no child split, only the entry counts change
+	if ((int)newChildren.size() == keyCount + 1)
+	{
+		for (int i = 0; i <= keyCount; i++)
+			nonLeaf.setChildCount(i, newChildren[i].count);
+		count = nonLeaf.getTotalCount();
+		return nonLeaf.write(pid, pf) ? RC_FILE_WRITE_FAILED : 0;
+	}
+	return writeNonLeafNodes(pid, newChildren, count, splits);
+}
+
+RC BTreeIndex::insertLeaf(const IndexEntry* entries, int n, PageId pid, int& count, vector<ChildEntry>& splits)
+{
+	RC rc;
+	BTLeafNode leafNode;
+	if (leafNode.read(pid, pf)) return RC_FILE_READ_FAILED;
+
+	//A single entry usually fits in place
+	if (n == 1 && (rc = insertInPlace(entries[0], leafNode, pid, count)) != RC_NODE_FULL) return rc;
+
+	//Gather the entries of the leaf and of its overflow pages,
+	//remembering which pages held which of them
+	vector<IndexEntry> old;
+	vector<PageId> oldPids;
+	vector<int> oldStarts;
+	PageId prev = leafNode.getPrevNodePtr();
+	PageId tail = leafNode.getOverflowTail();
+	PageId next = pid;
+	for (bool last = false; !last; )
+	{
+		if (next != pid && leafNode.read(next, pf)) return RC_FILE_READ_FAILED;
+		oldPids.push_back(next);
+		oldStarts.push_back(old.size());
+		last = (tail == -1 || next == tail);
+		for (int i = 0; i < leafNode.getKeyCount(); i++)
+		{
+			IndexEntry entry;
+			leafNode.readEntry(i, entry.key, entry.rid);
+			old.push_back(entry);
+		}
+		next = leafNode.getNextNodePtr();
+	}
+	oldStarts.push_back(old.size());
+
+	//Merge them with the batch. origin[i] is the position of the i-th
+	//entry among the old ones, or -1 for an entry of the batch.
+	int total = old.size() + n;
+	vector<IndexEntry> merged(total);
+	vector<int> origin(total);
+	for (int i = 0, j = 0, k = 0; k < total; k++)
+	{
+		if (j < n && (i == (int)old.size() || entries[j] < old[i]))
+		{
+			merged[k] = entries[j++];
+			origin[k] = -1;
+		}
+		else
+		{
+			merged[k] = old[i];
+			origin[k] = i++;
+		}
+	}
+
+	//Lay the entries out in leaves and overflow pages. The pages of the
+	//old leaf are reused in order, the rest are appended to the file.
+	vector<LeafPage> pages;
+	if ((rc = packLeaves(&merged[0], total, pages)) < 0) return rc;
+	int nodes = pages.size();
+	vector<PageId> pids(nodes);
+	for (int j = 0; j < nodes; j++)
+		pids[j] = (j < (int)oldPids.size()) ? oldPids[j] : pf.endPid() + j - (int)oldPids.size();
+	if (pids[nodes - 1] != oldPids.back() && (rc = linkPrevNode(next, pids[nodes - 1])) < 0) return rc;
+
+	for (int j = 0; j < nodes; j++)
+	{
+		//The overflow count of a leaf covers the overflow pages behind it
+		int overflow = 0, end = j + 1;
+		for (; !pages[j].overflow && end < nodes && pages[end].overflow; end++)
+			overflow += pages[end].size;
+
+		//An overflow page that keeps its entries and neighbours is left as it is
+		int start = pages[j].start, size = pages[j].size;
+		bool nextSame = (j + 1 < nodes) ? (j + 1 < (int)oldPids.size()) : (j + 1 == (int)oldPids.size());
+		if (pages[j].overflow && j < (int)oldPids.size() && nextSame
+			&& size == oldStarts[j + 1] - oldStarts[j] && origin[start] == oldStarts[j]
+			&& origin[start + size - 1] == oldStarts[j + 1] - 1)
+			continue;
+
+		BTLeafNode newNode;
+		for (int i = start; i < start + size; i++)
+			newNode.append(merged[i].key, merged[i].rid);
+		newNode.setPrevNodePtr(j == 0 ? prev : pids[j - 1]);
+		newNode.setNextNodePtr(j == nodes - 1 ? next : pids[j + 1]);
+		newNode.setOverflow(overflow, overflow ? pids[end - 1] : -1);
+		if (newNode.write(pids[j], pf)) return RC_FILE_WRITE_FAILED;
+		if (pages[j].overflow) continue;
+		if (j == 0) count = size + overflow;
+		else
+		{
+			ChildEntry sibling = { merged[start].key, pids[j], size + overflow };
+			splits.push_back(sibling);
+		}
+	}
+	return 0;
+}
+
+RC BTreeIndex::insertInPlace(const IndexEntry& entry, BTLeafNode& leafNode, PageId pid, int& count)
+{
+	IndexEntry last, first;
+	PageId tail = leafNode.getOverflowTail();
+	if (leafNode.getKeyCount() > 0) leafNode.readEntry(leafNode.getKeyCount() - 1, last.key, last.rid);
+
+	//Entries up to the last one of the leaf go to the leaf itself
+	if (tail == -1 || leafNode.getKeyCount() == 0 || !(last < entry))
+	{
+		if (leafNode.insert(entry.key, entry.rid)) return RC_NODE_FULL;
+		count = leafNode.getKeyCount() + leafNode.getOverflowCount();
+		return leafNode.write(pid, pf) ? RC_FILE_WRITE_FAILED : 0;
+	}
+	if (entry.key != last.key) return RC_NODE_FULL;
+
+	//The others continue the last key in the overflow pages. Most of them
+	//come in RecordId order and belong to the last page.
+	BTLeafNode page;
+	PageId pagePid = tail;
+	if (page.read(tail, pf)) return RC_FILE_READ_FAILED;
+	page.readEntry(0, first.key, first.rid);
+	if (entry < first)
+	{
+		for (pagePid = leafNode.getNextNodePtr(); pagePid != tail; pagePid = page.getNextNodePtr())
+		{
+			if (page.read(pagePid, pf)) return RC_FILE_READ_FAILED;
+			page.readEntry(page.getKeyCount() - 1, last.key, last.rid);
+			if (!(last < entry)) break;
+		}
+		if (pagePid == tail && page.read(tail, pf)) return RC_FILE_READ_FAILED;
+	}
+	if (page.insert(entry.key, entry.rid)) return RC_NODE_FULL;
+	if (page.write(pagePid, pf)) return RC_FILE_WRITE_FAILED;
+	leafNode.setOverflow(leafNode.getOverflowCount() + 1, tail);
+	count = leafNode.getKeyCount() + leafNode.getOverflowCount();
+	return leafNode.write(pid, pf) ? RC_FILE_WRITE_FAILED : 0;
+}
+
+RC BTreeIndex::packLeaves(const IndexEntry* entries, int n, vector<LeafPage>& pages)
+{
+	//Count the leaves a greedy packing needs, cutting only between keys
+	int nodes = 0;
+	for (int pos = 0; pos < n; nodes++)
+	{
+		int cut = cutLeaf(entries, n, pos, fitLeaf(entries + pos, n - pos));
+		if (cut > 0) pos = cut;
+		else for (int key = entries[pos].key; pos < n && entries[pos].key == key; pos++);
+	}
+
+	//Then give every leaf its share of the rest, as far as it fits
+	pages.clear();
+	for (int pos = 0, leaves = 0; pos < n; leaves++)
+	{
+		int fit = fitLeaf(entries + pos, n - pos);
+		if (fit <= 0) return RC_NODE_FULL;
+		int left = max(nodes - leaves, 1);
+		int cut = cutLeaf(entries, n, pos, min((n - pos + left - 1) / left, fit));
+		if (cut < 0) cut = cutLeaf(entries, n, pos, fit);
+		if (cut > 0)
+		{
+			LeafPage leaf = { pos, cut - pos, false };
+			pages.push_back(leaf);
+			pos = cut;
+			continue;
+		}
+
+		//The key at pos has more entries than a leaf holds.
+		//The leaf is filled with them and the rest go to overflow pages.
+		int key = entries[pos].key;
+		LeafPage leaf = { pos, fit, false };
+		pages.push_back(leaf);
+		for (pos += fit; pos < n && entries[pos].key == key; pos += fit)
+		{
+			int end;
+			for (end = pos; end < n && entries[end].key == key; end++);
+			if ((fit = fitLeaf(entries + pos, end - pos)) <= 0) return RC_NODE_FULL;
+			LeafPage page = { pos, fit, true };
+			pages.push_back(page);
+		}
+	}
+	return 0;
+}
+
+int BTreeIndex::cutLeaf(const IndexEntry* entries, int n, int pos, int size)
+{
+	//The last key boundary at most size entries behind pos
+	int cut;
+	for (cut = pos + size; cut > pos && cut < n && entries[cut].key == entries[cut - 1].key; cut--);
+	return (cut > pos) ? cut : -(pos + 1);
+}
+
+int BTreeIndex::fitLeaf(const IndexEntry* entries, int n)
+{
+	BTLeafNode leafNode;
+	int i;
+	for (i = 0; i < n && leafNode.append(entries[i].key, entries[i].rid) == 0; i++);
+	return i;
+}
+
+RC BTreeIndex::writeNonLeafNodes(PageId pid, const vector<ChildEntry>& children, int& count, vector<ChildEntry>& splits)
+{
+	//Spread the child pointers evenly over as few nodes as possible.
+	//The key in front of the first pointer of every extra node is the
+	//separator for the parent.
+	int total = children.size();
+	int nodes = (total + BTNonLeafNode::MAX_KEY_NUMBER) / (BTNonLeafNode::MAX_KEY_NUMBER + 1);
+	int pos = 0;
+	for (int j = 0; j < nodes; j++)
+	{
+		int size = total / nodes + (j < total % nodes ? 1 : 0);
+		BTNonLeafNode node;
+		node.initialize(children[pos].pid, children[pos].count);
+		for (int i = pos + 1; i < pos + size; i++)
+			node.insert(children[i].key, children[i].pid, children[i].count);
+		PageId nodePid = (j == 0) ? pid : pf.endPid();
+		if (node.write(nodePid, pf)) return RC_FILE_WRITE_FAILED;
+		if (j == 0) count = node.getTotalCount();
+		else
+		{
+			ChildEntry sibling = { children[pos].key, nodePid, node.getTotalCount() };
+			splits.push_back(sibling);
+		}
+		pos += size;
+	}
+	return 0;
+}
+
+RC BTreeIndex::linkPrevNode(PageId pid, PageId prev)
+{
+	BTLeafNode leafNode;
+	if (pid == -1) return 0;
+	if (leafNode.read(pid, pf)) return RC_FILE_READ_FAILED;
+	leafNode.setPrevNodePtr(prev);
+	return leafNode.write(pid, pf) ? RC_FILE_WRITE_FAILED : 0;
+}
+
+/*
+ * Count the index entries whose key is in [lo, hi].
+ * @param lo[IN] the smallest key of the range
+ * @param hi[IN] the largest key of the range
+ * @param count[OUT] the number of index entries in the range
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::countRange(int lo, int hi, int& count)
+{
+	RC rc;
+	int below, upTo;
+	count = 0;
+	if (lo > hi || rootPid == -1) return 0;
+	if (flushAppends()) return RC_FILE_WRITE_FAILED;
+	if ((rc = countBelow(lo, false, below)) < 0) return rc;
+	if ((rc = countBelow(hi, true, upTo)) < 0) return rc;
+	count = upTo - below;
+	return 0;
+}
+
+RC BTreeIndex::countBelow(int searchKey, bool orEqual, int& count)
+{
+	int key, eid;
+	RecordId rid;
+	PageId pageID = rootPid;
+	count = 0;
+
+	//Add up the counts of the children left of the path to searchKey.
+	//The entries of a key never span two leaves, so a separator equal
+	//to searchKey leads to the leaf where they start.
+	for (int i = 1; i < treeHeight; i++)
+	{
+		BTNonLeafNode nonLeaf;
+		if (nonLeaf.read(pageID, pf)) return RC_FILE_READ_FAILED;
+		int c = nonLeaf.locateChild(searchKey, false);
+		for (int j = 0; j < c; j++)
+			count += nonLeaf.getChildCount(j);
+		nonLeaf.readEntry(c - 1, key, pageID);
+	}
+
+	BTLeafNode leafNode;
+	if (leafNode.read(pageID, pf)) return RC_FILE_READ_FAILED;
+	leafNode.locate(searchKey, eid);
+	if (orEqual)
+		for (; eid < leafNode.getKeyCount() && (leafNode.readEntry(eid, key, rid), key == searchKey); eid++);
+	//The overflow pages continue the last key of the leaf
+	if (eid == leafNode.getKeyCount()) eid += leafNode.getOverflowCount();
+	count += eid;
+	return 0;
+}
+
 /**
  * Run the standard B+Tree key search algorithm and identify the
  * leaf nonleaf where searchKey may exist. If an index entry with
@@ -168,18 +675,35 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
  */
 RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
 {
+	cursor.pid = -1;
+	cursor.eid = 0;
 	if (rootPid == -1) return RC_NO_SUCH_RECORD;
+	//The entries of a key never span two leaves, so a separator equal
+	//to searchKey leads to the leaf where they start
+	int key;
 	PageId pageID = rootPid;
 	for (int i = 1; i < treeHeight;i++)
 	{
 		BTNonLeafNode nonLeaf;
-		nonLeaf.read(pageID, pf);
-		nonLeaf.locateChildPtr(searchKey, pageID);
+		if (nonLeaf.read(pageID, pf)) return RC_FILE_READ_FAILED;
+		nonLeaf.readEntry(nonLeaf.locateChild(searchKey, false) - 1, key, pageID);
 	}
 	BTLeafNode leafNode;
-	leafNode.read(pageID, pf);
+	if (leafNode.read(pageID, pf)) return RC_FILE_READ_FAILED;
 	cursor.pid = pageID;
-	return leafNode.locate(searchKey, cursor.eid);
+	RC rc = leafNode.locate(searchKey, cursor.eid);
+	if (cursor.eid < leafNode.getKeyCount()) return rc;
+
+	//Every key of the leaf is smaller. The next leaf starts behind its
+	//overflow pages, which continue the last key.
+	cursor.eid = 0;
+	cursor.pid = leafNode.getNextNodePtr();
+	if (leafNode.getOverflowTail() != -1)
+	{
+		if (leafNode.read(leafNode.getOverflowTail(), pf)) return RC_FILE_READ_FAILED;
+		cursor.pid = leafNode.getNextNodePtr();
+	}
+	return RC_NO_SUCH_RECORD;
 }
 
 /*
@@ -192,8 +716,17 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
  */
 RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
 {
-	BTLeafNode leafNode;
-	if (leafNode.read(cursor.pid, pf)) return RC_FILE_READ_FAILED;
+	if (cursor.pid == -1) return RC_END_OF_TREE;
+	if (readScanLeaf(cursor.pid)) return RC_FILE_READ_FAILED;
+	BTLeafNode& leafNode = scanLeaf;
+	//A cursor behind the last entry of a leaf continues in the next leaf
+	while (cursor.eid >= leafNode.getKeyCount())
+	{
+		cursor.pid = leafNode.getNextNodePtr();
+		cursor.eid = 0;
+		if (cursor.pid == -1) return RC_END_OF_TREE;
+		if (readScanLeaf(cursor.pid)) return RC_FILE_READ_FAILED;
+	}
 	leafNode.readEntry(cursor.eid, key, rid);
 	if (cursor.eid >= leafNode.getKeyCount() - 1)
 	{
@@ -204,3 +737,159 @@ RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
 		cursor.eid++;
 	return 0;
 }
+
+RC BTreeIndex::readScanLeaf(PageId pid)
+{
+	//Any page write may have changed the leaf
+	if (pid == scanPid && PageFile::getPageWriteCount() == scanWrites) return 0;
+	scanPid = -1;
+	if (scanLeaf.read(pid, pf)) return RC_FILE_READ_FAILED;
+	scanPid = pid;
+	scanWrites = PageFile::getPageWriteCount();
+	return 0;
+}
+
+/*
+ * Split the key range [lo, hi] at separator keys of the non-leaf nodes
+ * into sub-ranges of about size index entries each.
+ * @param lo[IN] the smallest key of the range
+ * @param hi[IN] the largest key of the range
+ * @param size[IN] the # index entries a sub-range should not exceed
+ * @param bounds[OUT] the first keys of the sub-ranges after the first one
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::splitRange(int lo, int hi, int size, vector<int>& bounds)
+{
+	int run = 0;
+	bounds.clear();
+	if (rootPid == -1 || treeHeight <= 1 || lo >= hi) return 0;
+	if (flushAppends()) return RC_FILE_WRITE_FAILED;
+	return splitRangeRecursive(rootPid, 1, lo, hi, max(size, 1), run, bounds);
+}
+
+RC BTreeIndex::splitRangeRecursive(PageId pid, int height, int lo, int hi, int size, int& run, vector<int>& bounds)
+{
+	RC rc;
+	int key;
+	PageId child;
+	BTNonLeafNode nonLeaf;
+	if (nonLeaf.read(pid, pf)) return RC_FILE_READ_FAILED;
+
+	//Walk the children that overlap [lo, hi]. A new sub-range starts at
+	//the separator in front of a child that would make the current one too
+	//large. A child too large by itself is split at the separators below it.
+	int first = nonLeaf.locateChild(lo, false);
+	int last = nonLeaf.locateChild(hi, false);
+	for (int c = first; c <= last; c++)
+	{
+		nonLeaf.readEntry(c - 1, key, child);
+		int count = nonLeaf.getChildCount(c);
+		if (c > first && run > 0 && run + count > size)
+		{
+			bounds.push_back(key);
+			run = 0;
+		}
+		if (count > size && height + 1 < treeHeight)
+		{
+			if ((rc = splitRangeRecursive(child, height + 1, lo, hi, size, run, bounds)) < 0) return rc;
+		}
+		else
+			run += count;
+	}
+	return 0;
+}
+
+/*
+ * Read the separator keys of the root node.
+ * @param keys[OUT] the keys of the root node in ascending order
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readRootKeys(vector<int>& keys)
+{
+	BTNonLeafNode root;
+	int key;
+	PageId pid;
+	keys.clear();
+	if (treeHeight <= 1) return 0;
+	if (root.read(rootPid, pf)) return RC_FILE_READ_FAILED;
+	for (int i = 0; i < root.getKeyCount(); i++)
+	{
+		root.readEntry(i, key, pid);
+		keys.push_back(key);
+	}
+	return 0;
+}
+
+/*
+ * Set the cursor to the last index entry whose key is not larger than
+ * searchKey, for a backward scan with readBackward().
+ * @param searchKey[IN] the largest key to find
+ * @param cursor[OUT] the cursor pointing to the last index entry with a key
+ *                    not larger than searchKey. pid is -1 if there is none.
+ * @return 0 if searchKey is found. Othewise an error code
+ */
+RC BTreeIndex::locateLast(int searchKey, IndexCursor& cursor)
+{
+	int key;
+	RecordId rid;
+	cursor.pid = -1;
+	cursor.eid = -1;
+	if (rootPid == -1) return RC_NO_SUCH_RECORD;
+
+	//The entries of searchKey start in the leaf right of an equal separator
+	PageId pageID = rootPid;
+	for (int i = 1; i < treeHeight; i++)
+	{
+		BTNonLeafNode nonLeaf;
+		if (nonLeaf.read(pageID, pf)) return RC_FILE_READ_FAILED;
+		nonLeaf.readEntry(nonLeaf.locateChild(searchKey, false) - 1, key, pageID);
+	}
+	BTLeafNode leafNode;
+	if (leafNode.read(pageID, pf)) return RC_FILE_READ_FAILED;
+	cursor.pid = pageID;
+	for (cursor.eid = leafNode.getKeyCount() - 1; cursor.eid >= 0; cursor.eid--)
+	{
+		leafNode.readEntry(cursor.eid, key, rid);
+		if (key > searchKey) continue;
+
+		//The last key of the leaf ends in its last overflow page
+		if (cursor.eid == leafNode.getKeyCount() - 1 && leafNode.getOverflowTail() != -1)
+		{
+			cursor.pid = leafNode.getOverflowTail();
+			if (leafNode.read(cursor.pid, pf)) return RC_FILE_READ_FAILED;
+			cursor.eid = leafNode.getKeyCount() - 1;
+		}
+		return (key == searchKey) ? 0 : RC_NO_SUCH_RECORD;
+	}
+	//Every key in the leaf is larger. readBackward() starts from the
+	//last entry of the previous leaf.
+	return RC_NO_SUCH_RECORD;
+}
+
+/*
+ * Read the (key, rid) pair at the location specified by the index cursor,
+ * and move the cursor back to the previous entry.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param key[OUT] the key stored at the index cursor location.
+ * @param rid[OUT] the RecordId stored at the index cursor location.
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readBackward(IndexCursor& cursor, int& key, RecordId& rid)
+{
+	if (cursor.pid == -1) return RC_END_OF_TREE;
+	if (readScanLeaf(cursor.pid)) return RC_FILE_READ_FAILED;
+	BTLeafNode& leafNode = scanLeaf;
+	//A cursor in front of the first entry of a leaf continues with the
+	//last entry of the previous leaf
+	while (cursor.eid < 0)
+	{
+		cursor.pid = leafNode.getPrevNodePtr();
+		if (cursor.pid == -1) return RC_END_OF_TREE;
+		if (readScanLeaf(cursor.pid)) return RC_FILE_READ_FAILED;
+		cursor.eid = leafNode.getKeyCount() - 1;
+	}
+	if (cursor.eid >= leafNode.getKeyCount()) cursor.eid = leafNode.getKeyCount() - 1;
+	leafNode.readEntry(cursor.eid, key, rid);
+	cursor.eid--;
+	return 0;
+}
@@ -10,9 +10,12 @@
 #ifndef BTREEINDEX_H
 #define BTREEINDEX_H
 
+#include <vector>
+#include <utility>
 #include "Bruinbase.h"
 #include "PageFile.h"
 #include "RecordFile.h"
+#include "BTreeNode.h"
              
 /**
  * The data structure to point to a particular entry at a b+tree leaf node.
@@ -27,6 +30,18 @@ typedef struct {
   int     eid;  
 } IndexCursor;
 
+/**
+ * A (key, RecordId) pair to be stored in the index.
+ * An array of IndexEntry is handed to BTreeIndex::insertBatch().
+ */
+typedef struct {
+  int      key;
+  RecordId rid;
+} IndexEntry;
+
+// order index entries by key, then by RecordId
+bool operator< (const IndexEntry& e1, const IndexEntry& e2);
+
 /**
  * Implements a B-Tree index for bruinbase.
  * 
@@ -58,6 +73,30 @@ class BTreeIndex {
    */
   RC insert(int key, const RecordId& rid);
 
+  /**
+   * Insert a batch of (key, RecordId) pairs to the index.
+   * The batch is split into groups by their target leaf, so that every
+   * touched leaf is read and written only once. Leaves and non-leaf nodes
+   * that overflow are split into as many nodes as needed in one pass.
+   * The caller sorts the batch, so that a batch of one entry, as insert()
+   * passes, costs no copy.
+   * @param entries[IN] the array of entries sorted by key and RecordId
+   * @param n[IN] the number of entries in the array
+   * @return error code. 0 if no error
+   */
+  RC insertBatch(const IndexEntry* entries, int n);
+
+  /**
+   * Build the tree bottom-up from a batch of (key, RecordId) pairs.
+   * The leaves are written from left to right, then every level of
+   * non-leaf nodes above them.
+   * If the tree is not empty, the entries are inserted by insertBatch().
+   * @param entries[IN] the array of entries sorted by key and RecordId
+   * @param n[IN] the number of entries in the array
+   * @return error code. 0 if no error
+   */
+  RC build(const IndexEntry* entries, int n);
+
   /**
    * Run the standard B+Tree key search algorithm and identify the
    * leaf node where searchKey may exist. If an index entry with
@@ -87,8 +126,80 @@ class BTreeIndex {
    * @return error code. 0 if no error
    */
   RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
+
+  /**
+   * Find the last index entry whose key is not larger than searchKey
+   * and set IndexCursor to its location, to start a backward scan.
+   * IndexCursor.pid is set to -1 if there is no such entry.
+   * @param searchKey[IN] the largest key to find
+   * @param cursor[OUT] the cursor pointing to the last index entry with
+   *                    a key not larger than searchKey
+   * @return 0 if searchKey is found. Othewise, an error code
+   */
+  RC locateLast(int searchKey, IndexCursor& cursor);
+
+  /**
+   * Read the (key, rid) pair at the location specified by the index cursor,
+   * and move the cursor back to the previous entry, following the
+   * backward links between the leaves.
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+   * @param key[OUT] the key stored at the index cursor location
+   * @param rid[OUT] the RecordId stored at the index cursor location
+   * @return error code. 0 if no error, RC_END_OF_TREE in front of the first entry
+   */
+  RC readBackward(IndexCursor& cursor, int& key, RecordId& rid);
+
+  /**
+   * Count the index entries whose key is in [lo, hi].
+   * Every child pointer of a non-leaf node carries the number of entries
+   * below it, so this takes two root-to-leaf descents whatever the range.
+   * @param lo[IN] the smallest key of the range
+   * @param hi[IN] the largest key of the range
+   * @param count[OUT] the number of index entries in the range
+   * @return error code. 0 if no error
+   */
+  RC countRange(int lo, int hi, int& count);
+
+  /**
+   * Split the key range [lo, hi] at separator keys of the non-leaf nodes
+   * into sub-ranges of about size index entries each, so that they can be
+   * scanned separately. The entry counts of the child pointers tell the
+   * size of a subtree, so only the nodes of subtrees larger than size are read.
+   * @param lo[IN] the smallest key of the range
+   * @param hi[IN] the largest key of the range
+   * @param size[IN] the # index entries a sub-range should not exceed
+   * @param bounds[OUT] the first keys of the sub-ranges after the first one,
+   *                    in ascending order. empty if the range is not split
+   * @return error code. 0 if no error
+   */
+  RC splitRange(int lo, int hi, int size, std::vector<int>& bounds);
+
+  /**
+   * Read the separator keys of the root node.
+   * keys is left empty when the root is a leaf or the tree is empty.
+   * @param keys[OUT] the keys of the root node in ascending order
+   * @return error code. 0 if no error
+   */
+  RC readRootKeys(std::vector<int>& keys);
+
+  /**
+   * @return the # pages in the index file
+   */
+  int getPageCount() const { return pf.endPid(); }
+
+  /**
+   * @return the height of the tree. 0 if the tree is empty
+   */
+  int getTreeHeight() const { return treeHeight; }
   
  private:
+  /// the version of the node format, stored in the first page of the file.
+  /// 2: child pointers of non-leaf nodes carry entry counts
+  /// 3: leaves link to their previous sibling
+  /// 4: leaf entries are compressed
+  /// 5: posting lists and overflow pages
+  static const int FORMAT_VERSION = 5;
+
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
 
   PageId   rootPid;    /// the PageId of the root node
@@ -100,13 +211,142 @@ class BTreeIndex {
 
   bool isWrite;
 
+  //
+  // the following members cache the path to the rightmost leaf,
+  // so that inserts of ever-increasing keys can skip the descent
+  //
+  static const int APPEND_RUN_THRESHOLD = 8; /// consecutive appends before the fast path is taken
+
+  std::vector<PageId> rightPath; /// PageIds from the root to the rightmost leaf. empty if unknown
+  int      rightMaxKey;          /// the largest key in the tree (valid only if rightPath is known)
+  int      appendRun;            /// # consecutive inserts whose key was >= rightMaxKey
+  int      rightPending;         /// # appends not yet added to the counts along rightPath
+
+  //
+  // the decoded leaf readForward() and readBackward() step through
+  //
+  BTLeafNode scanLeaf;
+  PageId   scanPid;              /// the PageId of scanLeaf. -1 if none
+  int      scanWrites;           /// the page write count when scanLeaf was read
+
+  /**
+   * Make scanLeaf the leaf at pid, decoding it only if it is another one
+   * or if pages were written since.
+   */
+  RC readScanLeaf(PageId pid);
+
+  /**
+   * Read the right edge of the tree into rightPath and rightMaxKey.
+   */
+  RC loadRightPath();
+
+  /**
+   * Add the pending appends to the entry counts of the non-leaf nodes
+   * along rightPath.
+   */
+  RC flushAppends();
+
+  /**
+   * Append (key, rid) to the rightmost leaf without descending the tree.
+   * key must not be smaller than any key in the tree. When the leaf is full,
+   * it is left as it is and key starts a new leaf (a 100/0 split), and the
+   * same happens for full non-leaf nodes along the right edge. More entries
+   * of the largest key go to overflow pages behind the leaf instead.
+   * @return RC_INVALID_RID if key is the largest key and rid is smaller
+   *         than its last RecordId
+   */
+  RC appendRightmost(int key, const RecordId& rid);
+
+  /// a child pointer of a non-leaf node: the separator key in front of it,
+  /// its PageId and the number of index entries below it
+  typedef struct {
+    int    key;
+    PageId pid;
+    int    count;
+  } ChildEntry;
+
+  /**
+   * Insert the sorted entries into the subtree rooted at pid.
+   * The # index entries below pid afterwards is returned in count.
+   * The new siblings created by splits are appended to splits in key order.
+   * It is the caller's duty to add them to the parent node.
+   */
+  RC insertBatchRecursive(const IndexEntry* entries, int n, PageId pid, int height, int& count, std::vector<ChildEntry>& splits);
+
+  /**
+   * Make the root and the new siblings in splits the children of a new
+   * root, as many times as it takes to fit them in one node.
+   * @param count[IN] the # index entries below the current root
+   */
+  RC growRoot(int count, std::vector<ChildEntry>& splits);
+
+  /**
+   * Insert the sorted entries into the leaf at pid and its overflow pages,
+   * splitting them into new leaves as needed. count and splits are
+   * returned as insertBatchRecursive() does.
+   */
+  RC insertLeaf(const IndexEntry* entries, int n, PageId pid, int& count, std::vector<ChildEntry>& splits);
+
+  /**
+   * Insert entry into the leaf at pid or one of its overflow pages,
+   * without moving any other entry to another page.
+   * @return RC_NODE_FULL if the entry does not fit there
+   */
+  RC insertInPlace(const IndexEntry& entry, BTLeafNode& leafNode, PageId pid, int& count);
+
+  /// the entries of one leaf or overflow page laid out by packLeaves()
+  typedef struct {
+    int  start;     /// the position of the first entry
+    int  size;      /// the # entries
+    bool overflow;  /// whether the page continues the last key of the leaf before it
+  } LeafPage;
+
+  /**
+   * Split the sorted entries into as few leaves as hold them, spread as
+   * evenly as their encoded size allows. Leaves are cut only between keys.
+   * A key with more entries than a leaf holds fills a leaf, and the rest
+   * of its entries go to overflow pages behind it.
+   */
+  RC packLeaves(const IndexEntry* entries, int n, std::vector<LeafPage>& pages);
+
+  /**
+   * A posting list never straddles a cut: the separator in the parent is
+   * the first key of a leaf, so a search for a key reaches one leaf only,
+   * and all entries of the key must be in it or in its overflow pages.
+   * @return the last position between two keys at most size entries
+   *         behind pos, or -(pos + 1) if the key at pos has more entries
+   */
+  int cutLeaf(const IndexEntry* entries, int n, int pos, int size);
+
+  /**
+   * @return the # leading entries that fit in one leaf
+   */
+  int fitLeaf(const IndexEntry* entries, int n);
+
+  /**
+   * Write the child pointers as one non-leaf node at pid, or as several
+   * nodes starting at pid if they do not fit in one. The key of the first
+   * child is ignored. The # index entries below the node at pid is returned
+   * in count and the extra nodes are appended to splits.
+   */
+  RC writeNonLeafNodes(PageId pid, const std::vector<ChildEntry>& children, int& count, std::vector<ChildEntry>& splits);
+
+  /**
+   * Add the separators of the subtree at pid that split [lo, hi] to bounds.
+   * run is the # entries in the current sub-range so far.
+   */
+  RC splitRangeRecursive(PageId pid, int height, int lo, int hi, int size, int& run, std::vector<int>& bounds);
+
+  /**
+   * Set the previous sibling pointer of the leaf at pid (if pid is not -1).
+   */
+  RC linkPrevNode(PageId pid, PageId prev);
+
   /**
-   * Traverses the B+tree recursively and creates any appropriate nodes along the way.
-   * If an insert succeeds without the need for a split, the data will be written on
-   * disk. If a split is needed, both the current and sibling nodes will be written.
-   * It is the caller's duty to create the proper parent node to hold both.
+   * Count the index entries whose key is smaller than searchKey,
+   * or smaller than or equal to it if orEqual is set.
    */
-  bool insertRecursive(int key, const RecordId& rid, PageId pid, int height, int& newKey, PageId& pageID);
+  RC countBelow(int searchKey, bool orEqual, int& count);
 };
 
 #endif /* BTREEINDEX_H */
@@ -2,34 +2,188 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
 
 using namespace std;
 
+// the # bits needed to store v
+static int bitWidth(unsigned v)
+{
+	int width = 0;
+	for (; v; v >>= 1) width++;
+	return width;
+}
+
+// packs values of up to 32 bits each into consecutive bits of a buffer
+typedef struct {
+	char*    out;   // where the next 32 bits go
+	uint64_t bits;  // packed bits not yet stored
+	int      count; // # bits in bits
+} BitWriter;
+
+static void putBits(BitWriter& w, unsigned v, int width)
+{
+	w.bits |= (uint64_t)v << w.count;
+	w.count += width;
+	if (w.count >= 32)
+	{
+		uint32_t low = (uint32_t)w.bits;
+		memcpy(w.out, &low, sizeof(low));
+		w.out += sizeof(low);
+		w.bits >>= 32;
+		w.count -= 32;
+	}
+}
+
+static void flushBits(BitWriter& w)
+{
+	memcpy(w.out, &w.bits, (w.count + 7) / 8);
+}
+
+// unpacks the values a BitWriter packed
+typedef struct {
+	const char* in;    // where the next 32 bits come from
+	uint64_t    bits;  // bits loaded but not yet read
+	int         count; // # bits in bits
+} BitReader;
+
+static unsigned getBits(BitReader& r, int width)
+{
+	if (r.count < width)
+	{
+		uint32_t next;
+		memcpy(&next, r.in, sizeof(next));
+		r.in += sizeof(next);
+		r.bits |= (uint64_t)next << r.count;
+		r.count += 32;
+	}
+	unsigned v = (unsigned)(r.bits & (((uint64_t)1 << width) - 1));
+	r.bits >>= width;
+	r.count -= width;
+	return v;
+}
+
 BTLeafNode::BTLeafNode()
 {
-  *(int *)buffer = 0;
-  setNextNodePtr(-1);
+  keyCount = 0;
+  nextPid = -1;
+  prevPid = -1;
+  overflowCount = 0;
+  overflowTail = -1;
+  measure();
 }
+
 /*
- * Read the content of the node from the page pid in the PageFile pf.
+ * Read the content of the node from the page pid in the PageFile pf
+ * and decode its entries.
  * @param pid[IN] the PageId to read
  * @param pf[IN] PageFile to read from
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTLeafNode::read(PageId pid, const PageFile& pf)
 {
-	return pf.read(pid, buffer); 
+	RC rc;
+	char page[PageFile::PAGE_SIZE + sizeof(uint64_t)];
+	if ((rc = pf.read(pid, page)) < 0) return rc;
+	memset(page + PageFile::PAGE_SIZE, 0, sizeof(uint64_t));
+
+	int* header = (int*)page;
+	keyCount = header[0];
+	nextPid = header[1];
+	prevPid = header[2];
+	if (keyCount < 0 || keyCount > MAX_KEY_NUMBER) return RC_INVALID_FILE_FORMAT;
+	unsigned deltaBase = header[4], pidBase = header[5];
+	int runs = header[6], groups = header[7];
+	overflowCount = header[8];
+	overflowTail = header[9];
+	const unsigned char* widths = (const unsigned char*)(header + 10);
+	BitReader reader = { page + HEADER_SIZE, 0, 0 };
+
+	//Keys: the first key, then the deltas to the previous key,
+	//then the number of entries of every key
+	int groupKeys[MAX_KEY_NUMBER];
+	if (groups > 0) groupKeys[0] = header[3];
+	for (int g = 1; g < groups && g < MAX_KEY_NUMBER; g++)
+		groupKeys[g] = (int)((unsigned)groupKeys[g - 1] + deltaBase + getBits(reader, widths[0]));
+	for (int g = 0, i = 0; g < groups && g < MAX_KEY_NUMBER; g++)
+	{
+		int length = getBits(reader, widths[1]) + 1;
+		for (; length > 0 && i < keyCount; length--)
+			keys[i++] = groupKeys[g];
+	}
+
+	//RecordIds: (page, run length) pairs, then the slots
+	for (int r = 0, i = 0; r < runs; r++)
+	{
+		PageId runPid = (PageId)(pidBase + getBits(reader, widths[2]));
+		int length = getBits(reader, widths[3]) + 1;
+		for (; length > 0 && i < keyCount; length--)
+			rids[i++].pid = runPid;
+	}
+	for (int i = 0; i < keyCount; i++)
+		rids[i].sid = (int)getBits(reader, widths[4]);
+
+	//The frame is only needed to change the node
+	framed = false;
+	return 0;
 }
     
 /*
- * Write the content of the node to the page pid in the PageFile pf.
+ * Encode the entries of the node and write them to the page pid in the PageFile pf.
  * @param pid[IN] the PageId to write to
  * @param pf[IN] PageFile to write to
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTLeafNode::write(PageId pid, PageFile& pf)
 {
-	return pf.write(pid, buffer);
+	char page[PageFile::PAGE_SIZE];
+	memset(page, 0, sizeof(page));
+	if (!framed) measure();
+	if (payloadBits() > PAYLOAD_BITS) return RC_NODE_FULL;
+
+	int keyBits = bitWidth(frame.maxDelta - frame.minDelta);
+	int countBits = bitWidth(frame.maxGroupLength - 1);
+	int pidBits = bitWidth(frame.maxPid - frame.minPid);
+	int lenBits = bitWidth(frame.maxRunLength - 1);
+	int sidBits = bitWidth(frame.maxSid);
+	int* header = (int*)page;
+	header[0] = keyCount;
+	header[1] = nextPid;
+	header[2] = prevPid;
+	header[3] = keyCount > 0 ? keys[0] : 0;
+	header[4] = frame.minDelta;
+	header[5] = frame.minPid;
+	header[6] = frame.runCount;
+	header[7] = frame.groupCount;
+	header[8] = overflowCount;
+	header[9] = overflowTail;
+	unsigned char* widths = (unsigned char*)(header + 10);
+	widths[0] = keyBits;
+	widths[1] = countBits;
+	widths[2] = pidBits;
+	widths[3] = lenBits;
+	widths[4] = sidBits;
+
+	BitWriter writer = { page + HEADER_SIZE, 0, 0 };
+	for (int i = 1; i < keyCount; i++)
+		if (keys[i] != keys[i - 1])
+			putBits(writer, (unsigned)keys[i] - (unsigned)keys[i - 1] - frame.minDelta, keyBits);
+	for (int i = 0, j; i < keyCount; i = j)
+	{
+		for (j = i + 1; j < keyCount && keys[j] == keys[i]; j++);
+		putBits(writer, j - i - 1, countBits);
+	}
+	for (int i = 0, j; i < keyCount; i = j)
+	{
+		for (j = i + 1; j < keyCount && rids[j].pid == rids[i].pid; j++);
+		putBits(writer, (unsigned)rids[i].pid - frame.minPid, pidBits);
+		putBits(writer, j - i - 1, lenBits);
+	}
+	for (int i = 0; i < keyCount; i++)
+		putBits(writer, (unsigned)rids[i].sid, sidBits);
+	flushBits(writer);
+	return pf.write(pid, page);
 }
 
 /*
@@ -38,7 +192,39 @@ RC BTLeafNode::write(PageId pid, PageFile& pf)
  */
 int BTLeafNode::getKeyCount()
 { 
-  return *((int *)buffer); 
+  return keyCount; 
+}
+
+/*
+ * Return the number of entries of the last key in the overflow pages
+ * behind this node.
+ * @return the number of entries in the overflow pages. 0 if there are none
+ */
+int BTLeafNode::getOverflowCount()
+{
+	return overflowCount;
+}
+
+/*
+ * Return the last overflow page behind this node.
+ * @return the PageId of the last overflow page. -1 if there are none
+ */
+PageId BTLeafNode::getOverflowTail()
+{
+	return overflowTail;
+}
+
+/*
+ * Record the overflow pages behind this node.
+ * @param count[IN] the number of entries in the overflow pages
+ * @param tail[IN] the PageId of the last overflow page
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::setOverflow(int count, PageId tail)
+{
+	overflowCount = count;
+	overflowTail = (count > 0) ? tail : -1;
+	return 0;
 }
 
 /*
@@ -49,68 +235,56 @@ int BTLeafNode::getKeyCount()
  */
 RC BTLeafNode::insert(int key, const RecordId& rid)
 {
- 	int count = getKeyCount();
-	if (MAX_KEY_NUMBER <= count) return RC_NODE_FULL;
-	else
-	{
-		int eID, i;
-		locate(key, eID);
-		PageId pageID = getNextNodePtr();
-		for (i = count; i > eID; --i)
-		{
-			int destIndex = PID_SIZE*i + sizeof(int);
-			int srcIndex = (i - 1)*PID_SIZE + sizeof(int);
-			memcpy(buffer + destIndex, buffer + srcIndex, PID_SIZE);
-		}
-		int tempIndex = PID_SIZE*eID + sizeof(int);
-		*(RecordId*)(buffer + tempIndex) = rid;
-		*(int*)(buffer + tempIndex + sizeof(RecordId)) = key;
-		(*(int*)buffer)++;
-		setNextNodePtr(pageID);
-		return 0;
-	}
+	int eID;
+	if (MAX_KEY_NUMBER <= keyCount) return RC_NODE_FULL;
+	//The RecordIds of a key are kept sorted
+	locate(key, eID);
+	while (eID < keyCount && keys[eID] == key && rids[eID] < rid) eID++;
+	if (eID == keyCount) return append(key, rid);
 
+	memmove(keys + eID + 1, keys + eID, (keyCount - eID) * sizeof(int));
+	memmove(rids + eID + 1, rids + eID, (keyCount - eID) * sizeof(RecordId));
+	keys[eID] = key;
+	rids[eID] = rid;
+	keyCount++;
+	measure();
 
+	//Take the entry out again if the node no longer fits in a page
+	if (payloadBits() > PAYLOAD_BITS)
+	{
+		keyCount--;
+		memmove(keys + eID, keys + eID + 1, (keyCount - eID) * sizeof(int));
+		memmove(rids + eID, rids + eID + 1, (keyCount - eID) * sizeof(RecordId));
+		measure();
+		return RC_NODE_FULL;
+	}
+	return 0;
 }
 
 /*
- * Insert the (key, rid) pair to the node
- * and split the node half and half with sibling.
- * The first key of the sibling node is returned in siblingKey.
- * @param key[IN] the key to insert.
- * @param rid[IN] the RecordId to insert.
- * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
- * @param siblingKey[OUT] the first key in the sibling node after split.
- * @return 0 if successful. Return an error code if there is an error.
+ * Append the (key, rid) pair behind the last entry of the node.
+ * @param key[IN] the key to append
+ * @param rid[IN] the RecordId to append
+ * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey)
+RC BTLeafNode::append(int key, const RecordId& rid)
 {
-	//--------------------start insert---------------------------
-	int count = getKeyCount();
-	int eID, i;
-	locate(key, eID);
-	PageId pageID = getNextNodePtr();
-	for (i = count; i > eID; --i)
+	if (MAX_KEY_NUMBER <= keyCount) return RC_NODE_FULL;
+	if (keyCount > 0 && (key < keys[keyCount - 1] || (key == keys[keyCount - 1] && rid < rids[keyCount - 1])))
+		return RC_INVALID_RID;
+	if (!framed) measure();
+	Frame old = frame;
+	keys[keyCount] = key;
+	rids[keyCount] = rid;
+	extendFrame(keyCount);
+	keyCount++;
+	if (payloadBits() > PAYLOAD_BITS)
 	{
-		int destIndex = PID_SIZE*i + sizeof(int);
-		int srcIndex = (i - 1)*PID_SIZE + sizeof(int);
-		memcpy(buffer + destIndex, buffer + srcIndex, PID_SIZE);
+		keyCount--;
+		frame = old;
+		return RC_NODE_FULL;
 	}
-	int tempIndex = PID_SIZE*eID + sizeof(int);
-	*(RecordId*)(buffer + tempIndex) = rid;
-	*(int*)(buffer + tempIndex + sizeof(RecordId)) = key;
-
-	//--------------------split insert---------------------------
-	int lessKey = (MAX_KEY_NUMBER + 1) / 2;
-	int moreKey = (MAX_KEY_NUMBER + 1) - lessKey;
-	*(int*)buffer = lessKey;
-	*(int*)sibling.buffer = moreKey;
-	memcpy(sibling.buffer + sizeof(int), buffer + sizeof(int) + lessKey*PID_SIZE, moreKey*PID_SIZE);
-	sibling.setNextNodePtr(pageID);
-	siblingKey = *(int*)(sibling.buffer + sizeof(int) + sizeof(RecordId));
 	return 0;
-
-
 }
 
 /**
@@ -126,16 +300,17 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling,
  */
 RC BTLeafNode::locate(int searchKey, int& eid)
 {
-	eid = 0;
-	while (eid<getKeyCount())
+	//Binary search for the first key not smaller than searchKey
+	int lo = 0, hi = keyCount;
+	while (lo < hi)
 	{
-		if (*(int*)(buffer + sizeof(int) + sizeof(RecordId) + PID_SIZE*eid) >= searchKey)
-			return 0;
-		eid++;
+		int mid = (lo + hi) / 2;
+		if (keys[mid] < searchKey) lo = mid + 1;
+		else hi = mid;
 	}
+	eid = lo;
 	//If not found, then return no such record 
-	return RC_NO_SUCH_RECORD;
-	
+	return (eid < keyCount) ? 0 : RC_NO_SUCH_RECORD;
 }
 
 /*
@@ -147,10 +322,10 @@ RC BTLeafNode::locate(int searchKey, int& eid)
  */
 RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
 {
- 	rid = *(RecordId*)(buffer + eid*PID_SIZE + sizeof(int));
-	key = *(int*)(buffer + eid*PID_SIZE + sizeof(int) + sizeof(RecordId));
+	if (eid < 0 || eid >= keyCount) return RC_INVALID_CURSOR;
+	key = keys[eid];
+	rid = rids[eid];
 	return 0;
-
 }
 
 /*
@@ -159,7 +334,7 @@ RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
  */
 PageId BTLeafNode::getNextNodePtr()
 {
-	return *(PageId *)(buffer + sizeof(int) + getKeyCount()*PID_SIZE);
+	return nextPid;
 }
 
 /*
@@ -169,10 +344,89 @@ PageId BTLeafNode::getNextNodePtr()
  */
 RC BTLeafNode::setNextNodePtr(PageId pid)
 { 
-	*(PageId *)(buffer + sizeof(int) + getKeyCount()*PID_SIZE) = pid;
+	nextPid = pid;
 	return 0; 
 }
 
+/*
+ * Return the pid of the previous slibling node.
+ * @return the PageId of the previous sibling node 
+ */
+PageId BTLeafNode::getPrevNodePtr()
+{
+	return prevPid;
+}
+
+/*
+ * Set the pid of the previous slibling node.
+ * @param pid[IN] the PageId of the previous sibling node 
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::setPrevNodePtr(PageId pid)
+{ 
+	prevPid = pid;
+	return 0; 
+}
+
+/*
+ * Recompute the frame of the encoding from the entries.
+ */
+void BTLeafNode::measure()
+{
+	frame.minDelta = frame.minPid = UINT_MAX;
+	frame.maxDelta = frame.maxPid = frame.maxSid = 0;
+	frame.groupCount = frame.groupLength = frame.maxGroupLength = 0;
+	frame.runCount = frame.runLength = frame.maxRunLength = 0;
+	for (int i = 0; i < keyCount; i++)
+		extendFrame(i);
+	framed = true;
+}
+
+/*
+ * Extend the frame by the eid-th entry, which follows the entries already in it.
+ */
+void BTLeafNode::extendFrame(int eid)
+{
+	if (eid > 0 && keys[eid] == keys[eid - 1])
+		frame.groupLength++;
+	else
+	{
+		if (eid > 0)
+		{
+			unsigned delta = (unsigned)keys[eid] - (unsigned)keys[eid - 1];
+			if (delta < frame.minDelta) frame.minDelta = delta;
+			if (delta > frame.maxDelta) frame.maxDelta = delta;
+		}
+		frame.groupCount++;
+		frame.groupLength = 1;
+	}
+	if (frame.groupLength > frame.maxGroupLength) frame.maxGroupLength = frame.groupLength;
+	if (eid > 0 && rids[eid].pid == rids[eid - 1].pid)
+		frame.runLength++;
+	else
+	{
+		frame.runCount++;
+		frame.runLength = 1;
+		if ((unsigned)rids[eid].pid < frame.minPid) frame.minPid = rids[eid].pid;
+		if ((unsigned)rids[eid].pid > frame.maxPid) frame.maxPid = rids[eid].pid;
+	}
+	if (frame.runLength > frame.maxRunLength) frame.maxRunLength = frame.runLength;
+	if ((unsigned)rids[eid].sid > frame.maxSid) frame.maxSid = rids[eid].sid;
+}
+
+/*
+ * @return the # bits the packed entries take with the current frame
+ */
+int BTLeafNode::payloadBits() const
+{
+	if (keyCount == 0) return 0;
+	int keyBits = bitWidth(frame.maxDelta - frame.minDelta);
+	int countBits = bitWidth(frame.maxGroupLength - 1);
+	int runBits = bitWidth(frame.maxPid - frame.minPid) + bitWidth(frame.maxRunLength - 1);
+	return (frame.groupCount - 1) * keyBits + frame.groupCount * countBits
+		+ frame.runCount * runBits + keyCount * bitWidth(frame.maxSid);
+}
+
 /*
  * Read the content of the node from the page pid in the PageFile pf.
  * @param pid[IN] the PageId to read
@@ -209,109 +463,127 @@ int BTNonLeafNode::getKeyCount()
  * Insert a (key, pid) pair to the node.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
+ * @param count[IN] the number of index entries in the subtree at pid
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
+RC BTNonLeafNode::insert(int key, PageId pid, int count)
 {
-	int count = getKeyCount();
-	if (MAX_KEY_NUMBER <= count) return RC_NODE_FULL;
-	int i = 0, j=count;
-	while (i<count)
+	int keyCount = getKeyCount();
+	if (MAX_KEY_NUMBER <= keyCount) return RC_NODE_FULL;
+	int i = 0, j = keyCount;
+	while (i < keyCount)
 	{
-		int tempIndex = sizeof(int) + sizeof(PageId) + i*PID_SIZE;
-		if (*(int*)(buffer + tempIndex) > key) break;
+		if (*(int*)keyPtr(i) > key) break;
 		i++;
 	}
-	while (j>i)
+	while (j > i)
 	{
-		int destIndex = sizeof(int) + sizeof(PageId) + j*PID_SIZE;
-		int srcIndex = sizeof(int) + sizeof(PageId) + (j - 1)*PID_SIZE;
-		memcpy(buffer + destIndex, buffer + srcIndex, PID_SIZE);
+		memcpy(keyPtr(j), keyPtr(j - 1), PID_SIZE);
 		j--;
 	}
-	*(PageId*)(buffer + 2 * sizeof(int) + sizeof(PageId) + i*PID_SIZE) = pid;
-	*(int*)(buffer + sizeof(int) + sizeof(PageId) + i*PID_SIZE) = key;
+	*(int*)keyPtr(i) = key;
+	*(PageId*)childPtr(i + 1) = pid;
+	*(int*)(childPtr(i + 1) + sizeof(PageId)) = count;
 	(*(int*)buffer)++;
 	return 0;
 
 }
 
 /*
- * Insert the (key, pid) pair to the node
- * and split the node half and half with sibling.
- * The middle key after the split is returned in midKey.
- * @param key[IN] the key to insert
- * @param pid[IN] the PageId to insert
- * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
- * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
- * @return 0 if successful. Return an error code if there is an error.
+ * Given the searchKey, find the number of the child pointer to follow.
+ * @param searchKey[IN] the searchKey that is being looked up.
+ * @param lowerBound[IN] if true, stop at the first key equal to searchKey
+ * @return the number of the child pointer, from 0 to getKeyCount()
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
+int BTNonLeafNode::locateChild(int searchKey, bool lowerBound)
 {
-	//----------------------insert start----------------------------------------
-	int count = getKeyCount();
-	int i = 0, j = count;
-	while (i<count)
-	{
-		int tempIndex = sizeof(int) + sizeof(PageId) + i*PID_SIZE;
-		if (*(int*)(buffer + tempIndex) > key) break;
-		i++;
-	}
-	while (j>i)
+	int eid = 0;
+	while (eid < getKeyCount())
 	{
-		int destIndex = sizeof(int) + sizeof(PageId) + j*PID_SIZE;
-		int srcIndex = sizeof(int) + sizeof(PageId) + (j - 1)*PID_SIZE;
-		memcpy(buffer + destIndex, buffer + srcIndex, PID_SIZE);
-		j--;
+		int key = *(int*)keyPtr(eid);
+		if (key > searchKey || (lowerBound && key == searchKey)) break;
+		eid++;
 	}
-	*(PageId*)(buffer + 2 * sizeof(int) + sizeof(PageId) + i*PID_SIZE) = pid;
-	*(int*)(buffer + sizeof(int) + sizeof(PageId) + i*PID_SIZE) = key;
-
-	//------------------------split start---------------------------------------------
-	int lessKey = (MAX_KEY_NUMBER + 1) / 2;
-	int moreKey = MAX_KEY_NUMBER - lessKey;
-	*(int*)buffer = lessKey;
-	*(int*)sibling.buffer = moreKey;
-	memcpy(sibling.buffer + sizeof(int), buffer + sizeof(int) + (lessKey + 1)*PID_SIZE, moreKey*PID_SIZE + sizeof(PageId));
-	midKey = *(int*)(sibling.buffer + sizeof(int) + sizeof(PageId));
-	return 0;
+	return eid;
+}
 
+/*
+ * Read the eid-th key and the child pointer that follows it.
+ * With eid = -1, only the first child pointer is returned in pid.
+ * @param eid[IN] the entry number to read the (key, pid) pair from
+ * @param key[OUT] the key from the entry
+ * @param pid[OUT] the PageId behind the key
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::readEntry(int eid, int& key, PageId& pid)
+{
+	if (eid < -1 || eid >= getKeyCount()) return RC_INVALID_CURSOR;
+	pid = *(PageId*)childPtr(eid + 1);
+	if (eid >= 0) key = *(int*)keyPtr(eid);
+	return 0;
+}
 
+/*
+ * Return the number of index entries in the subtree of child i.
+ * @param i[IN] the number of the child pointer, from 0 to getKeyCount()
+ * @return the number of index entries below child i
+ */
+int BTNonLeafNode::getChildCount(int i)
+{
+	return *(int*)(childPtr(i) + sizeof(PageId));
 }
 
 /*
- * Given the searchKey, find the child-node pointer to follow and
- * output it in pid.
- * @param searchKey[IN] the searchKey that is being looked up.
- * @param pid[OUT] the pointer to the child node to follow.
+ * Set the number of index entries in the subtree of child i.
+ * @param i[IN] the number of the child pointer, from 0 to getKeyCount()
+ * @param count[IN] the number of index entries below child i
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
+RC BTNonLeafNode::setChildCount(int i, int count)
 {
-	int eid=0;
-	while (eid<getKeyCount())
-	{
-		if (*(int*)(buffer + sizeof(int) + sizeof(PageId) + eid*PID_SIZE) > searchKey) break;
-		eid++;
-	}
-	pid = *(PageId*)(buffer + sizeof(int) + eid*PID_SIZE);
+	if (i < 0 || i > getKeyCount()) return RC_INVALID_CURSOR;
+	*(int*)(childPtr(i) + sizeof(PageId)) = count;
 	return 0;
+}
 
+/*
+ * Return the number of index entries in the subtree of this node.
+ * @return the sum of the counts of all child pointers
+ */
+int BTNonLeafNode::getTotalCount()
+{
+	int total = 0;
+	for (int i = 0; i <= getKeyCount(); i++)
+		total += getChildCount(i);
+	return total;
+}
+
+/*
+ * Initialize the node with a single child pointer and no key.
+ * @param pid[IN] the first PageId of the node
+ * @param count[IN] the number of index entries in the subtree at pid
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::initialize(PageId pid, int count)
+{
+	*(int *)buffer = 0;
+	*(PageId *)childPtr(0) = pid;
+	*(int *)(childPtr(0) + sizeof(PageId)) = count;
+	return 0;
 }
 
 /*
  * Initialize the root node with (pid1, key, pid2).
  * @param pid1[IN] the first PageId to insert
+ * @param count1[IN] the number of index entries in the subtree at pid1
  * @param key[IN] the key that should be inserted between the two PageIds
  * @param pid2[IN] the PageId to insert behind the key
+ * @param count2[IN] the number of index entries in the subtree at pid2
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
+RC BTNonLeafNode::initializeRoot(PageId pid1, int count1, int key, PageId pid2, int count2)
 {
-	*(int *)buffer = 1;
-	*(int *)(buffer + sizeof(int) + sizeof(PageId)) = key;
-	*(PageId *)(buffer + sizeof(int)) = pid1;
-	*(PageId *)(buffer + sizeof(int) + PID_SIZE) = pid2;
-	return 0;
+	initialize(pid1, count1);
+	return insert(key, pid2, count2);
 
 }
@@ -16,6 +16,25 @@
 
 /**
  * BTLeafNode: The class representing a B+tree leaf node.
+ *
+ * On disk the entries of a leaf are compressed. Every key is stored once
+ * with the number of its entries (a posting list), as the first key
+ * followed by the deltas between neighbouring keys. The RecordIds of a key
+ * are kept sorted and are stored as runs of entries on the same page
+ * followed by the slot numbers. Deltas, entry counts, run pages, run
+ * lengths and slots are each bit packed relative to their smallest value
+ * (frame of reference), so a leaf holds as many entries as fit in the page
+ * once encoded: dense keys whose tuples share pages need a few bits per
+ * entry instead of 12 bytes.
+ *
+ * The entries of one key are never split between two leaves. If they do
+ * not fit in one, the last key of the leaf continues in overflow pages:
+ * leaves that hold only that key, which follow the leaf in the sibling
+ * chain but have no pointer in the parent node. The leaf records how many
+ * entries its overflow pages hold and which page is the last of them.
+ *
+ * read() decodes the page into the arrays of the node and write() encodes
+ * them again, so that the node can be searched and modified in memory.
  */
 class BTLeafNode {
   public:
@@ -30,17 +49,14 @@ class BTLeafNode {
     RC insert(int key, const RecordId& rid);
 
    /**
-    * Insert the (key, rid) pair to the node
-    * and split the node half and half with sibling.
-    * The first key of the sibling node is returned in siblingKey.
-    * Remember that all keys inside a B+tree node should be kept sorted.
-    * @param key[IN] the key to insert.
-    * @param rid[IN] the RecordId to insert.
-    * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
-    * @param siblingKey[OUT] the first key in the sibling node after split.
-    * @return 0 if successful. Return an error code if there is an error.
+    * Append the (key, rid) pair behind the last entry of the node.
+    * (key, rid) must not be smaller than the last entry in the node.
+    * This takes constant time, while insert() encodes the whole node again.
+    * @param key[IN] the key to append
+    * @param rid[IN] the RecordId to append
+    * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
+    RC append(int key, const RecordId& rid);
 
    /**
     * If searchKey exists in the node, set eid to the index entry
@@ -78,11 +94,45 @@ class BTLeafNode {
     */
     RC setNextNodePtr(PageId pid);
 
+   /**
+    * Return the pid of the previous slibling node.
+    * @return the PageId of the previous sibling node. -1 for the first leaf
+    */
+    PageId getPrevNodePtr();
+
+   /**
+    * Set the previous slibling node PageId.
+    * @param pid[IN] the PageId of the previous sibling node 
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setPrevNodePtr(PageId pid);
+
    /**
     * Return the number of keys stored in the node.
     * @return the number of keys in the node
     */
     int getKeyCount();
+
+   /**
+    * Return the number of entries of the last key in the overflow pages
+    * behind this node.
+    * @return the number of entries in the overflow pages. 0 if there are none
+    */
+    int getOverflowCount();
+
+   /**
+    * Return the last overflow page behind this node.
+    * @return the PageId of the last overflow page. -1 if there are none
+    */
+    PageId getOverflowTail();
+
+   /**
+    * Record the overflow pages behind this node.
+    * @param count[IN] the number of entries in the overflow pages
+    * @param tail[IN] the PageId of the last overflow page
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setOverflow(int count, PageId tail);
  
    /**
     * Read the content of the node from the page pid in the PageFile pf.
@@ -100,20 +150,65 @@ class BTLeafNode {
     */
     RC write(PageId pid, PageFile& pf);
 
-    static const int MAX_KEY_NUMBER = (PageFile::PAGE_SIZE - sizeof(PageId))/(sizeof(RecordId)+sizeof(int)) - 1;
-    static const int PID_SIZE = sizeof(RecordId)+sizeof(int);
+    /// the most entries a leaf can hold, however well they compress
+    static const int MAX_KEY_NUMBER = 512;
 
   private:
+    /// the page header: entry count, next and previous sibling, first key,
+    /// the bases of the key deltas and run pages, the # runs, the # keys,
+    /// the overflow count and tail, and the five bit widths
+    static const int HEADER_SIZE = 12 * sizeof(int);
+
+    /// the # bits available for the packed entries of a page
+    static const int PAYLOAD_BITS = (PageFile::PAGE_SIZE - HEADER_SIZE) * 8;
+
+    int      keyCount;
+    PageId   nextPid;
+    PageId   prevPid;
+    int      overflowCount;
+    PageId   overflowTail;
+    int      keys[MAX_KEY_NUMBER];
+    RecordId rids[MAX_KEY_NUMBER];
+
+    /// the frame of reference of the encoding: the ranges the packed
+    /// values fall in, from which their bit widths follow
+    typedef struct {
+      unsigned minDelta, maxDelta;  // smallest and largest delta between neighbouring keys
+      int      groupCount;          // # distinct keys
+      int      groupLength;         // # entries of the last key
+      int      maxGroupLength;      // # entries of the key with the most
+      unsigned minPid, maxPid;      // smallest and largest page of a RecordId run
+      unsigned maxSid;              // largest slot number
+      int      runCount;            // # runs of neighbouring entries on the same page
+      int      runLength;           // # entries in the last run
+      int      maxRunLength;        // # entries in the longest run
+    } Frame;
+
+    Frame    frame;
+    bool     framed;  /// false until the frame is computed for the entries read from disk
+
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * Recompute the frame of the encoding from the entries.
     */
-    char buffer[PageFile::PAGE_SIZE];
+    void measure();
+
+   /**
+    * Extend the frame by the eid-th entry, which follows the entries already in it.
+    */
+    void extendFrame(int eid);
+
+   /**
+    * @return the # bits the packed entries take with the current frame
+    */
+    int payloadBits() const;
 }; 
 
 
 /**
  * BTNonLeafNode: The class representing a B+tree nonleaf node.
+ * Every child pointer carries the number of index entries stored
+ * in the subtree below it, so that key ranges can be counted
+ * without visiting the leaves.
  */
 class BTNonLeafNode {
   public:
@@ -122,42 +217,71 @@ class BTNonLeafNode {
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
+    * @param count[IN] the number of index entries in the subtree at pid
     * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insert(int key, PageId pid);
+    RC insert(int key, PageId pid, int count);
 
    /**
-    * Insert the (key, pid) pair to the node
-    * and split the node half and half with sibling.
-    * The sibling node MUST be empty when this function is called.
-    * The middle key after the split is returned in midKey.
-    * Remember that all keys inside a B+tree node should be kept sorted.
-    * @param key[IN] the key to insert
-    * @param pid[IN] the PageId to insert
-    * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
-    * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+    * Given the searchKey, find the number of the child pointer to follow.
+    * Child i sits between the (i-1)-th and the i-th key.
+    * @param searchKey[IN] the searchKey that is being looked up.
+    * @param lowerBound[IN] if true, stop at the first key equal to
+    *                       searchKey instead of following it to the right.
+    * @return the number of the child pointer, from 0 to getKeyCount()
+    */
+    int locateChild(int searchKey, bool lowerBound);
+
+   /**
+    * Read the eid-th key and the child pointer that follows it.
+    * With eid = -1, only the first child pointer is returned in pid.
+    * @param eid[IN] the entry number to read the (key, pid) pair from
+    * @param key[OUT] the key from the entry
+    * @param pid[OUT] the PageId behind the key
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
+    RC readEntry(int eid, int& key, PageId& pid);
 
    /**
-    * Given the searchKey, find the child-node pointer to follow and
-    * output it in pid.
-    * Remember that the keys inside a B+tree node are sorted.
-    * @param searchKey[IN] the searchKey that is being looked up.
-    * @param pid[OUT] the pointer to the child node to follow.
+    * Return the number of index entries in the subtree of child i.
+    * @param i[IN] the number of the child pointer, from 0 to getKeyCount()
+    * @return the number of index entries below child i
+    */
+    int getChildCount(int i);
+
+   /**
+    * Set the number of index entries in the subtree of child i.
+    * @param i[IN] the number of the child pointer, from 0 to getKeyCount()
+    * @param count[IN] the number of index entries below child i
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setChildCount(int i, int count);
+
+   /**
+    * Return the number of index entries in the subtree of this node.
+    * @return the sum of the counts of all child pointers
+    */
+    int getTotalCount();
+
+   /**
+    * Initialize the node with a single child pointer and no key.
+    * Keys are added afterwards with insert().
+    * @param pid[IN] the first PageId of the node
+    * @param count[IN] the number of index entries in the subtree at pid
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC locateChildPtr(int searchKey, PageId& pid);
+    RC initialize(PageId pid, int count);
 
    /**
     * Initialize the root node with (pid1, key, pid2).
     * @param pid1[IN] the first PageId to insert
+    * @param count1[IN] the number of index entries in the subtree at pid1
     * @param key[IN] the key that should be inserted between the two PageIds
     * @param pid2[IN] the PageId to insert behind the key
+    * @param count2[IN] the number of index entries in the subtree at pid2
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC initializeRoot(PageId pid1, int key, PageId pid2);
+    RC initializeRoot(PageId pid1, int count1, int key, PageId pid2, int count2);
 
    /**
     * Return the number of keys stored in the node.
@@ -181,15 +305,23 @@ class BTNonLeafNode {
     */
     RC write(PageId pid, PageFile& pf);
 
-    static const int MAX_KEY_NUMBER = (PageFile::PAGE_SIZE - sizeof(PageId))/(sizeof(PageId)+sizeof(int)) - 1;
-    static const int PID_SIZE = sizeof(PageId)+sizeof(int);
+    // a child pointer is a (PageId, entry count) pair
+    static const int PTR_SIZE = sizeof(PageId)+sizeof(int);
+    static const int MAX_KEY_NUMBER = (PageFile::PAGE_SIZE - sizeof(int) - PTR_SIZE)/(PTR_SIZE+sizeof(int)) - 1;
+    static const int PID_SIZE = PTR_SIZE+sizeof(int);
 
   private:
    /**
     * The main memory buffer for loading the content of the disk page 
     * that contains the node.
+    * The layout is the key count, followed by child pointer 0 and then
+    * (key i, child pointer i+1) for every key.
     */
     char buffer[PageFile::PAGE_SIZE];
+
+    // the location of the i-th key and the i-th child pointer in the buffer
+    char* keyPtr(int i) { return buffer + sizeof(int) + PTR_SIZE + i*PID_SIZE; }
+    char* childPtr(int i) { return buffer + sizeof(int) + i*PID_SIZE; }
 }; 
 
 #endif /* BTREENODE_H */
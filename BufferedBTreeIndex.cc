@@ -0,0 +1,168 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+#include <algorithm>
+#include <climits>
+#include "BufferedBTreeIndex.h"
+
+using namespace std;
+
+/*
+ * BufferedBTreeIndex constructor
+ */
+BufferedBTreeIndex::BufferedBTreeIndex()
+{
+	buffered = 0;
+	buffers[INT_MIN];
+}
+
+/*
+ * Open the index file in read or write mode.
+ * @param indexname[IN] the name of the index file
+ * @param mode[IN] 'r' for read, 'w' for write
+ * @return error code. 0 if no error
+ */
+RC BufferedBTreeIndex::open(const string& indexname, char mode)
+{
+	RC rc;
+	if ((rc = tree.open(indexname, mode)) < 0) return rc;
+	return repartition();
+}
+
+/*
+ * Flush all buffered entries and close the index file.
+ * @return error code. 0 if no error
+ */
+RC BufferedBTreeIndex::close()
+{
+	RC rc = flush();
+	RC closeRc = tree.close();
+	return rc ? rc : closeRc;
+}
+
+/*
+ * Insert (key, RecordId) pair to the buffer of the root child
+ * whose subtree covers key.
+ * @param key[IN] the key for the value inserted into the index
+ * @param rid[IN] the RecordId for the record being inserted into the index
+ * @return error code. 0 if no error
+ */
+RC BufferedBTreeIndex::insert(int key, const RecordId& rid)
+{
+	IndexEntry entry;
+	entry.key = key;
+	entry.rid = rid;
+
+	//The first buffer is keyed by INT_MIN, so there is always one in front of key
+	map<int, vector<IndexEntry> >::iterator it = buffers.upper_bound(key);
+	(--it)->second.push_back(entry);
+	if (++buffered < BUFFER_CAPACITY) return 0;
+	return flushLargest();
+}
+
+/*
+ * Insert all buffered entries into the tree.
+ * @return error code. 0 if no error
+ */
+RC BufferedBTreeIndex::flush()
+{
+	RC rc;
+	if (buffered == 0) return 0;
+
+	vector<IndexEntry> entries;
+	entries.reserve(buffered);
+	for (map<int, vector<IndexEntry> >::iterator it = buffers.begin(); it != buffers.end(); ++it)
+	{
+		entries.insert(entries.end(), it->second.begin(), it->second.end());
+		vector<IndexEntry>().swap(it->second);
+	}
+	buffered = 0;
+	sort(entries.begin(), entries.end());
+	if ((rc = tree.insertBatch(&entries[0], entries.size())) < 0) return rc;
+	return repartition();
+}
+
+/*
+ * Flush the buffer with the most entries into the tree.
+ * Its entries all belong to one child subtree of the root, so the batch
+ * only reads and writes the nodes of that subtree.
+ * @return error code. 0 if no error
+ */
+RC BufferedBTreeIndex::flushLargest()
+{
+	RC rc;
+	map<int, vector<IndexEntry> >::iterator largest = buffers.begin();
+	for (map<int, vector<IndexEntry> >::iterator it = buffers.begin(); it != buffers.end(); ++it)
+		if (it->second.size() > largest->second.size()) largest = it;
+
+	vector<IndexEntry> entries;
+	entries.swap(largest->second);
+	buffered -= entries.size();
+	sort(entries.begin(), entries.end());
+	if ((rc = tree.insertBatch(&entries[0], entries.size())) < 0) return rc;
+
+	//The batch may have split the root or added keys to it
+	return repartition();
+}
+
+/*
+ * Split the buffers again by the current root keys
+ * if the root has changed since they were split.
+ * @return error code. 0 if no error
+ */
+RC BufferedBTreeIndex::repartition()
+{
+	RC rc;
+	vector<int> keys;
+	if ((rc = tree.readRootKeys(keys)) < 0) return rc;
+	if (keys == rootKeys) return 0;
+	rootKeys = keys;
+
+	vector<IndexEntry> entries;
+	entries.reserve(buffered);
+	for (map<int, vector<IndexEntry> >::iterator it = buffers.begin(); it != buffers.end(); ++it)
+		entries.insert(entries.end(), it->second.begin(), it->second.end());
+
+	buffers.clear();
+	buffers[INT_MIN];
+	for (unsigned i = 0; i < rootKeys.size(); i++)
+		buffers[rootKeys[i]];
+	for (unsigned i = 0; i < entries.size(); i++)
+	{
+		map<int, vector<IndexEntry> >::iterator it = buffers.upper_bound(entries[i].key);
+		(--it)->second.push_back(entries[i]);
+	}
+	return 0;
+}
+
+RC BufferedBTreeIndex::locate(int searchKey, IndexCursor& cursor)
+{
+	RC rc;
+	if ((rc = flush()) < 0) return rc;
+	return tree.locate(searchKey, cursor);
+}
+
+RC BufferedBTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
+{
+	return tree.readForward(cursor, key, rid);
+}
+
+RC BufferedBTreeIndex::locateLast(int searchKey, IndexCursor& cursor)
+{
+	RC rc;
+	if ((rc = flush()) < 0) return rc;
+	return tree.locateLast(searchKey, cursor);
+}
+
+RC BufferedBTreeIndex::readBackward(IndexCursor& cursor, int& key, RecordId& rid)
+{
+	return tree.readBackward(cursor, key, rid);
+}
+
+RC BufferedBTreeIndex::countRange(int lo, int hi, int& count)
+{
+	RC rc;
+	if ((rc = flush()) < 0) return rc;
+	return tree.countRange(lo, hi, count);
+}
@@ -0,0 +1,120 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BUFFEREDBTREEINDEX_H
+#define BUFFEREDBTREEINDEX_H
+
+#include <map>
+#include <vector>
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+
+/**
+ * A write-optimized B+tree index for bulk ingest of random keys.
+ *
+ * Inserts do not descend the tree. They are appended to message buffers
+ * in memory, one for every child subtree of the root. This is only the
+ * top level of a B-epsilon tree: the nodes on disk have no buffers. When
+ * the buffers hold BUFFER_CAPACITY entries, the buffer of the child with
+ * the most pending entries is flushed into the tree with
+ * BTreeIndex::insertBatch(), so that every leaf it touches is written once
+ * for all the entries it receives instead of once per entry.
+ *
+ * The buffers are flushed completely before the tree is searched and on
+ * close(), so the index file has the same format as a BTreeIndex and can
+ * be opened by either class. The entries still buffered are lost if the
+ * index is not closed with close().
+ */
+class BufferedBTreeIndex {
+ public:
+  /// the number of entries buffered before a child buffer is flushed
+  static const int BUFFER_CAPACITY = 65536;
+
+  BufferedBTreeIndex();
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file should be created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * Flush all buffered entries and close the index file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * Insert (key, RecordId) pair to the buffer of the root child
+   * whose subtree covers key.
+   * @param key[IN] the key for the value inserted into the index
+   * @param rid[IN] the RecordId for the record being inserted into the index
+   * @return error code. 0 if no error
+   */
+  RC insert(int key, const RecordId& rid);
+
+  /**
+   * Insert all buffered entries into the tree.
+   * @return error code. 0 if no error
+   */
+  RC flush();
+
+  /**
+   * Flush the buffers and find searchKey as BTreeIndex::locate() does.
+   */
+  RC locate(int searchKey, IndexCursor& cursor);
+
+  /**
+   * Read the entry at cursor and move it forward as BTreeIndex::readForward() does.
+   */
+  RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
+
+  /**
+   * Flush the buffers and find the last entry not larger than searchKey
+   * as BTreeIndex::locateLast() does.
+   */
+  RC locateLast(int searchKey, IndexCursor& cursor);
+
+  /**
+   * Read the entry at cursor and move it back as BTreeIndex::readBackward() does.
+   */
+  RC readBackward(IndexCursor& cursor, int& key, RecordId& rid);
+
+  /**
+   * Flush the buffers and count the entries in [lo, hi]
+   * as BTreeIndex::countRange() does.
+   */
+  RC countRange(int lo, int hi, int& count);
+
+  /**
+   * @return the height of the tree, not counting the buffered entries
+   */
+  int getTreeHeight() const { return tree.getTreeHeight(); }
+
+ private:
+  BTreeIndex tree;   /// the tree the buffered entries are flushed into
+
+  /// the buffers of the root children, keyed by the smallest key of the
+  /// child subtree (INT_MIN for the first child)
+  std::map<int, std::vector<IndexEntry> > buffers;
+  std::vector<int> rootKeys;  /// the root keys the buffers were split by
+  int buffered;               /// # entries in all buffers
+
+  /**
+   * Flush the buffer with the most entries into the tree.
+   */
+  RC flushLargest();
+
+  /**
+   * Split the buffers again by the current root keys
+   * if the root has changed since they were split.
+   */
+  RC repartition();
+};
+
+#endif /* BUFFEREDBTREEINDEX_H */
@@ -0,0 +1,65 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <climits>
+#include "Catalog.h"
+
+using std::map;
+using std::string;
+
+map<string, TableHandle*> Catalog::tables;
+
+RC Catalog::open(const string& table, TableHandle*& t)
+{
+  RC rc;
+  map<string, TableHandle*>::iterator it = tables.find(table);
+  if (it != tables.end()) {
+    t = it->second;
+    return 0;
+  }
+
+  t = new TableHandle;
+  t->name = table;
+  if ((rc = t->rf.open(table + ".tbl", 'r')) < 0) {
+    delete t;
+    t = NULL;
+    return rc;
+  }
+  t->indexed = (t->index.open(table + ".idx", 'r') == 0);
+  t->hasStats = (t->stats.load(table) == 0 && t->stats.rowCount > 0);
+  t->entryCount = -1;
+  tables[table] = t;
+  return 0;
+}
+
+void Catalog::invalidate(const string& table)
+{
+  map<string, TableHandle*>::iterator it = tables.find(table);
+  if (it == tables.end()) return;
+
+  TableHandle* t = it->second;
+  if (t->indexed) t->index.close();
+  t->rf.close();
+  delete t;
+  tables.erase(it);
+}
+
+void Catalog::closeAll()
+{
+  for (map<string, TableHandle*>::iterator it = tables.begin(); it != tables.end(); ++it) {
+    TableHandle* t = it->second;
+    if (t->indexed) t->index.close();
+    t->rf.close();
+    delete t;
+  }
+  tables.clear();
+}
+
+int Catalog::entryCount(TableHandle& t)
+{
+  if (t.entryCount < 0 && (!t.indexed || t.index.countRange(INT_MIN, INT_MAX, t.entryCount) < 0))
+    t.entryCount = 0;
+  return t.entryCount;
+}
@@ -0,0 +1,68 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <map>
+#include <string>
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include "RecordFile.h"
+#include "TableStats.h"
+
+/**
+ * The open files of a table and the metadata queries plan with: the table
+ * file knows its endRid, the index its root and height, and the statistics
+ * and the # index entries are read once.
+ */
+struct TableHandle {
+  std::string name;
+  RecordFile  rf;
+  BTreeIndex  index;
+  bool        indexed;      // true if the table has an index and it is open
+  TableStats  stats;
+  bool        hasStats;     // true if the table has statistics with any tuple
+  int         entryCount;   // # index entries. -1 until counted
+};
+
+/**
+ * The tables opened by the queries of the session. A table is opened on
+ * its first query and stays open for the next ones, until a command that
+ * changes its files invalidates it.
+ */
+class Catalog {
+ public:
+  /**
+   * look up the handle of a table, opening its files on first use.
+   * @param table[IN] the table name
+   * @param t[OUT] the handle. it is valid until the table is invalidated
+   * @return error code. 0 if no error
+   */
+  static RC open(const std::string& table, TableHandle*& t);
+
+  /**
+   * close the files of a table and forget its metadata. LOAD, CREATE INDEX
+   * and ANALYZE call it before they change the files of the table.
+   * @param table[IN] the table name
+   */
+  static void invalidate(const std::string& table);
+
+  /**
+   * close the files of every table and forget them all, as at the end
+   * of a session.
+   */
+  static void closeAll();
+
+  /**
+   * @return # entries in the index of a table, counted on first use
+   */
+  static int entryCount(TableHandle& t);
+
+ private:
+  static std::map<std::string, TableHandle*> tables;
+};
+
+#endif /* CATALOG_H */
@@ -0,0 +1,86 @@
+/**
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Compare the ingest cost of BTreeIndex::insert() and BufferedBTreeIndex
+ * under a load of random keys.
+ *
+ * usage: indexbench [# keys] [random seed]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <unistd.h>
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include "BufferedBTreeIndex.h"
+
+using namespace std;
+
+static const char* BTREE_FILE = "indexbench.btree.idx";
+static const char* BUFFERED_FILE = "indexbench.buffered.idx";
+
+static void report(const char* name, clock_t ticks, int reads, int writes, int n)
+{
+  fprintf(stdout, "%-22s %8.3f s %10d page reads %10d page writes %8.3f writes/key\n",
+          name, (double)ticks / CLOCKS_PER_SEC, reads, writes, (double)writes / n);
+}
+
+int main(int argc, char** argv)
+{
+  int n = (argc > 1) ? atoi(argv[1]) : 200000;
+  srand((argc > 2) ? atoi(argv[2]) : 1);
+
+  vector<int> keys(n);
+  for (int i = 0; i < n; i++) keys[i] = rand();
+
+  RecordId rid;
+  clock_t  start;
+  int      reads, writes;
+
+  // BTreeIndex, one insert() per key
+  unlink(BTREE_FILE);
+  BTreeIndex btree;
+  if (btree.open(BTREE_FILE, 'w')) {
+    fprintf(stderr, "Error: cannot create %s\n", BTREE_FILE);
+    return 1;
+  }
+  start = clock();
+  reads = PageFile::getPageReadCount();
+  writes = PageFile::getPageWriteCount();
+  for (int i = 0; i < n; i++) {
+    rid.pid = i / RecordFile::RECORDS_PER_PAGE;
+    rid.sid = i % RecordFile::RECORDS_PER_PAGE;
+    btree.insert(keys[i], rid);
+  }
+  btree.close();
+  report("BTreeIndex::insert", clock() - start, PageFile::getPageReadCount() - reads,
+         PageFile::getPageWriteCount() - writes, n);
+
+  // BufferedBTreeIndex, the same keys in the same order
+  unlink(BUFFERED_FILE);
+  BufferedBTreeIndex buffered;
+  if (buffered.open(BUFFERED_FILE, 'w')) {
+    fprintf(stderr, "Error: cannot create %s\n", BUFFERED_FILE);
+    return 1;
+  }
+  start = clock();
+  reads = PageFile::getPageReadCount();
+  writes = PageFile::getPageWriteCount();
+  for (int i = 0; i < n; i++) {
+    rid.pid = i / RecordFile::RECORDS_PER_PAGE;
+    rid.sid = i % RecordFile::RECORDS_PER_PAGE;
+    buffered.insert(keys[i], rid);
+  }
+  buffered.close();
+  report("BufferedBTreeIndex", clock() - start, PageFile::getPageReadCount() - reads,
+         PageFile::getPageWriteCount() - writes, n);
+
+  unlink(BTREE_FILE);
+  unlink(BUFFERED_FILE);
+  return 0;
+}
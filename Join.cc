@@ -0,0 +1,324 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <algorithm>
+#include "Join.h"
+
+using std::string;
+using std::vector;
+
+JoinOutput::JoinOutput(ResultSink& sink, const vector<Column>& columns) : sink(sink), columns(columns)
+{
+  count = 0;
+}
+
+void JoinOutput::put(int key, const char* leftValue, int leftLen, const char* rightValue, int rightLen)
+{
+  count++;
+  if (columns.empty()) return;
+
+  sink.beginRow();
+  for (unsigned i = 0; i < columns.size(); i++) {
+    switch (columns[i]) {
+    case KEY:
+      sink.putInt(key);
+      break;
+    case LEFT_VALUE:
+      sink.putValue(leftValue, leftLen);
+      break;
+    case RIGHT_VALUE:
+      sink.putValue(rightValue, rightLen);
+      break;
+    }
+  }
+  sink.endRow();
+}
+
+IndexNestedLoopJoin::IndexNestedLoopJoin(JoinOutput& out, JoinTable& inner, bool innerLeft)
+  : out(out), inner(inner)
+{
+  this->innerLeft = innerLeft;
+  looked = false;
+  lastKey = 0;
+  matches = 0;
+}
+
+RC IndexNestedLoopJoin::add(int key, const char* value, int len)
+{
+  RC rc;
+  if (out.full() || !inner.pred.matchKey(key)) return 0;
+
+  // look up the inner tuples with the key, unless it is the key of the last tuple
+  if (!looked || key != lastKey) {
+    IndexCursor cursor;
+    RecordId rid;
+    int k;
+    string v;
+
+    looked = true;
+    lastKey = key;
+    matches = 0;
+    values.clear();
+    inner.table->index.locate(key, cursor);
+    while (inner.table->index.readForward(cursor, k, rid) == 0 && k == key) {
+      if (inner.needValue) {
+        if ((rc = inner.table->rf.read(rid, k, v)) < 0) return rc;
+        if (!inner.pred.matchValue(key, v.c_str())) continue;
+        values.push_back(v);
+      }
+      matches++;
+    }
+  }
+
+  for (int i = 0; i < matches && !out.full(); i++) {
+    const char* v = inner.needValue ? values[i].data() : "";
+    int l = inner.needValue ? values[i].size() : 0;
+    if (innerLeft) out.put(key, v, l, value, len);
+    else out.put(key, value, len, v, l);
+  }
+  return 0;
+}
+
+HashJoin::HashJoin(JoinOutput& out, bool buildLeft, int level) : out(out)
+{
+  this->buildLeft = buildLeft;
+  this->level = level;
+  probing = false;
+}
+
+HashJoin::~HashJoin()
+{
+  for (unsigned i = 0; i < writers.size(); i++) delete writers[i];
+  for (unsigned i = 0; i < buildParts.size(); i++) delete buildParts[i];
+  for (unsigned i = 0; i < probeParts.size(); i++) delete probeParts[i];
+}
+
+unsigned HashJoin::hash(int key) const
+{
+  // the finalizer of MurmurHash3, with the key offset by the level
+  // so that the tuples of one partition spread over the next level
+  unsigned h = (unsigned)key + level * 0x9e3779b9u;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+RC HashJoin::add(int key, const char* value, int len)
+{
+  if (!probing) {
+    if (!buildParts.empty()) {
+      unsigned p = hash(key) >> 28;
+      buildCounts[p]++;
+      return writers[p]->put(key, value, len);
+    }
+
+    Tuple t;
+    t.key = key;
+    t.offset = arena.size();
+    t.len = len;
+    t.next = -1;
+    tuples.push_back(t);
+    arena.append(value, len);
+    if (arena.size() + tuples.size() * sizeof(Tuple) > (unsigned)MEMORY_BUDGET && level < MAX_LEVEL)
+      return spill();
+    return 0;
+  }
+
+  // a probe tuple goes to its partition, unless no build tuple can match it
+  if (!probeParts.empty()) {
+    unsigned p = hash(key) >> 28;
+    return buildCounts[p] ? writers[p]->put(key, value, len) : 0;
+  }
+  if (tuples.empty() || out.full()) return 0;
+
+  unsigned mask = heads.size() - 1;
+  for (int i = heads[hash(key) & mask]; i >= 0 && !out.full(); i = tuples[i].next) {
+    const Tuple& t = tuples[i];
+    if (t.key == key) put(key, arena.data() + t.offset, t.len, value, len);
+  }
+  return 0;
+}
+
+RC HashJoin::probe()
+{
+  RC rc;
+  probing = true;
+
+  if (!buildParts.empty()) {
+    if ((rc = finishPartitions()) < 0) return rc;
+    return createPartitions(probeParts);
+  }
+
+  // chain the build tuples. a chain is walked from its first tuple,
+  // so the tuples are pushed in reverse to keep their order
+  unsigned size = 1;
+  while (size < tuples.size()) size *= 2;
+  heads.assign(size, -1);
+  for (int i = (int)tuples.size() - 1; i >= 0; i--) {
+    int& head = heads[hash(tuples[i].key) & (size - 1)];
+    tuples[i].next = head;
+    head = i;
+  }
+  return 0;
+}
+
+RC HashJoin::spill()
+{
+  RC rc;
+  if ((rc = createPartitions(buildParts)) < 0) return rc;
+  buildCounts.assign(PARTITION_COUNT, 0);
+
+  for (unsigned i = 0; i < tuples.size(); i++) {
+    unsigned p = hash(tuples[i].key) >> 28;
+    buildCounts[p]++;
+    if ((rc = writers[p]->put(tuples[i].key, arena.data() + tuples[i].offset, tuples[i].len)) < 0) return rc;
+  }
+  vector<Tuple>().swap(tuples);
+  string().swap(arena);
+  return 0;
+}
+
+RC HashJoin::createPartitions(vector<SpillFile*>& parts)
+{
+  RC rc;
+  for (int i = 0; i < PARTITION_COUNT; i++) {
+    parts.push_back(new SpillFile);
+    if ((rc = parts.back()->create()) < 0) return rc;
+    writers.push_back(new SpillWriter(*parts.back()));
+  }
+  return 0;
+}
+
+RC HashJoin::finishPartitions()
+{
+  RC rc = 0;
+  for (unsigned i = 0; i < writers.size(); i++) {
+    if (rc == 0) rc = writers[i]->finish();
+    delete writers[i];
+  }
+  writers.clear();
+  return rc;
+}
+
+RC HashJoin::finish()
+{
+  RC rc;
+  if (probeParts.empty()) return 0;
+  if ((rc = finishPartitions()) < 0) return rc;
+
+  // join every pair of partitions by itself, one at a time
+  for (int p = 0; p < PARTITION_COUNT && !out.full(); p++) {
+    if (buildCounts[p] == 0) continue;
+    HashJoin join(out, buildLeft, level + 1);
+    SpillReader build(*buildParts[p]);
+    while (build.next())
+      if ((rc = join.add(build.key, build.value, build.len)) < 0) return rc;
+    if (build.rc < 0) return build.rc;
+    if ((rc = join.probe()) < 0) return rc;
+
+    SpillReader probe(*probeParts[p]);
+    while (probe.next() && !out.full())
+      if ((rc = join.add(probe.key, probe.value, probe.len)) < 0) return rc;
+    if (probe.rc < 0) return probe.rc;
+    if ((rc = join.finish()) < 0) return rc;
+
+    delete buildParts[p];
+    delete probeParts[p];
+    buildParts[p] = probeParts[p] = NULL;
+  }
+  return 0;
+}
+
+// the index entries of one table with the same key, and the values of
+// their tuples that meet the conditions if the values are needed
+struct KeyGroup {
+  int key;
+  vector<RecordId> rids;
+  vector<string> values;
+  int matches;
+};
+
+// read the entries of the key at the cursor into group, and their tuples
+// if fetch is set and the values are needed. on return, key and rid hold
+// the first entry with a larger key, and valid is false if there is none
+// in [.., hi]
+static RC readGroup(JoinTable& t, IndexCursor& cursor, int hi, int& key, RecordId& rid, bool& valid,
+  bool fetch, KeyGroup& group)
+{
+  RC rc;
+  group.key = key;
+  group.rids.clear();
+  do {
+    group.rids.push_back(rid);
+    valid = (t.table->index.readForward(cursor, key, rid) == 0 && key <= hi);
+  } while (valid && key == group.key);
+
+  group.values.clear();
+  group.matches = 0;
+  if (!fetch) return 0;
+  if (!t.needValue) {
+    group.matches = group.rids.size();
+    return 0;
+  }
+
+  // read the tuples in page order
+  int k;
+  string v;
+  sort(group.rids.begin(), group.rids.end());
+  for (unsigned i = 0; i < group.rids.size(); i++) {
+    if ((rc = t.table->rf.read(group.rids[i], k, v)) < 0) return rc;
+    if (!t.pred.matchValue(k, v.c_str())) continue;
+    group.values.push_back(v);
+    group.matches++;
+  }
+  return 0;
+}
+
+RC mergeJoin(JoinTable& left, JoinTable& right, JoinOutput& out)
+{
+  RC rc;
+  int lo = std::max(left.pred.keyMin, right.pred.keyMin);
+  int hi = std::min(left.pred.keyMax, right.pred.keyMax);
+  if (lo > hi) return 0;
+
+  IndexCursor lcur, rcur;
+  int lk, rk;
+  RecordId lrid, rrid;
+  left.table->index.locate(lo, lcur);
+  right.table->index.locate(lo, rcur);
+  bool lvalid = (left.table->index.readForward(lcur, lk, lrid) == 0 && lk <= hi);
+  bool rvalid = (right.table->index.readForward(rcur, rk, rrid) == 0 && rk <= hi);
+
+  KeyGroup lg, rg;
+  const string none;   // the value of a table whose values are not needed
+  while (lvalid && rvalid && !out.full()) {
+    if (lk < rk) {
+      lvalid = (left.table->index.readForward(lcur, lk, lrid) == 0 && lk <= hi);
+      continue;
+    }
+    if (rk < lk) {
+      rvalid = (right.table->index.readForward(rcur, rk, rrid) == 0 && rk <= hi);
+      continue;
+    }
+
+    // the same key on both sides: join all entries with it. the tuples
+    // of the right table are not read if no left tuple meets the conditions
+    int key = lk;
+    bool match = left.pred.matchKey(key);
+    if ((rc = readGroup(left, lcur, hi, lk, lrid, lvalid, match, lg)) < 0) return rc;
+    if ((rc = readGroup(right, rcur, hi, rk, rrid, rvalid, lg.matches > 0, rg)) < 0) return rc;
+    for (int i = 0; i < lg.matches; i++) {
+      const string& lv = left.needValue ? lg.values[i] : none;
+      for (int j = 0; j < rg.matches && !out.full(); j++) {
+        const string& rv = right.needValue ? rg.values[j] : none;
+        out.put(key, lv.data(), lv.size(), rv.data(), rv.size());
+      }
+    }
+  }
+  return 0;
+}
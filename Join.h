@@ -0,0 +1,200 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include "Catalog.h"
+#include "Predicate.h"
+#include "ResultSink.h"
+#include "SpillFile.h"
+
+/**
+ * A table of a join with the conditions on it.
+ */
+struct JoinTable {
+  std::string  name;
+  TableHandle* table;      // the open files of the table
+  Predicate    pred;       // the conditions on the table, including every key condition of the join
+  bool         needValue;  // true if the values of the table are selected or tested
+  double       rows;       // the estimated # tuples that meet pred
+};
+
+/**
+ * Outputs the rows of a join, or only counts them for COUNT(*).
+ * The tables are joined on key, so both tuples of a row have the same key.
+ */
+class JoinOutput {
+ public:
+  /// the columns of a row
+  enum Column { KEY, LEFT_VALUE, RIGHT_VALUE };
+
+  int count;   // # rows joined
+
+  /**
+   * @param columns[IN] the columns of a row. empty for COUNT(*)
+   */
+  JoinOutput(ResultSink& sink, const std::vector<Column>& columns);
+
+  /**
+   * output the row of a tuple of the left table and one of the right table.
+   * @param leftLen[IN] the length of leftValue
+   * @param rightLen[IN] the length of rightValue
+   */
+  void put(int key, const char* leftValue, int leftLen, const char* rightValue, int rightLen);
+
+  /**
+   * @return true if the LIMIT has been reached
+   */
+  bool full() const { return sink.full(); }
+
+ private:
+  ResultSink& sink;
+  std::vector<Column> columns;
+};
+
+/**
+ * Joins the tuples of a scan of the outer table with the inner table by
+ * looking up every outer key in the index of the inner table. The inner
+ * tuples are read only if their values are needed; the matches of the
+ * last key are kept, so that a run of equal outer keys is looked up once.
+ */
+class IndexNestedLoopJoin : public RowConsumer {
+ public:
+  /**
+   * @param inner[IN] the inner table. its index must be open
+   * @param innerLeft[IN] true if the inner table is the left table of the join
+   */
+  IndexNestedLoopJoin(JoinOutput& out, JoinTable& inner, bool innerLeft);
+
+  /**
+   * take a tuple of the outer table and output its rows.
+   */
+  RC add(int key, const char* value, int len);
+
+ private:
+  JoinOutput& out;
+  JoinTable&  inner;
+  bool        innerLeft;
+  bool        looked;                    // true once a key has been looked up
+  int         lastKey;                   // the key looked up last
+  int         matches;                   // # inner tuples that meet the conditions with that key
+  std::vector<std::string> values;       // their values, if needed
+};
+
+/**
+ * A grace hash join. The tuples of the build input, normally the smaller
+ * table, are added first and kept in a hash table chained on the key;
+ * after probe() the tuples of the probe input look up their matches.
+ *
+ * When the build input outgrows MEMORY_BUDGET, both inputs are divided
+ * into PARTITION_COUNT spill files by the top bits of the hash of the key,
+ * and finish() joins every pair of partitions with another HashJoin that
+ * hashes with another seed.
+ */
+class HashJoin : public RowConsumer {
+ public:
+  /// the most bytes the hash table and the values of the build input may take
+  static const int MEMORY_BUDGET = 16 * 1024 * 1024;
+
+  /// # partitions of a join that does not fit in memory
+  static const int PARTITION_COUNT = 16;
+
+  /**
+   * @param buildLeft[IN] true if the build input is the left table of the join
+   * @param level[IN] # times the inputs have been partitioned already
+   */
+  HashJoin(JoinOutput& out, bool buildLeft, int level = 0);
+  ~HashJoin();
+
+  /**
+   * take a tuple of the build input, or of the probe input after probe().
+   */
+  RC add(int key, const char* value, int len);
+
+  /**
+   * end the build input. the tuples added from now on are probed.
+   * @return error code. 0 if no error
+   */
+  RC probe();
+
+  /**
+   * end the probe input and join the partitions that were spilled.
+   * @return error code. 0 if no error
+   */
+  RC finish();
+
+ private:
+  /// a build tuple. next is the index of the next tuple of its chain, or -1
+  struct Tuple {
+    int key;
+    int offset;   // the offset of the value in the arena
+    int len;
+    int next;
+  };
+
+  /// the deepest level that still spills. below it, the table just grows
+  static const int MAX_LEVEL = 4;
+
+  JoinOutput& out;
+  bool  buildLeft;
+  int   level;
+  bool  probing;                           // true after probe()
+  std::vector<Tuple> tuples;               // the build tuples in memory
+  std::string arena;                       // their values
+  std::vector<int> heads;                  // the first tuple of every chain. its size is a power of 2
+  std::vector<SpillFile*>   buildParts;    // the partitions, once spilled
+  std::vector<SpillFile*>   probeParts;
+  std::vector<SpillWriter*> writers;       // the writers of the input being partitioned
+  std::vector<int> buildCounts;            // # build tuples of every partition
+
+  /**
+   * @return the hash of a key, seeded with the level
+   */
+  unsigned hash(int key) const;
+
+  /**
+   * output the row of a build and a probe tuple in the order of the tables.
+   */
+  void put(int key, const char* buildValue, int buildLen, const char* probeValue, int probeLen)
+  {
+    if (buildLeft) out.put(key, buildValue, buildLen, probeValue, probeLen);
+    else out.put(key, probeValue, probeLen, buildValue, buildLen);
+  }
+
+  /**
+   * create the partitions of the build input and write out the tuples in memory.
+   * @return error code. 0 if no error
+   */
+  RC spill();
+
+  /**
+   * create a spill file and writer for every partition.
+   * @param parts[OUT] the spill files
+   * @return error code. 0 if no error
+   */
+  RC createPartitions(std::vector<SpillFile*>& parts);
+
+  /**
+   * finish and delete the writers of the partitions.
+   * @return error code. 0 if no error
+   */
+  RC finishPartitions();
+};
+
+/**
+ * Join two indexed tables by reading their index entries side by side in
+ * key order over the key range of the conditions. The tuples of a table
+ * are read only if their values are needed, so a join that selects keys
+ * or COUNT(*) reads nothing but the leaves of the two indexes.
+ * @return error code. 0 if no error
+ */
+RC mergeJoin(JoinTable& left, JoinTable& right, JoinOutput& out);
+
+#endif /* JOIN_H */
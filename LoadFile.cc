@@ -0,0 +1,160 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "LoadFile.h"
+
+// @return the first c in [p, end), or end if there is none
+static const char* findByte(const char* p, const char* end, char c)
+{
+#ifdef __SSE2__
+  __m128i needle = _mm_set1_epi8(c);
+  for (; end - p >= 16; p += 16) {
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), needle));
+    if (mask) return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p < end; p++) {
+    if (*p == c) return p;
+  }
+  return end;
+}
+
+// read an integer at p the way atoi() does: white spaces, an optional
+// sign and the digits. a number out of the range of long is clamped to
+// it, and the result is then cut to int, as (int)strtol() does.
+// @return the first byte after the number
+static const char* parseKey(const char* p, const char* end, int& key)
+{
+  while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) p++;
+
+  bool negative = false;
+  if (p < end && (*p == '+' || *p == '-')) negative = (*p++ == '-');
+
+  unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+  unsigned long v = 0;
+  for (; p < end; p++) {
+    unsigned d = (unsigned char)*p - '0';
+    if (d > 9) break;
+    // below LONG_MAX / 10 another digit cannot overflow
+    if (v < (unsigned long)LONG_MAX / 10 || v <= (limit - d) / 10) v = v * 10 + d;
+    else v = limit;
+  }
+  key = (int)(negative ? 0 - v : v);
+  return p;
+}
+
+LoadFile::LoadFile()
+{
+  begin = NULL;
+  length = 0;
+  mapped = false;
+}
+
+LoadFile::~LoadFile()
+{
+  close();
+}
+
+RC LoadFile::open(const std::string& filename)
+{
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return RC_FILE_OPEN_FAILED;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    length = st.st_size;
+    if (length == 0) {
+      ::close(fd);
+      return 0;
+    }
+    void* p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      madvise(p, length, MADV_SEQUENTIAL);
+      begin = (char*)p;
+      mapped = true;
+      ::close(fd);
+      return 0;
+    }
+  }
+
+  // read the file into a buffer that doubles as it fills
+  size_t capacity = 0;
+  length = 0;
+  for (;;) {
+    if (length == capacity) {
+      capacity = capacity ? capacity * 2 : 1 << 20;
+      char* p = (char*)realloc(begin, capacity);
+      if (p == NULL) break;
+      begin = p;
+    }
+    ssize_t n = read(fd, begin + length, capacity - length);
+    if (n <= 0) {
+      ::close(fd);
+      if (n == 0) return 0;
+      close();
+      return RC_FILE_READ_FAILED;
+    }
+    length += n;
+  }
+  ::close(fd);
+  close();
+  return RC_FILE_READ_FAILED;
+}
+
+void LoadFile::close()
+{
+  if (mapped) munmap(begin, length);
+  else free(begin);
+  begin = NULL;
+  length = 0;
+  mapped = false;
+}
+
+size_t LoadFile::lineStart(size_t offset) const
+{
+  if (offset == 0) return 0;
+  if (offset >= length) return length;
+  if (begin[offset - 1] == '\n') return offset;
+  const char* p = findByte(begin + offset, begin + length, '\n');
+  return (p == begin + length) ? length : p - begin + 1;
+}
+
+const char* LoadFile::lineEnd(const char* line, const char* end)
+{
+  return findByte(line, end, '\n');
+}
+
+RC LoadFile::parseLine(const char* line, const char* end, int& key, const char*& value, int& len)
+{
+  // get the integer key value, and look for the comma after it
+  const char* s = parseKey(line, end, key);
+  s = findByte(s, end, ',');
+  if (s == end) return RC_INVALID_FILE_FORMAT;
+
+  // ignore white spaces
+  for (s++; s < end && (*s == ' ' || *s == '\t'); s++) ;
+
+  // a value delimited by ' or " ends at the same quote,
+  // and any other value at the end of the line
+  const char* e = end;
+  if (s < end && (*s == '\'' || *s == '"')) {
+    char quote = *s++;
+    e = findByte(s, end, quote);
+  }
+  value = s;
+  len = e - s;
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef LOADFILE_H
+#define LOADFILE_H
+
+#include <string>
+#include "Bruinbase.h"
+
+/**
+ * A load file, mapped into memory so that its lines can be parsed
+ * anywhere in it, such as in chunks by several threads.
+ *
+ * A line holds the key and the value of a tuple separated by a comma.
+ * The value may be enclosed in ' or ", and otherwise runs to the end of
+ * the line. Lines and values are returned as pointers into the file, so
+ * reading a file allocates and copies nothing. The line breaks, commas
+ * and quotes are found 16 bytes at a time with SSE2 where the compiler
+ * supports it.
+ */
+class LoadFile {
+ public:
+  LoadFile();
+  ~LoadFile();
+
+  /**
+   * map a file into memory. a file that cannot be mapped, such as a
+   * pipe, is read into memory instead.
+   * @param filename[IN] the name of the file
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& filename);
+
+  /**
+   * unmap the file.
+   */
+  void close();
+
+  /**
+   * @param offset[IN] an offset in the file
+   * @return the offset of the first line that starts at or after offset,
+   *         or size() if there is none
+   */
+  size_t lineStart(size_t offset) const;
+
+  /**
+   * @return the bytes of the file
+   */
+  const char* data() const { return begin; }
+
+  /**
+   * @return # bytes in the file
+   */
+  size_t size() const { return length; }
+
+  /**
+   * @param line[IN] the first byte of a line
+   * @param end[IN] the end of the bytes the line is in
+   * @return the end of the line, without the line break
+   */
+  static const char* lineEnd(const char* line, const char* end);
+
+  /**
+   * parse a line into the (key, value) pair. the key is read the way
+   * atoi() reads it.
+   * @param line[IN] the first byte of the line
+   * @param end[IN] the end of the line
+   * @param key[OUT] the key field of the tuple in the line
+   * @param value[OUT] the value field of the tuple. points into the line
+   * @param len[OUT] the length of value
+   * @return error code. 0 if no error. value and len are not set
+   *         if the line has no comma
+   */
+  static RC parseLine(const char* line, const char* end, int& key, const char*& value, int& len);
+
+ private:
+  char*  begin;    // the bytes of the file
+  size_t length;   // # bytes in the file
+  bool   mapped;   // true if begin is mapped, false if it was read
+};
+
+#endif /* LOADFILE_H */
@@ -18,8 +18,11 @@ using std::string;
 
 int PageFile::readCount = 0;
 int PageFile::writeCount = 0;
+int PageFile::hitCount = 0;
 int PageFile::cacheClock = 1;
+int PageFile::writeEpoch = 0;
 struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
+pthread_mutex_t PageFile::cacheMutex = PTHREAD_MUTEX_INITIALIZER;
 
 PageFile::PageFile() 
 { 
@@ -76,6 +79,7 @@ RC PageFile::close()
   if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
 
   // evict all cached pages for this file
+  pthread_mutex_lock(&cacheMutex);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
        readCache[i].fd = 0;
@@ -83,6 +87,7 @@ RC PageFile::close()
        readCache[i].lastAccessed = 0;
     }
   }
+  pthread_mutex_unlock(&cacheMutex);
 
   // set the fd and epid to the initial state
   fd = -1; 
@@ -95,30 +100,23 @@ PageId PageFile::endPid() const
   return epid;
 }
 
-RC PageFile::seek(PageId pid) const
-{
-  return (::lseek(fd, pid * PAGE_SIZE, SEEK_SET) < 0) ? RC_FILE_SEEK_FAILED : 0;
-}
-
 RC PageFile::write(PageId pid, const void* buffer)
 {
-  RC rc;
   if (pid < 0) return RC_INVALID_PID; 
 
-  // seek to the location of the page
-  if ((rc = seek(pid)) < 0) return rc;
-
   // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+  if (::pwrite(fd, buffer, PAGE_SIZE, (off_t)pid * PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
 
-  // if the page is in read cache, invalidate it
+  // if the page is in read cache, invalidate it. a read that was
+  // in progress meanwhile sees the new epoch and does not cache its page
+  pthread_mutex_lock(&cacheMutex);
+  writeEpoch++;
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].pid == pid &&
         readCache[i].lastAccessed != 0) {
        readCache[i].fd = 0;
        readCache[i].pid = 0;
        readCache[i].lastAccessed = 0;
-       break;
     }
   }
 
@@ -127,31 +125,98 @@ RC PageFile::write(PageId pid, const void* buffer)
 
   // increase page write count
   writeCount++;
+  pthread_mutex_unlock(&cacheMutex);
 
   return 0;
 }
 
-RC PageFile::read(PageId pid, void* buffer) const
+RC PageFile::write(PageId pid, const void* buffer, int count)
 {
-  RC rc;
+  if (pid < 0) return RC_INVALID_PID; 
+
+  // write the pages with as few system calls as the kernel allows
+  const char* p = (const char*)buffer;
+  size_t left = (size_t)count * PAGE_SIZE;
+  off_t offset = (off_t)pid * PAGE_SIZE;
+  while (left > 0) {
+    ssize_t n = ::pwrite(fd, p, left, offset);
+    if (n <= 0) return RC_FILE_WRITE_FAILED;
+    p += n;
+    left -= n;
+    offset += n;
+  }
+
+  // invalidate the pages in read cache
+  pthread_mutex_lock(&cacheMutex);
+  writeEpoch++;
+  for (int i = 0; i < CACHE_COUNT; i++) {
+    if (readCache[i].fd == fd && readCache[i].pid >= pid && readCache[i].pid < pid + count &&
+        readCache[i].lastAccessed != 0) {
+       readCache[i].fd = 0;
+       readCache[i].pid = 0;
+       readCache[i].lastAccessed = 0;
+    }
+  }
+
+  // if the written pages go past the end pid, update the end pid
+  if (pid + count > epid) epid = pid + count;
+
+  // increase page write count
+  writeCount += count;
+  pthread_mutex_unlock(&cacheMutex);
+
+  return 0;
+}
 
+RC PageFile::read(PageId pid, void* buffer) const
+{
   if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
 
   //
   // if the page is in cache, read it from there
   //
+  pthread_mutex_lock(&cacheMutex);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].pid == pid && 
         readCache[i].lastAccessed != 0) {
        memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
        readCache[i].lastAccessed = ++cacheClock;
+       hitCount++;
+       pthread_mutex_unlock(&cacheMutex);
        return 0;
     }
   }
+  int epoch = writeEpoch;
+  pthread_mutex_unlock(&cacheMutex);
+
+  // read the page without holding the lock, so that other
+  // threads can read their pages in the meantime
+  if (::pread(fd, buffer, PAGE_SIZE, (off_t)pid * PAGE_SIZE) < 0) {
+    return RC_FILE_READ_FAILED;
+  }
+
+  pthread_mutex_lock(&cacheMutex);
+
+  // increase the page read count
+  readCount++;
+
+  // a write since the lookup may have changed the page under the pread,
+  // so the bytes read are not cached
+  if (writeEpoch != epoch) {
+    pthread_mutex_unlock(&cacheMutex);
+    return 0;
+  }
+
+  // another thread may have cached the page in the meantime
+  for (int i = 0; i < CACHE_COUNT; i++) {
+    if (readCache[i].fd == fd && readCache[i].pid == pid &&
+        readCache[i].lastAccessed != 0) {
+      readCache[i].lastAccessed = ++cacheClock;
+      pthread_mutex_unlock(&cacheMutex);
+      return 0;
+    }
+  }
 
-  // seek to the page
-  if ((rc = seek(pid)) < 0) return rc;
-  
   // find the cache slot to evict
   int toEvict = 0; 
   for (int i = 0; i < CACHE_COUNT; i++) {
@@ -166,15 +231,8 @@ RC PageFile::read(PageId pid, void* buffer) const
   readCache[toEvict].fd = fd;
   readCache[toEvict].pid = pid;
   readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
-    return RC_FILE_READ_FAILED;
-  }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
-
-  // increase the page read count
-  readCount++;
+  memcpy(readCache[toEvict].buffer, buffer, PAGE_SIZE);
+  pthread_mutex_unlock(&cacheMutex);
 
   return 0;
 }
@@ -11,12 +11,18 @@
 #define PAGEFILE_H
 
 #include <string>
+#include <pthread.h>
 #include "Bruinbase.h"
 
 typedef int PageId;
 
 /**
- * read/write a file in the unit of a page
+ * read/write a file in the unit of a page.
+ * read() may be called from several threads at once, also on the same
+ * PageFile: pages are read with pread() and the shared read cache and
+ * counters are guarded by a mutex. A page is cached only if no write
+ * happened while it was read, so a read that overlaps a write of the
+ * page never leaves the old bytes in the cache.
  */
 class PageFile {
  public:
@@ -58,6 +64,15 @@ class PageFile {
    * @return error code. 0 if no error
    */
   RC write(PageId pid, const void *buffer);
+
+  /**
+   * write consecutive disk pages from the memory buffer at once.
+   * @param pid[IN] the first page to write to
+   * @param buffer[IN] the content to write. count * PAGE_SIZE bytes
+   * @param count[IN] # pages to write
+   * @return error code. 0 if no error
+   */
+  RC write(PageId pid, const void *buffer, int count);
     
   /**
    * note the +1 part. The last page id in the file is actually endPid()-1.
@@ -76,14 +91,10 @@ class PageFile {
    */
   static int getPageWriteCount() { return writeCount; }
 
- protected:
   /**
-   * move the file cursor to the beginning of a page.
-   * this is an internal function not exposed to public.
-   * @param pid[IN] page to seek to
-   * @return error code. 0 if no error
+   * @return the total # of page reads answered by the read cache
    */
-  RC seek(PageId pid) const;
+  static int getCacheHitCount()  { return hitCount; }
 
  private:
   int     fd;     // file descriptor of the associated unix file
@@ -95,6 +106,8 @@ class PageFile {
   static const int CACHE_COUNT = 10;
 
   static int cacheClock; // clock tick counter for LRU policy
+  static int writeEpoch; // # writes so far. a read caches its page only if
+                         //   no write happened while it read the page
 
   // the actual cache data structure
   static struct cacheStruct {
@@ -107,6 +120,9 @@ class PageFile {
 
   static int readCount;  // total # of page reads 
   static int writeCount; // total # of page writes 
+  static int hitCount;   // total # of page reads from the cache
+
+  static pthread_mutex_t cacheMutex; // guards the read cache and the counters
 };
   
 #endif // PAGEFILE_H
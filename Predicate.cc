@@ -0,0 +1,190 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "Predicate.h"
+
+using std::vector;
+
+// compare a value with the literal of a condition with the comparator Cmp
+template <class Cmp>
+static bool compareValue(const char* value, const char* literal)
+{
+  return Cmp::test(strcmp(value, literal), 0);
+}
+
+// order the conditions by disjunct
+static bool disjunctLess(const SelCond* c1, const SelCond* c2)
+{
+  return c1->disjunct < c2->disjunct;
+}
+
+// order key ranges by their first key
+static bool rangeLess(const Predicate::KeyRange& r1, const Predicate::KeyRange& r2)
+{
+  return r1.lo < r2.lo;
+}
+
+// a value condition as written, to find the disjuncts with the same value conditions
+typedef std::pair<int, std::string> ValueCond;
+
+Predicate::Predicate()
+{
+  keyMin = INT_MIN;
+  keyMax = INT_MAX;
+  keyRange = empty = false;
+  valueTests = false;
+  KeyRange all = { INT_MIN, INT_MAX };
+  ranges.push_back(all);
+  disjuncts.resize(1);
+  disjuncts[0].ranges = ranges;
+}
+
+void Predicate::compile(const vector<SelCond>& cond)
+{
+  // no WHERE clause lets every tuple through
+  *this = Predicate();
+  if (cond.empty()) return;
+
+  ranges.clear();
+  disjuncts.clear();
+  keyRange = true;
+
+  vector<const SelCond*> sorted;
+  for (unsigned i = 0; i < cond.size(); i++) sorted.push_back(&cond[i]);
+  std::stable_sort(sorted.begin(), sorted.end(), disjunctLess);
+
+  vector<vector<ValueCond> > signatures;   // the value conditions of every disjunct
+  for (unsigned first = 0, last; first < sorted.size(); first = last) {
+    for (last = first; last < sorted.size() && sorted[last]->disjunct == sorted[first]->disjunct; last++) ;
+
+    int  lo = INT_MIN;
+    int  hi = INT_MAX;
+    bool none = false;          // true if no key meets the conditions
+    bool restricted = false;    // true if a condition other than NE restricts the key
+    vector<int> excluded;       // the keys NE conditions exclude
+    vector<ValueTest> tests;
+    vector<ValueCond> signature;
+
+    for (unsigned i = first; i < last; i++) {
+      const SelCond& c = *sorted[i];
+      if (c.attr == 2) {
+        ValueTest t;
+        t.literal = c.value;
+        switch (c.comp) {
+        case SelCond::EQ: t.test = compareValue<Equal>; break;
+        case SelCond::NE: t.test = compareValue<NotEqual>; break;
+        case SelCond::LT: t.test = compareValue<Less>; break;
+        case SelCond::GT: t.test = compareValue<Greater>; break;
+        case SelCond::LE: t.test = compareValue<LessEqual>; break;
+        case SelCond::GE: t.test = compareValue<GreaterEqual>; break;
+        }
+        tests.push_back(t);
+        signature.push_back(ValueCond(c.comp, c.value));
+        continue;
+      }
+
+      // keys are integers, so strict bounds are turned into inclusive ones
+      int val = atoi(c.value);
+      switch (c.comp) {
+      case SelCond::EQ:
+        lo = std::max(lo, val);
+        hi = std::min(hi, val);
+        break;
+      case SelCond::GE:
+        lo = std::max(lo, val);
+        break;
+      case SelCond::GT:
+        if (val == INT_MAX) none = true;
+        else lo = std::max(lo, val + 1);
+        break;
+      case SelCond::LE:
+        hi = std::min(hi, val);
+        break;
+      case SelCond::LT:
+        if (val == INT_MIN) none = true;
+        else hi = std::min(hi, val - 1);
+        break;
+      case SelCond::NE:
+        excluded.push_back(val);
+        continue;
+      }
+      restricted = true;
+    }
+    if (none || lo > hi) continue;
+    if (!restricted) keyRange = false;
+
+    // split the range around the excluded keys
+    vector<KeyRange> split;
+    std::sort(excluded.begin(), excluded.end());
+    for (unsigned i = 0; i < excluded.size() && lo <= hi; i++) {
+      if (excluded[i] < lo || excluded[i] > hi) continue;
+      if (excluded[i] > lo) {
+        KeyRange r = { lo, excluded[i] - 1 };
+        split.push_back(r);
+      }
+      if (excluded[i] == INT_MAX) {
+        lo = 1;
+        hi = 0;
+      }
+      else lo = excluded[i] + 1;
+    }
+    if (lo <= hi) {
+      KeyRange r = { lo, hi };
+      split.push_back(r);
+    }
+    if (split.empty()) continue;
+
+    // the disjuncts with the same value conditions become one
+    std::sort(signature.begin(), signature.end());
+    unsigned d;
+    for (d = 0; d < signatures.size() && signatures[d] != signature; d++) ;
+    if (d == signatures.size()) {
+      signatures.push_back(signature);
+      disjuncts.push_back(Disjunct());
+      disjuncts.back().values = tests;
+    }
+    disjuncts[d].ranges.insert(disjuncts[d].ranges.end(), split.begin(), split.end());
+    ranges.insert(ranges.end(), split.begin(), split.end());
+    if (!tests.empty()) valueTests = true;
+  }
+
+  for (unsigned d = 0; d < disjuncts.size(); d++) mergeRanges(disjuncts[d].ranges);
+  mergeRanges(ranges);
+  empty = ranges.empty();
+  keyMin = empty ? 0 : ranges.front().lo;
+  keyMax = empty ? -1 : ranges.back().hi;
+}
+
+void Predicate::mergeRanges(vector<KeyRange>& ranges)
+{
+  std::sort(ranges.begin(), ranges.end(), rangeLess);
+  unsigned n = 0;
+  for (unsigned i = 0; i < ranges.size(); i++) {
+    // ranges[n - 1].hi + 1 would overflow at INT_MAX, so compare the other way
+    if (n > 0 && (ranges[i].lo == INT_MIN || ranges[i].lo - 1 <= ranges[n - 1].hi)) {
+      ranges[n - 1].hi = std::max(ranges[n - 1].hi, ranges[i].hi);
+      continue;
+    }
+    ranges[n++] = ranges[i];
+  }
+  ranges.resize(n);
+}
+
+bool Predicate::inRanges(const vector<KeyRange>& ranges, int key)
+{
+  // find the last range that starts at or before key
+  unsigned lo = 0, hi = ranges.size();
+  while (lo < hi) {
+    unsigned mid = (lo + hi) / 2;
+    if (ranges[mid].lo <= key) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo > 0 && key <= ranges[lo - 1].hi;
+}
@@ -0,0 +1,151 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <vector>
+#include "Bruinbase.h"
+#include "SqlEngine.h"
+
+//
+// the comparators of the WHERE clause. test(a, b) is true if "a comp b".
+//
+struct Equal {
+  static bool test(int a, int b) { return a == b; }
+};
+
+struct NotEqual {
+  static bool test(int a, int b) { return a != b; }
+};
+
+struct Less {
+  static bool test(int a, int b) { return a < b; }
+};
+
+struct Greater {
+  static bool test(int a, int b) { return a > b; }
+};
+
+struct LessEqual {
+  static bool test(int a, int b) { return a <= b; }
+};
+
+struct GreaterEqual {
+  static bool test(int a, int b) { return a >= b; }
+};
+
+/**
+ * The conditions of a WHERE clause, compiled once per query.
+ *
+ * The clause is an OR of disjuncts, each of which ANDs its conditions.
+ * The key literals are parsed once. The key conditions of a disjunct are
+ * turned into a sorted list of disjoint ranges of keys: the range of the
+ * comparisons, split around every key an NE condition excludes. The key
+ * ranges of all disjuncts are merged into ranges, the keys that can meet
+ * the conditions at all, which index scans read one after the other.
+ *
+ * Every value condition gets the comparison function instantiated for
+ * its comparator, so checking a tuple does not look at SelCond::comp or
+ * SelCond::attr again. Disjuncts with the same value conditions, such as
+ * those of "key IN (...)", are merged into one.
+ */
+class Predicate {
+ public:
+  /// a compiled value condition: test(value, literal) is true if it is met
+  struct ValueTest {
+    bool (*test)(const char* value, const char* literal);
+    const char* literal;
+  };
+
+  /// the keys in [lo, hi]
+  struct KeyRange {
+    int lo;
+    int hi;
+  };
+
+  /// a disjunct: the keys of its key conditions and its value conditions
+  struct Disjunct {
+    std::vector<KeyRange>  ranges;   // sorted, disjoint and not adjacent
+    std::vector<ValueTest> values;
+  };
+
+  int  keyMin;                       // the smallest key that can meet the conditions
+  int  keyMax;                       // the largest key that can meet the conditions
+  bool keyRange;                     // true if every disjunct has a condition other than NE on the key
+  bool empty;                        // true if no tuple can meet the conditions
+  std::vector<KeyRange> ranges;      // the keys that can meet the conditions. sorted, disjoint and not adjacent
+  std::vector<Disjunct> disjuncts;
+
+  Predicate();
+
+  /**
+   * compile the conditions of a WHERE clause. the conditions with the same
+   * SelCond::disjunct are ANDed together, and the disjuncts are ORed.
+   * the literals of the value conditions are not copied and must stay valid.
+   * @param cond[IN] the conditions
+   */
+  void compile(const std::vector<SelCond>& cond);
+
+  /**
+   * @return true if key is in one of the ranges
+   */
+  bool matchKey(int key) const
+  {
+    // key - keyMin wraps around below keyMin, so one unsigned comparison checks the range
+    if ((unsigned)key - (unsigned)keyMin > (unsigned)keyMax - (unsigned)keyMin) return false;
+    return ranges.size() == 1 || inRanges(ranges, key);
+  }
+
+  /**
+   * @return true if the tuple meets the value conditions of a disjunct
+   *         whose key ranges hold key. matchKey(key) must be true
+   */
+  bool matchValue(int key, const char* value) const
+  {
+    if (disjuncts.size() == 1) return matchTests(disjuncts[0].values, value);
+    for (unsigned i = 0; i < disjuncts.size(); i++)
+      if (inRanges(disjuncts[i].ranges, key) && matchTests(disjuncts[i].values, value)) return true;
+    return false;
+  }
+
+  /**
+   * @return true if the tuple meets the conditions
+   */
+  bool match(int key, const char* value) const
+  {
+    return !empty && matchKey(key) && matchValue(key, value);
+  }
+
+  /**
+   * @return true if any disjunct has a value condition
+   */
+  bool hasValueTests() const { return valueTests; }
+
+ private:
+  bool valueTests;                   // true if any disjunct has a value condition
+
+  /**
+   * @return true if value passes every test
+   */
+  static bool matchTests(const std::vector<ValueTest>& tests, const char* value)
+  {
+    for (unsigned i = 0; i < tests.size(); i++)
+      if (!tests[i].test(value, tests[i].literal)) return false;
+    return true;
+  }
+
+  /**
+   * @return true if key is in one of the sorted ranges
+   */
+  static bool inRanges(const std::vector<KeyRange>& ranges, int key);
+
+  /**
+   * sort ranges and merge the ones that overlap or are adjacent.
+   */
+  static void mergeRanges(std::vector<KeyRange>& ranges);
+};
+
+#endif /* PREDICATE_H */
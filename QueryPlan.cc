@@ -0,0 +1,118 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdio>
+#include <time.h>
+#include "PageFile.h"
+#include "QueryPlan.h"
+
+using std::string;
+
+QueryPlan::QueryPlan()
+{
+  on = false;
+  analyze = false;
+}
+
+void QueryPlan::begin(bool analyze)
+{
+  on = true;
+  this->analyze = analyze;
+  ops.clear();
+}
+
+void QueryPlan::end()
+{
+  on = false;
+  ops.clear();
+}
+
+int QueryPlan::add(int parent, const string& name, const string& detail)
+{
+  if (!on) return -1;
+  Operator o;
+  o.parent = parent;
+  o.name = name;
+  o.detail = detail;
+  o.measured = false;
+  o.total.nanos = 0;
+  o.total.reads = o.total.hits = o.total.writes = 0;
+  o.rowsIn = o.rowsOut = -1;
+  ops.push_back(o);
+  return ops.size() - 1;
+}
+
+QueryPlan::Counters QueryPlan::now()
+{
+  Counters c;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  c.nanos = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  c.reads = PageFile::getPageReadCount();
+  c.hits = PageFile::getCacheHitCount();
+  c.writes = PageFile::getPageWriteCount();
+  return c;
+}
+
+void QueryPlan::start(int op)
+{
+  if (op < 0 || !analyze) return;
+  ops[op].started = now();
+}
+
+void QueryPlan::stop(int op)
+{
+  if (op < 0 || !analyze) return;
+  Counters c = now();
+  Operator& o = ops[op];
+  o.measured = true;
+  o.total.nanos += c.nanos - o.started.nanos;
+  o.total.reads += c.reads - o.started.reads;
+  o.total.hits += c.hits - o.started.hits;
+  o.total.writes += c.writes - o.started.writes;
+}
+
+void QueryPlan::setRows(int op, long long rowsIn, long long rowsOut)
+{
+  if (op < 0) return;
+  ops[op].rowsIn = rowsIn;
+  ops[op].rowsOut = rowsOut;
+}
+
+void QueryPlan::print(ResultSink& sink) const
+{
+  for (unsigned i = 0; i < ops.size(); i++)
+    if (ops[i].parent < 0) print(sink, i, 0);
+}
+
+void QueryPlan::print(ResultSink& sink, int op, int depth) const
+{
+  const Operator& o = ops[op];
+  char stats[160];
+
+  string line(depth * 4, ' ');
+  if (depth > 0) line += "-> ";
+  line += o.name;
+  if (!o.detail.empty()) line += " " + o.detail;
+  if (o.measured) {
+    line += " (time=";
+    snprintf(stats, sizeof(stats), "%lldns", o.total.nanos);
+    line += stats;
+    if (o.rowsIn >= 0) {
+      snprintf(stats, sizeof(stats), " rows in=%lld", o.rowsIn);
+      line += stats;
+    }
+    if (o.rowsOut >= 0) {
+      snprintf(stats, sizeof(stats), " rows out=%lld", o.rowsOut);
+      line += stats;
+    }
+    snprintf(stats, sizeof(stats), " reads=%d hits=%d writes=%d)", o.total.reads, o.total.hits, o.total.writes);
+    line += stats;
+  }
+  sink.putLine(line);
+
+  for (unsigned i = op + 1; i < ops.size(); i++)
+    if (ops[i].parent == op) print(sink, i, depth + 1);
+}
@@ -0,0 +1,118 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef QUERYPLAN_H
+#define QUERYPLAN_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "ResultSink.h"
+
+/**
+ * The operators of a query as EXPLAIN prints them: a tree in which every
+ * operator takes the rows of the operators below it.
+ *
+ * With EXPLAIN ANALYZE the query runs, and every operator measures the
+ * time it ran in nanoseconds, the rows it took and returned, and the page
+ * reads, cache hits and writes of PageFile meanwhile. An operator that
+ * hands its rows to another one as it produces them, like a scan feeding
+ * a sort, includes the time and pages the other spends on them; the
+ * measurements of the other operator cover all of its work.
+ *
+ * Only one plan is described at a time. While none is, active() is false
+ * and the operators do not describe themselves.
+ */
+class QueryPlan {
+ public:
+  QueryPlan();
+
+  /**
+   * start describing the plan of a query.
+   * @param analyze[IN] true if the query runs and its operators are measured
+   */
+  void begin(bool analyze);
+
+  /**
+   * stop describing the plan and forget the operators.
+   */
+  void end();
+
+  /**
+   * @return true if a plan is being described
+   */
+  bool active() const { return on; }
+
+  /**
+   * @return true if the query is only described and must not run (EXPLAIN)
+   */
+  bool describeOnly() const { return on && !analyze; }
+
+  /**
+   * add an operator to the plan.
+   * @param parent[IN] the operator that takes its rows. -1 for the top one
+   * @param name[IN] the operator, e.g. "Index Scan"
+   * @param detail[IN] what it reads and checks, e.g. the table and the key ranges
+   * @return the id of the operator. -1 if no plan is being described
+   */
+  int add(int parent, const std::string& name, const std::string& detail);
+
+  /**
+   * start measuring an operator. nothing happens without EXPLAIN ANALYZE
+   * or if op is -1, so the operators can call it unconditionally.
+   */
+  void start(int op);
+
+  /**
+   * stop measuring an operator and add what it did since start().
+   */
+  void stop(int op);
+
+  /**
+   * set the rows an operator took and returned. -1 if unknown.
+   */
+  void setRows(int op, long long rowsIn, long long rowsOut);
+
+  /**
+   * output the plan, one line per operator, with the measurements for EXPLAIN ANALYZE.
+   */
+  void print(ResultSink& sink) const;
+
+ private:
+  /// the time and the counters of PageFile at one instant
+  struct Counters {
+    long long nanos;
+    int reads;
+    int hits;
+    int writes;
+  };
+
+  struct Operator {
+    int         parent;
+    std::string name;
+    std::string detail;
+    bool        measured;  // true once stop() was called
+    Counters    started;   // the counters at start()
+    Counters    total;     // the differences accumulated by stop()
+    long long   rowsIn;
+    long long   rowsOut;
+  };
+
+  bool on;
+  bool analyze;
+  std::vector<Operator> ops;
+
+  /**
+   * @return the time and the counters of PageFile now
+   */
+  static Counters now();
+
+  /**
+   * output an operator and the operators below it.
+   */
+  void print(ResultSink& sink, int op, int depth) const;
+};
+
+#endif /* QUERYPLAN_H */
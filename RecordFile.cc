@@ -10,6 +10,7 @@
 #include "Bruinbase.h"
 #include "RecordFile.h"
 #include <cstring>
+#include <vector>
 
 using std::string;
 
@@ -24,7 +25,7 @@ static char* slotPtr(char* page, int n);
 static void readSlot(const char* page, int n, int& key, std::string& value);
 
 // write the record to the n'th slot in the page
-static void writeSlot(char* page, int n, int key, const std::string& value);
+static void writeSlot(char* page, int n, int key, const char* value, int len);
 
 // get # records stored in the page
 static int getRecordCount(const char* page);
@@ -63,6 +64,15 @@ RecordId& operator++ (RecordId& rid)
   return rid;
 }
 
+RecordId operator+ (const RecordId& rid, int n)
+{
+  long long slot = (long long)rid.sid + n;
+  RecordId r;
+  r.pid = rid.pid + (PageId)(slot / RecordFile::RECORDS_PER_PAGE);
+  r.sid = (int)(slot % RecordFile::RECORDS_PER_PAGE);
+  return r;
+}
+
 // RecordId comparators
 bool operator < (const RecordId& r1, const RecordId& r2)
 {
@@ -184,7 +194,49 @@ RC RecordFile::read(const RecordId& rid, int& key, string& value) const
   return 0;
 }
 
+RC RecordFile::readKeys(PageId pid, int* keys, int& count) const
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  // check whether the pid is in the valid range
+  if (pid < 0 || pid > erid.pid || (pid == erid.pid && erid.sid == 0)) return RC_INVALID_PID;
+
+  // read the page and copy the key of every record in it
+  if ((rc = pf.read(pid, page)) < 0) return rc;
+  count = getRecordCount(page);
+  for (int i = 0; i < count; i++) {
+    memcpy(&keys[i], slotPtr(page, i), sizeof(int));
+  }
+
+  return 0;
+}
+
+RC RecordFile::readPage(PageId pid, char* page, int* keys, const char** values, int& count) const
+{
+  RC rc;
+
+  // check whether the pid is in the valid range
+  if (pid < 0 || pid > erid.pid || (pid == erid.pid && erid.sid == 0)) return RC_INVALID_PID;
+
+  // read the page and point to the slots in it
+  if ((rc = pf.read(pid, page)) < 0) return rc;
+  count = getRecordCount(page);
+  for (int i = 0; i < count; i++) {
+    char* ptr = slotPtr(page, i);
+    memcpy(&keys[i], ptr, sizeof(int));
+    values[i] = ptr + sizeof(int);
+  }
+
+  return 0;
+}
+
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
+{
+  return append(key, value.data(), value.size(), rid);
+}
+
+RC RecordFile::append(int key, const char* value, int len, RecordId& rid)
 {
   RC   rc;
   char page[PageFile::PAGE_SIZE];
@@ -200,7 +252,7 @@ RC RecordFile::append(int key, const std::string& value, RecordId& rid)
   }
     
   // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
+  writeSlot(page, erid.sid, key, value, len);
 
   // the first four bytes in the page stores # records in the page.
   // update this number.
@@ -218,6 +270,31 @@ RC RecordFile::append(int key, const std::string& value, RecordId& rid)
   return 0;
 }
 
+RC RecordFile::appendBatch(const int* keys, const char* const* values, const int* lens, int n, RecordId& rid)
+{
+  RC rc;
+  rid = erid;
+  if (n <= 0) return 0;
+
+  // fill all pages the records go to in memory. like append(),
+  // the last page has to be read first if it is partly used
+  int pages = (erid.sid + n + RECORDS_PER_PAGE - 1) / RECORDS_PER_PAGE;
+  std::vector<char> buffer((size_t)pages * PageFile::PAGE_SIZE, 0);
+  if (erid.sid > 0 && (rc = pf.read(erid.pid, &buffer[0])) < 0) return rc;
+
+  RecordId r = erid;
+  for (int i = 0; i < n; i++, ++r) {
+    char* page = &buffer[(size_t)(r.pid - erid.pid) * PageFile::PAGE_SIZE];
+    writeSlot(page, r.sid, keys[i], values[i], lens[i]);
+    setRecordCount(page, r.sid + 1);
+  }
+
+  // write the pages to the disk and advance the end record id past them
+  if ((rc = pf.write(erid.pid, &buffer[0], pages)) < 0) return rc;
+  erid = r;
+  return 0;
+}
+
 const RecordId& RecordFile::endRid() const
 {
   return erid;
@@ -259,7 +336,7 @@ static void readSlot(const char* page, int n, int& key, std::string& value)
   value.assign(ptr + sizeof(int));
 }
 
-static void writeSlot(char* page, int n, int key, const std::string& value)
+static void writeSlot(char* page, int n, int key, const char* value, int len)
 {
   // compute the location of the record
   char *ptr = slotPtr(page, n);
@@ -268,11 +345,10 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
   memcpy(ptr, &key, sizeof(int));
 
   // store the value. 
-  if ((int)value.size() >= RecordFile::MAX_VALUE_LENGTH) {
+  if (len >= RecordFile::MAX_VALUE_LENGTH) {
     // when the string is longer than MAX_VALUE_LENGTH, truncate it.
-    memcpy(ptr + sizeof(int), value.c_str(), RecordFile::MAX_VALUE_LENGTH -1);
-    *(ptr + sizeof(int) + RecordFile::MAX_VALUE_LENGTH - 1) = 0;
-  } else {
-    strcpy(ptr + sizeof(int), value.c_str());
+    len = RecordFile::MAX_VALUE_LENGTH - 1;
   }
+  memcpy(ptr + sizeof(int), value, len);
+  *(ptr + sizeof(int) + len) = 0;
 }
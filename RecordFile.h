@@ -30,6 +30,9 @@ typedef struct {
 RecordId& operator++ (RecordId& rid);
 RecordId  operator++ (RecordId& rid, int);
 
+// the RecordId n slots after rid
+RecordId  operator+ (const RecordId& rid, int n);
+
 // RecordId comparators
 bool operator> (const RecordId& r1, const RecordId& r2);
 bool operator< (const RecordId& r1, const RecordId& r2);
@@ -79,6 +82,28 @@ class RecordFile {
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * read the keys of all records in a page.
+   * several threads may read pages of the same RecordFile at once.
+   * @param pid[IN] the page to read
+   * @param keys[OUT] the keys of the records. must hold RECORDS_PER_PAGE keys
+   * @param count[OUT] # records in the page
+   * @return error code. 0 if no error
+   */
+  RC readKeys(PageId pid, int* keys, int& count) const;
+
+  /**
+   * read all records in a page at once.
+   * the values are not copied: values[i] points into the page buffer.
+   * @param pid[IN] the page to read
+   * @param page[OUT] the buffer the page is read into. must hold PAGE_SIZE bytes
+   * @param keys[OUT] the keys of the records. must hold RECORDS_PER_PAGE keys
+   * @param values[OUT] the values of the records. must hold RECORDS_PER_PAGE pointers
+   * @param count[OUT] # records in the page
+   * @return error code. 0 if no error
+   */
+  RC readPage(PageId pid, char* page, int* keys, const char** values, int& count) const;
+
   /**
    * append a new record at the end of the file.
    * note that RecordFile does not have write() function.
@@ -90,6 +115,27 @@ class RecordFile {
    */
   RC append(int key, const std::string& value, RecordId& rid);
 
+  /**
+   * append a new record at the end of the file.
+   * @param key[IN] the record key
+   * @param value[IN] the record value. need not end with a null
+   * @param len[IN] the length of value
+   * @param rid[OUT] the location of the stored record
+   * @return error code. 0 if no error
+   */
+  RC append(int key, const char* value, int len, RecordId& rid);
+
+  /**
+   * append records at the end of the file, writing every page once.
+   * @param keys[IN] the record keys
+   * @param values[IN] the record values. need not end with a null
+   * @param lens[IN] the lengths of the values
+   * @param n[IN] # records
+   * @param rid[OUT] the location of the first record. the others follow it
+   * @return error code. 0 if no error
+   */
+  RC appendBatch(const int* keys, const char* const* values, const int* lens, int n, RecordId& rid);
+
   /**
    * note the +1 part. The rid of the last record is endRid()-1.
    * @return (last record id + 1) of the RecordFile
@@ -0,0 +1,320 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include "ResultSink.h"
+
+using std::string;
+
+// the two digits of 0..99
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+// write the decimal digits of n to dst, two digits at a time.
+// @return the # characters written. at most 11
+static int formatInt(char* dst, int n)
+{
+  char digits[12];
+  char* p = digits + sizeof(digits);
+  unsigned u = (n < 0) ? 0u - (unsigned)n : (unsigned)n;
+
+  while (u >= 100) {
+    const char* pair = DIGIT_PAIRS + 2 * (u % 100);
+    u /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (u >= 10) {
+    *--p = DIGIT_PAIRS[2 * u + 1];
+    *--p = DIGIT_PAIRS[2 * u];
+  }
+  else *--p = '0' + u;
+  if (n < 0) *--p = '-';
+
+  int len = digits + sizeof(digits) - p;
+  memcpy(dst, p, len);
+  return len;
+}
+
+ResultSink::ResultSink(FILE* file)
+{
+  this->file = file;
+  format = TEXT;
+  buffer = (char*)malloc(BUFFER_SIZE);
+  size = 0;
+  skip = 0;
+  left = -1;
+  discard = false;
+  rowValueCount = 0;
+}
+
+ResultSink::~ResultSink()
+{
+  flush();
+  free(buffer);
+}
+
+void ResultSink::setFormat(Format f)
+{
+  flush();
+  format = f;
+}
+
+void ResultSink::setLimit(int offset, int count)
+{
+  skip = offset;
+  left = count;
+}
+
+int ResultSink::rowLength(const char* data, int size) const
+{
+  if (format == BINARY) {
+    int len;
+    memcpy(&len, data, sizeof(int));
+    return sizeof(int) + len;
+  }
+  // values never contain a newline, since every line of a load file is a tuple
+  const char* end = (const char*)memchr(data, '\n', size);
+  return end ? end - data + 1 : size;
+}
+
+int ResultSink::formatRow(char* dst, Format format, int attr, int key, const char* value, int len)
+{
+  char* p = dst;
+
+  // COUNT(*) returns no rows for the tuples
+  if (attr < 1 || attr > 3) return 0;
+
+  if (format == BINARY) {
+    int size = ((attr & 1) ? sizeof(int) : 0) + ((attr & 2) ? len : 0);
+    memcpy(p, &size, sizeof(int));
+    p += sizeof(int);
+    if (attr & 1) {
+      memcpy(p, &key, sizeof(int));
+      p += sizeof(int);
+    }
+    if (attr & 2) {
+      memcpy(p, value, len);
+      p += len;
+    }
+    return p - dst;
+  }
+
+  switch (attr) {
+  case 1:  // SELECT key
+    p += formatInt(p, key);
+    break;
+  case 2:  // SELECT value
+    memcpy(p, value, len);
+    p += len;
+    break;
+  case 3:  // SELECT *
+    p += formatInt(p, key);
+    *p++ = ' ';
+    *p++ = '\'';
+    memcpy(p, value, len);
+    p += len;
+    *p++ = '\'';
+    break;
+  }
+  *p++ = '\n';
+  return p - dst;
+}
+
+void ResultSink::put(int attr, int key, const char* value)
+{
+  put(attr, key, value, (attr & 2) ? strlen(value) : 0);
+}
+
+void ResultSink::put(int attr, int key, const char* value, int len)
+{
+  if (attr < 1 || attr > 3 || !take()) return;
+  if (size + len + ROW_OVERHEAD > BUFFER_SIZE) {
+    flush();
+    // a value longer than the buffer is never stored in a table
+    if (len + ROW_OVERHEAD > BUFFER_SIZE) return;
+  }
+  size += formatRow(buffer + size, format, attr, key, value, len);
+}
+
+void ResultSink::putCount(int count)
+{
+  if (!take()) return;
+  if (size + ROW_OVERHEAD > BUFFER_SIZE) flush();
+  if (format == BINARY) {
+    size += formatRow(buffer + size, format, 1, count, "", 0);
+    return;
+  }
+  size += formatInt(buffer + size, count);
+  buffer[size++] = '\n';
+}
+
+void ResultSink::write(const char* data, int size)
+{
+  // with a limit, drop the rows before the offset and after the limit
+  if (skip > 0 || left >= 0) {
+    int start = 0;
+    while (start < size && skip > 0) {
+      start += rowLength(data + start, size - start);
+      skip--;
+    }
+    int end = (left < 0) ? size : start;
+    while (end < size && left != 0) {
+      end += rowLength(data + end, size - end);
+      if (left > 0) left--;
+    }
+    data += start;
+    size = end - start;
+    if (size == 0) return;
+  }
+
+  // large chunks are written directly instead of being copied first
+  if (this->size + size > BUFFER_SIZE) {
+    flush();
+    if (size > BUFFER_SIZE / 2) {
+      if (!discard) fwrite(data, 1, size, file);
+      return;
+    }
+  }
+  memcpy(buffer + this->size, data, size);
+  this->size += size;
+}
+
+void ResultSink::beginRow()
+{
+  row.clear();
+  rowValue.clear();
+  rowValues.clear();
+  rowValueCount = 0;
+}
+
+void ResultSink::putInt(int n)
+{
+  if (format == BINARY) {
+    row.append((const char*)&n, sizeof(int));
+    return;
+  }
+  char buf[16];
+  separate();
+  row.append(buf, formatInt(buf, n));
+}
+
+void ResultSink::putLong(long long n)
+{
+  if (format == BINARY) {
+    row.append((const char*)&n, sizeof(long long));
+    return;
+  }
+  char buf[32];
+  separate();
+  row.append(buf, snprintf(buf, sizeof(buf), "%lld", n));
+}
+
+void ResultSink::putDouble(double d)
+{
+  if (format == BINARY) {
+    row.append((const char*)&d, sizeof(double));
+    return;
+  }
+  char buf[64];
+  separate();
+  row.append(buf, snprintf(buf, sizeof(buf), "%.3f", d));
+}
+
+void ResultSink::putNull(int size)
+{
+  if (format == BINARY) {
+    row.append(size, '\0');
+    return;
+  }
+  separate();
+  row += "NULL";
+}
+
+void ResultSink::putValue(const char* value, int len)
+{
+  if (format == BINARY) {
+    if (rowValueCount++ > 0) {
+      int l = rowValue.size();
+      rowValues.append((const char*)&l, sizeof(int));
+      rowValues += rowValue;
+    }
+    rowValue.assign(value, len);
+    return;
+  }
+  separate();
+  row += '\'';
+  row.append(value, len);
+  row += '\'';
+}
+
+void ResultSink::endRow()
+{
+  if (format == BINARY) {
+    row += rowValues;
+    row += rowValue;
+    int len = row.size();
+    row.insert(0, (const char*)&len, sizeof(int));
+  }
+  else row += '\n';
+
+  if (take()) writeRow();
+}
+
+void ResultSink::writeRow()
+{
+  if (size + (int)row.size() > BUFFER_SIZE) flush();
+  if ((int)row.size() > BUFFER_SIZE) {
+    if (!discard) fwrite(row.data(), 1, row.size(), file);
+  }
+  else {
+    memcpy(buffer + size, row.data(), row.size());
+    size += row.size();
+  }
+}
+
+void ResultSink::putLine(const string& line)
+{
+  beginRow();
+  if (format == BINARY) {
+    int len = line.size();
+    row.append((const char*)&len, sizeof(int));
+    row += line;
+  }
+  else row = line + '\n';
+  writeRow();
+}
+
+RC ResultSink::flush()
+{
+  RC rc = 0;
+  if (size > 0 && !discard && fwrite(buffer, 1, size, file) != (size_t)size) rc = RC_FILE_WRITE_FAILED;
+  size = 0;
+  fflush(file);
+  return rc;
+}
+
+void ResultSink::appendRow(string& out, Format format, int attr, int key, const char* value)
+{
+  int len = (attr & 2) ? strlen(value) : 0;
+  size_t at = out.size();
+  out.resize(at + len + ROW_OVERHEAD);
+  out.resize(at + formatRow(&out[at], format, attr, key, value, len));
+}
+
+RC RowConsumer::addRows(const char* data, int size)
+{
+  RC  rc;
+  int len, key;
+  for (int i = 0; i < size; i += sizeof(int) + len) {
+    memcpy(&len, data + i, sizeof(int));
+    memcpy(&key, data + i + sizeof(int), sizeof(int));
+    if ((rc = add(key, data + i + 2 * sizeof(int), len - sizeof(int))) < 0) return rc;
+  }
+  return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef RESULTSINK_H
+#define RESULTSINK_H
+
+#include <climits>
+#include <cstdio>
+#include <string>
+#include "Bruinbase.h"
+
+/**
+ * The destination of the rows a SELECT returns.
+ *
+ * Rows are formatted into one large buffer that is reused for every query
+ * and written out with one fwrite() per BUFFER_SIZE bytes, instead of one
+ * fprintf() per row. Integers are formatted by hand.
+ *
+ * In TEXT format a row is printed as before: "key", "value" or "key 'value'"
+ * on one line. In BINARY format every row is a 4-byte length followed by
+ * that many bytes: the 4-byte key if it is selected, then the bytes of the
+ * value if it is selected. COUNT(*) returns one row with the 4-byte count.
+ * Integers are in the byte order of the machine.
+ *
+ * Rows of aggregates are built field by field with beginRow() ... endRow().
+ * In TEXT format the fields are separated by a space and values are quoted.
+ * In BINARY format the numbers come first in the order they were put,
+ * 4-byte ints, 8-byte sums and 8-byte doubles, then the bytes of the value.
+ * A row of a join may hold two values; the first is then preceded by its
+ * 4-byte length.
+ * A NULL is printed as NULL in TEXT and as zero bytes in BINARY.
+ *
+ * A LIMIT is applied as the rows come in: the first offset rows are
+ * dropped and rows beyond the limit are ignored. Scans ask rowsWanted()
+ * or full() to stop as soon as no more rows are needed.
+ */
+class ResultSink {
+ public:
+  /// the formats of the rows
+  enum Format { TEXT, BINARY };
+
+  /// the size of the output buffer
+  static const int BUFFER_SIZE = 256 * 1024;
+
+  /**
+   * @param file[IN] the file the rows are written to
+   */
+  ResultSink(FILE* file);
+  ~ResultSink();
+
+  /**
+   * @return the format of the rows
+   */
+  Format getFormat() const { return format; }
+
+  /**
+   * change the format of the rows. the buffered rows are written out first.
+   */
+  void setFormat(Format f);
+
+  /**
+   * apply LIMIT count OFFSET offset to the rows of the next query.
+   * @param offset[IN] # rows to drop first
+   * @param count[IN] # rows to output after them. -1 for no limit
+   */
+  void setLimit(int offset, int count);
+
+  /**
+   * @return the # rows a scan still has to produce to meet the limit.
+   *         INT_MAX if there is no limit
+   */
+  int rowsWanted() const
+  {
+    if (left < 0) return INT_MAX;
+    return (skip > INT_MAX - left) ? INT_MAX : skip + left;
+  }
+
+  /**
+   * @return true if the limit has been reached
+   */
+  bool full() const { return left == 0; }
+
+  /**
+   * output a row. nothing is output for COUNT(*).
+   * @param attr[IN] attribute in the SELECT clause (1: key, 2: value, 3: *, 4: count(*))
+   * @param key[IN] the key of the tuple
+   * @param value[IN] the value of the tuple
+   */
+  void put(int attr, int key, const char* value);
+
+  /**
+   * output a row whose value is not null-terminated.
+   * @param len[IN] the length of value
+   */
+  void put(int attr, int key, const char* value, int len);
+
+  /**
+   * output the row of COUNT(*).
+   */
+  void putCount(int count);
+
+  /**
+   * output rows formatted by appendRow() in the format of this sink.
+   */
+  void write(const char* data, int size);
+
+  /**
+   * start a row of fields. it is output by endRow().
+   */
+  void beginRow();
+
+  /**
+   * add an integer, a 64-bit integer or a double to the row.
+   */
+  void putInt(int n);
+  void putLong(long long n);
+  void putDouble(double d);
+
+  /**
+   * add a NULL that takes size bytes in BINARY format.
+   */
+  void putNull(int size);
+
+  /**
+   * add a value to the row.
+   */
+  void putValue(const char* value, int len);
+
+  /**
+   * output the row built since beginRow().
+   */
+  void endRow();
+
+  /**
+   * output a line of text that is not a row of the query, like a line of
+   * EXPLAIN. the LIMIT does not apply to it. in BINARY format it is a row
+   * of its bytes.
+   */
+  void putLine(const std::string& line);
+
+  /**
+   * drop the rows instead of writing them to the file, or stop doing so.
+   * EXPLAIN ANALYZE runs a query this way, so that it pays for formatting
+   * its rows but outputs nothing but the plan.
+   */
+  void setDiscard(bool discard) { this->discard = discard; }
+
+  /**
+   * write the buffered rows to the file.
+   * @return error code. 0 if no error
+   */
+  RC flush();
+
+  /**
+   * append a row to out, formatted as put() would.
+   * for the workers of parallel scans that build their output separately.
+   */
+  static void appendRow(std::string& out, Format format, int attr, int key, const char* value);
+
+ private:
+  FILE*  file;    // the file the rows are written to
+  Format format;  // the format of the rows
+  char*  buffer;  // the rows not written yet
+  int    size;    // # bytes in buffer
+  int    skip;    // # rows still to drop for OFFSET
+  int    left;    // # rows still to output for LIMIT. -1 for no limit
+  bool   discard; // true if the rows are dropped instead of written
+  std::string row;       // the row being built by beginRow() ... endRow()
+  std::string rowValue;  // the last value of that row, which comes last in BINARY
+  std::string rowValues; // the values before it, each after its length
+  int    rowValueCount;  // # values in the row
+
+  /**
+   * start the next field of the row being built in TEXT format.
+   */
+  void separate() { if (!row.empty()) row += ' '; }
+
+  /**
+   * @return true if the next row is to be output, counting it against the limit
+   */
+  bool take()
+  {
+    if (left == 0) return false;
+    if (skip > 0) {
+      skip--;
+      return false;
+    }
+    if (left > 0) left--;
+    return true;
+  }
+
+  /**
+   * write the row built in row to the buffer.
+   */
+  void writeRow();
+
+  /**
+   * @return the length of the row at the start of data[0..size-1] in the format of this sink
+   */
+  int rowLength(const char* data, int size) const;
+
+  /**
+   * write the row of a tuple to dst, which has room for len + ROW_OVERHEAD bytes.
+   * @param len[IN] the length of value
+   * @return the # bytes written
+   */
+  static int formatRow(char* dst, Format format, int attr, int key, const char* value, int len);
+
+  /// the most bytes a row takes besides the value
+  static const int ROW_OVERHEAD = 16;
+};
+
+/**
+ * An operator that the tuples of a scan are handed to instead of the
+ * ResultSink, such as TupleSorter or HashAggregate. The scans deliver
+ * them as SELECT * rows in ResultSink::BINARY format.
+ */
+class RowConsumer {
+ public:
+  virtual ~RowConsumer() {}
+
+  /**
+   * take a tuple.
+   * @param len[IN] the length of value
+   * @return error code. 0 if no error
+   */
+  virtual RC add(int key, const char* value, int len) = 0;
+
+  /**
+   * take the tuples of SELECT * rows in ResultSink::BINARY format.
+   * @return error code. 0 if no error
+   */
+  RC addRows(const char* data, int size);
+};
+
+#endif /* RESULTSINK_H */
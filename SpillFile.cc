@@ -0,0 +1,103 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "SpillFile.h"
+
+// the bytes in front of the value of a tuple
+static const int TUPLE_HEADER = sizeof(int) + sizeof(short);
+
+SpillFile::SpillFile()
+{
+  pages = 0;
+}
+
+SpillFile::~SpillFile()
+{
+  pf.close();
+}
+
+RC SpillFile::create()
+{
+  static int created = 0;
+  char name[256];
+  const char* dir = getenv("TMPDIR");
+  snprintf(name, sizeof(name), "%s/bruinbase-spill-%d-%d", dir ? dir : "/tmp", (int)getpid(), created++);
+
+  unlink(name);
+  if (pf.open(name, 'w') < 0) {
+    fprintf(stderr, "Error: cannot create the temporary file %s\n", name);
+    return RC_FILE_OPEN_FAILED;
+  }
+  unlink(name);
+  pages = 0;
+  return 0;
+}
+
+SpillWriter::SpillWriter(SpillFile& file) : file(file)
+{
+  pid = 0;
+  used = sizeof(int);
+}
+
+RC SpillWriter::put(int key, const char* value, int len)
+{
+  RC rc;
+  if (used + TUPLE_HEADER + len > PageFile::PAGE_SIZE && (rc = flush()) < 0) return rc;
+
+  short l = len;
+  memcpy(page + used, &key, sizeof(int));
+  memcpy(page + used + sizeof(int), &l, sizeof(short));
+  memcpy(page + used + TUPLE_HEADER, value, len);
+  used += TUPLE_HEADER + len;
+  return 0;
+}
+
+RC SpillWriter::finish()
+{
+  RC rc = 0;
+  if (used > (int)sizeof(int)) rc = flush();
+  file.pages = pid;
+  return rc;
+}
+
+RC SpillWriter::flush()
+{
+  memcpy(page, &used, sizeof(int));
+  if (file.pf.write(pid++, page) < 0) return RC_FILE_WRITE_FAILED;
+  used = sizeof(int);
+  return 0;
+}
+
+SpillReader::SpillReader(const SpillFile& file) : file(file)
+{
+  pid = -1;
+  offset = used = 0;
+  rc = 0;
+}
+
+bool SpillReader::next()
+{
+  while (offset >= used) {
+    if (++pid >= file.pages) return false;
+    if (file.pf.read(pid, page) < 0) {
+      rc = RC_FILE_READ_FAILED;
+      return false;
+    }
+    memcpy(&used, page, sizeof(int));
+    offset = sizeof(int);
+  }
+
+  short l;
+  memcpy(&key, page + offset, sizeof(int));
+  memcpy(&l, page + offset + sizeof(int), sizeof(short));
+  len = l;
+  value = page + offset + TUPLE_HEADER;
+  offset += TUPLE_HEADER + len;
+  return true;
+}
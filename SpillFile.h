@@ -0,0 +1,92 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef SPILLFILE_H
+#define SPILLFILE_H
+
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * A temporary PageFile of (key, value) tuples that operators write out
+ * when their input does not fit in memory, such as the runs of TupleSorter
+ * and the partitions of HashAggregate.
+ *
+ * Every page starts with the # bytes used in it, followed by the tuples:
+ * the key, the length of the value and the value. A tuple never spans
+ * two pages. The file is unlinked as soon as it is created, so it
+ * disappears when it is closed, even if Bruinbase does not exit cleanly.
+ */
+class SpillFile {
+ public:
+  PageFile pf;      // the file
+  PageId   pages;   // # pages written
+
+  SpillFile();
+  ~SpillFile();
+
+  /**
+   * create the temporary file in $TMPDIR, or /tmp if it is not set.
+   * @return error code. 0 if no error
+   */
+  RC create();
+};
+
+/**
+ * Appends tuples to a SpillFile.
+ */
+class SpillWriter {
+ public:
+  SpillWriter(SpillFile& file);
+
+  /**
+   * append a tuple.
+   * @param len[IN] the length of value
+   * @return error code. 0 if no error
+   */
+  RC put(int key, const char* value, int len);
+
+  /**
+   * write out the last page and set the page count of the file.
+   * @return error code. 0 if no error
+   */
+  RC finish();
+
+ private:
+  SpillFile& file;
+  PageId     pid;                      // the page being filled
+  int        used;                     // # bytes used in page
+  char       page[PageFile::PAGE_SIZE];
+
+  RC flush();
+};
+
+/**
+ * Reads the tuples of a SpillFile in the order they were written.
+ */
+class SpillReader {
+ public:
+  int         key;     // the current tuple
+  const char* value;   // points into the page buffer of the reader
+  int         len;
+  RC          rc;      // the error that ended the file early. 0 if none
+
+  SpillReader(const SpillFile& file);
+
+  /**
+   * move to the next tuple.
+   * @return false at the end of the file or on an error
+   */
+  bool next();
+
+ private:
+  const SpillFile& file;
+  PageId pid;          // the page in page
+  int    offset;       // the offset of the next tuple in page
+  int    used;         // # bytes used in page
+  char   page[PageFile::PAGE_SIZE];
+};
+
+#endif /* SPILLFILE_H */
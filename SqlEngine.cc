@@ -10,194 +10,1443 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <limits.h>
-#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <unistd.h>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
+#include "BTreeNode.h"
+#include "BufferedBTreeIndex.h"
+#include "TableStats.h"
+#include "Predicate.h"
+#include "TupleBatch.h"
+#include "TupleSorter.h"
+#include "Aggregate.h"
+#include "Join.h"
+#include "QueryPlan.h"
+#include "LoadFile.h"
 
 using namespace std;
 
+// order (RecordId, position) pairs by RecordId
+static bool ridLess(const pair<RecordId, int>& r1, const pair<RecordId, int>& r2)
+{
+	return r1.first < r2.first;
+}
+
+// a range of table pages whose index entries one thread collects and sorts
+struct IndexScanTask {
+	const RecordFile* rf;
+	PageId first;                // the first page of the range
+	PageId last;                 // the page behind the range
+	vector<IndexEntry> entries;  // the sorted index entries of the range
+	RC rc;
+};
+
+static void* scanIndexEntries(void* arg)
+{
+	IndexScanTask* task = (IndexScanTask*)arg;
+	int keys[RecordFile::RECORDS_PER_PAGE];
+	int count;
+	IndexEntry entry;
+	task->rc = 0;
+	for (entry.rid.pid = task->first; entry.rid.pid < task->last; entry.rid.pid++)
+	{
+		if ((task->rc = task->rf->readKeys(entry.rid.pid, keys, count)) < 0) return NULL;
+		for (entry.rid.sid = 0; entry.rid.sid < count; entry.rid.sid++)
+		{
+			entry.key = keys[entry.rid.sid];
+			task->entries.push_back(entry);
+		}
+	}
+	sort(task->entries.begin(), task->entries.end());
+	return NULL;
+}
+
+// two sorted runs that one thread merges into one
+struct IndexMergeTask {
+	vector<IndexEntry>* left;
+	vector<IndexEntry>* right;
+	vector<IndexEntry> merged;
+};
+
+static void* mergeIndexEntries(void* arg)
+{
+	IndexMergeTask* task = (IndexMergeTask*)arg;
+	task->merged.resize(task->left->size() + task->right->size());
+	merge(task->left->begin(), task->left->end(), task->right->begin(), task->right->end(),
+		task->merged.begin());
+	vector<IndexEntry>().swap(*task->left);
+	vector<IndexEntry>().swap(*task->right);
+	return NULL;
+}
+
+// run fn(arg) in a new thread, or in this one if no thread can be started
+static bool startThread(pthread_t& thread, void* (*fn)(void*), void* arg)
+{
+	if (pthread_create(&thread, NULL, fn, arg) == 0) return true;
+	fn(arg);
+	return false;
+}
+
+// tasks 0..tasks-1 that worker threads take in order and whose results
+// are consumed in the same order, so that the output is deterministic
+struct TaskQueue {
+	int    tasks;    // # tasks
+	int    next;     // the next task to hand out
+	int    taken;    // # tasks whose results were consumed
+	int    window;   // how far the workers may run ahead of taken
+	RC     rc;       // the first error of a worker
+	vector<char> done;  // done[t] is set once task t has finished
+	pthread_mutex_t lock;
+	pthread_cond_t  changed;  // signalled when any of the above changes
+};
+
+static void initTasks(TaskQueue& q, int tasks, int window)
+{
+	q.tasks = tasks;
+	q.next = q.taken = 0;
+	q.window = window;
+	q.rc = 0;
+	q.done.assign(tasks, 0);
+	pthread_mutex_init(&q.lock, NULL);
+	pthread_cond_init(&q.changed, NULL);
+}
+
+static void destroyTasks(TaskQueue& q)
+{
+	pthread_cond_destroy(&q.changed);
+	pthread_mutex_destroy(&q.lock);
+}
+
+// take the next task, waiting while the workers are window tasks ahead.
+// -1 if no task is left or a worker failed.
+static int nextTask(TaskQueue& q)
+{
+	int t = -1;
+	pthread_mutex_lock(&q.lock);
+	while (q.rc == 0 && q.next < q.tasks && q.next >= q.taken + q.window)
+		pthread_cond_wait(&q.changed, &q.lock);
+	if (q.rc == 0 && q.next < q.tasks) t = q.next++;
+	pthread_mutex_unlock(&q.lock);
+	return t;
+}
+
+// mark task t as finished with the error code rc
+static void finishTask(TaskQueue& q, int t, RC rc)
+{
+	pthread_mutex_lock(&q.lock);
+	if (rc < 0 && q.rc == 0) q.rc = rc;
+	q.done[t] = 1;
+	pthread_cond_broadcast(&q.changed);
+	pthread_mutex_unlock(&q.lock);
+}
+
+// wait until task t has finished. an error code if a worker failed.
+static RC waitTask(TaskQueue& q, int t)
+{
+	pthread_mutex_lock(&q.lock);
+	while (q.rc == 0 && !q.done[t])
+		pthread_cond_wait(&q.changed, &q.lock);
+	RC rc = q.rc;
+	pthread_mutex_unlock(&q.lock);
+	return rc;
+}
+
+// hand out no more tasks, e.g. once a LIMIT is met
+static void stopTasks(TaskQueue& q)
+{
+	pthread_mutex_lock(&q.lock);
+	q.next = q.tasks;
+	pthread_cond_broadcast(&q.changed);
+	pthread_mutex_unlock(&q.lock);
+}
+
+// let the workers run ahead of task t, whose result was consumed
+static void releaseTask(TaskQueue& q, int t)
+{
+	pthread_mutex_lock(&q.lock);
+	q.taken = t + 1;
+	pthread_cond_broadcast(&q.changed);
+	pthread_mutex_unlock(&q.lock);
+}
+
+// start up to threads workers running fn(arg). if none can be started,
+// run all tasks of q in this thread instead.
+// @return the # workers started, to be joined
+static int startWorkers(vector<pthread_t>& ids, int threads, void* (*fn)(void*), void* arg, TaskQueue& q)
+{
+	int started = 0;
+	ids.resize(threads);
+	for (int i = 0; i < threads && i < q.tasks; i++)
+		if (pthread_create(&ids[started], NULL, fn, arg) == 0) started++;
+	if (started == 0)
+	{
+		q.window = q.tasks;
+		fn(arg);
+	}
+	return started;
+}
+
+// # worker threads a parallel scan uses
+static int workerCount()
+{
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	return (threads < 1) ? 1 : threads;
+}
+
+// merge sorted runs pairwise, every pair in its own thread, until one run is left
+static void mergeRuns(vector<vector<IndexEntry> >& runs)
+{
+	vector<pthread_t> ids(runs.size() / 2);
+	vector<bool> started(runs.size() / 2);
+	while (runs.size() > 1)
+	{
+		int pairs = runs.size() / 2;
+		vector<IndexMergeTask> merges(pairs);
+		for (int i = 0; i < pairs; i++)
+		{
+			merges[i].left = &runs[2 * i];
+			merges[i].right = &runs[2 * i + 1];
+			started[i] = startThread(ids[i], mergeIndexEntries, &merges[i]);
+		}
+		vector<vector<IndexEntry> > next(pairs);
+		for (int i = 0; i < pairs; i++)
+		{
+			if (started[i]) pthread_join(ids[i], NULL);
+			next[i].swap(merges[i].merged);
+		}
+		if (runs.size() % 2)
+		{
+			next.push_back(vector<IndexEntry>());
+			next.back().swap(runs.back());
+		}
+		runs.swap(next);
+	}
+}
+
+// the tuples of one chunk of a load file
+struct LoadChunk {
+	vector<int> keys;
+	vector<const char*> values;        // point into the load file. NULL before the first line with a comma
+	vector<int> lens;
+	vector<pair<int, int> > sorted;    // (key, position) of every tuple in key order, for the index
+	RecordId first;                    // the location of the first tuple, once written
+};
+
+// the state the stages of LOAD share. parsers turn the chunks of the
+// file into tuples, the table file is written in chunk order, and the
+// index stage collects the index entries of every written chunk
+struct LoadPipeline {
+	TaskQueue parsed;                  // task t parses chunk t. the window bounds the chunks in memory
+	TaskQueue written;                 // task t finishes once chunk t is in the table file
+	const LoadFile* file;
+	vector<size_t> bounds;             // chunk t is [bounds[t], bounds[t + 1]) of the file
+	vector<LoadChunk> chunks;
+	bool   sortKeys;                   // true if the index is built from sorted runs
+	vector<vector<IndexEntry> > runs;  // the sorted runs of the index stage
+};
+
+// a parser of LOAD. it takes the next chunk until none is left.
+static void* parseLoadChunks(void* arg)
+{
+	LoadPipeline* load = (LoadPipeline*)arg;
+	int t;
+	while ((t = nextTask(load->parsed)) >= 0)
+	{
+		LoadChunk& chunk = load->chunks[t];
+		const char* p = load->file->data() + load->bounds[t];
+		const char* end = load->file->data() + load->bounds[t + 1];
+		int key;
+		const char* value = NULL;
+		int len = 0;
+		while (p < end)
+		{
+			//A line without a comma keeps the value of the line before it
+			const char* lineEnd = LoadFile::lineEnd(p, end);
+			LoadFile::parseLine(p, lineEnd, key, value, len);
+			chunk.keys.push_back(key);
+			chunk.values.push_back(value);
+			chunk.lens.push_back(len);
+			p = lineEnd + 1;
+		}
+		if (load->sortKeys)
+		{
+			chunk.sorted.resize(chunk.keys.size());
+			for (unsigned i = 0; i < chunk.keys.size(); i++) chunk.sorted[i] = make_pair(chunk.keys[i], (int)i);
+			sort(chunk.sorted.begin(), chunk.sorted.end());
+		}
+		finishTask(load->parsed, t, 0);
+	}
+	return NULL;
+}
+
+// the index stage of LOAD. it turns the sorted keys of every written chunk
+// into a run of index entries and merges the last two runs as long as the
+// earlier one is less than twice as long, so that few runs are left.
+static void* buildLoadRuns(void* arg)
+{
+	LoadPipeline* load = (LoadPipeline*)arg;
+	vector<vector<IndexEntry> >& runs = load->runs;
+	for (int t = 0; t < load->written.tasks; t++)
+	{
+		if (waitTask(load->written, t) < 0) break;
+		LoadChunk& chunk = load->chunks[t];
+		runs.push_back(vector<IndexEntry>(chunk.sorted.size()));
+		for (unsigned i = 0; i < chunk.sorted.size(); i++)
+		{
+			runs.back()[i].key = chunk.sorted[i].first;
+			runs.back()[i].rid = chunk.first + chunk.sorted[i].second;
+		}
+		chunk = LoadChunk();
+		releaseTask(load->parsed, t);
+
+		while (runs.size() > 1 && runs[runs.size() - 2].size() < 2 * runs.back().size())
+		{
+			IndexMergeTask merge;
+			merge.left = &runs[runs.size() - 2];
+			merge.right = &runs.back();
+			mergeIndexEntries(&merge);
+			runs.pop_back();
+			runs.back().swap(merge.merged);
+		}
+	}
+	return NULL;
+}
+
+// the result of scanning one morsel of a table or one partition of an index
+struct ScanResult {
+	int    count;                      // # tuples that meet the conditions
+	string output;                     // the printed tuples
+};
+
+// the state a parallel table scan shares between its workers
+struct TableScan {
+	TaskQueue queue;                   // task m scans morsel m
+	const RecordFile* rf;
+	const Predicate*  pred;
+	int    attr;                       // attribute in the SELECT clause. 3 to sort the tuples
+	ResultSink::Format format;         // the format of the output. BINARY to sort the tuples
+	PageId first;                      // the first page of morsel 0
+	vector<ScanResult> results;
+};
+
+// a worker of a parallel table scan. it takes the next morsel until none is left.
+static void* scanMorsels(void* arg)
+{
+	TableScan* scan = (TableScan*)arg;
+	TupleBatch* batch = new TupleBatch;
+	int m;
+	while ((m = nextTask(scan->queue)) >= 0)
+	{
+		//Read and filter the pages of the morsel
+		ScanResult& result = scan->results[m];
+		PageId pid = scan->first + m * TupleBatch::PAGE_COUNT;
+		RC rc = batch->read(*scan->rf, pid);
+		if (rc == 0)
+		{
+			batch->filter(*scan->pred);
+			result.count = batch->selCount;
+			for (int j = 0; scan->attr != 4 && j < batch->selCount; j++)
+			{
+				int row = batch->sel[j];
+				ResultSink::appendRow(result.output, scan->format, scan->attr, batch->keys[row], batch->values[row]);
+			}
+		}
+		finishTask(scan->queue, m, rc);
+	}
+	delete batch;
+	return NULL;
+}
+
+// the state a parallel index scan shares between its workers
+struct IndexRangeScan {
+	TaskQueue queue;                   // task t scans the t-th partition in scan order
+	const RecordFile* rf;
+	string indexFile;                  // every worker opens the index by itself
+	const Predicate*  pred;
+	int    attr;                       // attribute in the SELECT clause. 3 to sort the tuples
+	ResultSink::Format format;         // the format of the output. BINARY to sort the tuples
+	bool   indexOnly;                  // true if the index entries answer the query
+	SelOrder order;
+	int    limit;                      // the most tuples a partition has to return
+	vector<int> bounds;                // partition p is [bounds[p], bounds[p + 1] - 1]
+	vector<ScanResult> results;
+};
+
+// cost of reading a page at random relative to reading it in a sequential scan
+static const double RANDOM_PAGE_COST = 4.0;
+
+// fraction of the table a key range is assumed to select without statistics
+static const double DEFAULT_RANGE_SELECTIVITY = 1.0 / 3;
+
 // external functions and variables for load file and sql command parsing 
 extern FILE* sqlin;
 int sqlparse(void);
 
 
-RC SqlEngine::run(FILE* commandline)
+ResultSink SqlEngine::output(stdout);
+QueryPlan SqlEngine::plan;
+
+// the most key ranges EXPLAIN lists for a scan
+static const unsigned EXPLAIN_RANGES = 10;
+
+static string formatInt(long long n)
+{
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%lld", n);
+	return buf;
+}
+
+// "key" or "value", with a value compared to it for a condition
+static string describeCond(const SelCond& c)
+{
+	static const char* comparators[] = { "=", "<>", "<", ">", "<=", ">=" };
+	string s = (c.attr == 1) ? "key " : "value ";
+	s += comparators[c.comp];
+	s += (c.attr == 1) ? string(" ") + c.value : string(" '") + c.value + "'";
+	return s;
+}
+
+// the table, key ranges, residual conditions and LIMIT of a scan for EXPLAIN.
+// the value conditions are checked on every tuple in the ranges; with
+// several disjuncts the key conditions are checked again with them
+static string describeScan(const string& table, const Predicate& pred, const vector<SelCond>& conds,
+	const SelLimit* limit)
+{
+	string s = "on " + table;
+
+	if (pred.empty) return s + ", the conditions contradict each other";
+	if (pred.ranges.size() != 1 || pred.ranges[0].lo != INT_MIN || pred.ranges[0].hi != INT_MAX)
+	{
+		s += (pred.ranges.size() == 1 && pred.ranges[0].lo == pred.ranges[0].hi) ? ", key = " : ", key in ";
+		for (unsigned i = 0; i < pred.ranges.size() && i < EXPLAIN_RANGES; i++)
+		{
+			const Predicate::KeyRange& r = pred.ranges[i];
+			if (i > 0) s += " ";
+			if (r.lo == r.hi) s += formatInt(r.lo);
+			else s += "[" + (r.lo == INT_MIN ? string("min") : formatInt(r.lo)) + ", "
+				+ (r.hi == INT_MAX ? string("max") : formatInt(r.hi)) + "]";
+		}
+		if (pred.ranges.size() > EXPLAIN_RANGES)
+			s += " ... (" + formatInt(pred.ranges.size()) + " ranges)";
+	}
+
+	if (pred.hasValueTests())
+	{
+		int disjuncts = 0;
+		for (unsigned i = 0; i < conds.size(); i++) disjuncts = max(disjuncts, conds[i].disjunct + 1);
+		string filter;
+		for (int d = 0; d < disjuncts; d++)
+		{
+			string conj;
+			for (unsigned i = 0; i < conds.size(); i++)
+			{
+				if (conds[i].disjunct != d || (disjuncts == 1 && conds[i].attr == 1)) continue;
+				if (!conj.empty()) conj += " AND ";
+				conj += describeCond(conds[i]);
+			}
+			if (d > 0) filter += " OR ";
+			filter += (disjuncts > 1) ? "(" + conj + ")" : conj;
+		}
+		s += ", filter " + filter;
+	}
+
+	if (limit && limit->count >= 0) s += ", limit " + formatInt(limit->count);
+	if (limit && limit->offset > 0) s += " offset " + formatInt(limit->offset);
+	return s;
+}
+
+// the ORDER BY and LIMIT of a sort for EXPLAIN
+static string describeSort(const SelOrder& order, const SelLimit& limit)
+{
+	string s = (order.attr == 1) ? "by key" : "by value";
+	if (order.desc) s += " desc";
+	if (limit.count >= 0) s += ", limit " + formatInt(limit.count);
+	if (limit.offset > 0) s += " offset " + formatInt(limit.offset);
+	return s;
+}
+
+// the statements of PREPARE by name. their strings belong to them
+static map<string, SelStatement*> prepared;
+
+static char* copyString(const char* s)
+{
+	return s ? strdup(s) : NULL;
+}
+
+SelStatement* copyStatement(const SelStatement& stmt)
+{
+	SelStatement* p = new SelStatement(stmt);
+	for (unsigned i = 0; i < p->items.size(); i++)
+		p->items[i].table = copyString(stmt.items[i].table);
+	for (unsigned i = 0; i < p->conds.size(); i++)
+		p->conds[i].value = copyString(stmt.conds[i].value);
+	for (unsigned i = 0; i < p->joinConds.size(); i++)
+	{
+		SelJoinCond& c = p->joinConds[i];
+		c.column.table = copyString(c.column.table);
+		c.value = copyString(c.value);
+		c.other.table = copyString(c.other.table);
+	}
+	return p;
+}
+
+void freeStatement(SelStatement* stmt)
+{
+	for (unsigned i = 0; i < stmt->items.size(); i++) free(stmt->items[i].table);
+	for (unsigned i = 0; i < stmt->conds.size(); i++) free(stmt->conds[i].value);
+	for (unsigned i = 0; i < stmt->joinConds.size(); i++)
+	{
+		free(stmt->joinConds[i].column.table);
+		free(stmt->joinConds[i].value);
+		free(stmt->joinConds[i].other.table);
+	}
+	delete stmt;
+}
+
+RC SqlEngine::run(FILE* commandline)
+{
+	if (output.getFormat() == ResultSink::TEXT) fprintf(stdout, "Bruinbase> ");
+	// set the command line input and start parsing user input
+	sqlin = commandline;
+	sqlparse(); // sqlparse() is defined in SqlParser.tab.c generated from
+	// SqlParser.y by bison (bison is GNU equivalent of yacc)
+
+	// free the prepared statements and close the tables the session kept
+	for (map<string, SelStatement*>::iterator it = prepared.begin(); it != prepared.end(); ++it)
+		freeStatement(it->second);
+	prepared.clear();
+	Catalog::closeAll();
+	return 0;
+}
+
+void SqlEngine::setOutputFormat(ResultSink::Format format)
+{
+	output.setFormat(format);
+}
+
+ResultSink::Format SqlEngine::getOutputFormat()
+{
+	return output.getFormat();
+}
+
+RC SqlEngine::flushOutput()
+{
+	return output.flush();
+}
+
+RC SqlEngine::query(const SelStatement& stmt)
+{
+	if (stmt.params > 0)
+	{
+		fprintf(stderr, "Error: parameters (?) can only be used in PREPARE\n");
+		return RC_INVALID_ATTRIBUTE;
+	}
+	return runQuery(stmt);
+}
+
+RC SqlEngine::explain(const SelStatement& stmt, bool analyze)
+{
+	RC rc;
+
+	if (stmt.params > 0)
+	{
+		fprintf(stderr, "Error: parameters (?) can only be used in PREPARE\n");
+		return RC_INVALID_ATTRIBUTE;
+	}
+
+	//EXPLAIN ANALYZE runs the query, but only its plan is output
+	plan.begin(analyze);
+	output.setDiscard(true);
+	rc = runQuery(stmt);
+	output.flush();
+	output.setDiscard(false);
+	output.setLimit(0, -1);
+	if (rc == 0) plan.print(output);
+	plan.end();
+	return rc;
+}
+
+RC SqlEngine::prepare(const string& name, const SelStatement& stmt)
+{
+	//A statement of the same name is replaced
+	SelStatement*& old = prepared[name];
+	if (old) freeStatement(old);
+	old = copyStatement(stmt);
+	return 0;
+}
+
+RC SqlEngine::execute(const string& name, const vector<char*>& params)
+{
+	map<string, SelStatement*>::iterator it = prepared.find(name);
+	RC rc;
+
+	if (it == prepared.end())
+	{
+		fprintf(stderr, "Error: prepared statement %s does not exist\n", name.c_str());
+		return RC_INVALID_ATTRIBUTE;
+	}
+	SelStatement& stmt = *it->second;
+	if ((int)params.size() != stmt.params)
+	{
+		fprintf(stderr, "Error: %s takes %d parameters, not %d\n", name.c_str(), stmt.params, (int)params.size());
+		return RC_INVALID_ATTRIBUTE;
+	}
+
+	//Bind the parameters in place for this run
+	for (unsigned i = 0; i < stmt.conds.size(); i++)
+		if (stmt.conds[i].param) stmt.conds[i].value = params[stmt.conds[i].param - 1];
+	for (unsigned i = 0; i < stmt.joinConds.size(); i++)
+		if (stmt.joinConds[i].param) stmt.joinConds[i].value = params[stmt.joinConds[i].param - 1];
+	rc = runQuery(stmt);
+	for (unsigned i = 0; i < stmt.conds.size(); i++)
+		if (stmt.conds[i].param) stmt.conds[i].value = NULL;
+	for (unsigned i = 0; i < stmt.joinConds.size(); i++)
+		if (stmt.joinConds[i].param) stmt.joinConds[i].value = NULL;
+	return rc;
+}
+
+RC SqlEngine::runQuery(const SelStatement& stmt)
+{
+	const vector<SelAggregate>& items = stmt.items;
+	TableHandle* t;
+	RC rc;
+
+	if (!stmt.right.empty()) return join(items, stmt.table, stmt.right, stmt.joinConds, stmt.limit);
+
+	for (unsigned i = 0; i < items.size(); i++)
+	{
+		if (items[i].table && stmt.table != items[i].table)
+		{
+			fprintf(stderr, "Error: table %s is not in the FROM clause\n", items[i].table);
+			return RC_INVALID_ATTRIBUTE;
+		}
+	}
+
+	//One column, * or COUNT(*) alone is a plain SELECT
+	bool plain = items.size() == 1 && stmt.group == 0 &&
+		(items[0].func == SelAggregate::NONE || items[0].func == SelAggregate::COUNT);
+	if (!plain && stmt.order.attr != 0)
+	{
+		fprintf(stderr, "Error: ORDER BY is not supported with aggregates or GROUP BY\n");
+		return RC_INVALID_ATTRIBUTE;
+	}
+
+	if ((rc = openTable(stmt.table, t)) < 0) return rc;
+	if (!plain) return aggregateTable(items, *t, stmt.conds, stmt.group, stmt.limit);
+	if (items[0].func == SelAggregate::COUNT) return selectTable(4, *t, stmt.conds, stmt.order, stmt.limit);
+	return selectTable(items[0].attr, *t, stmt.conds, stmt.order, stmt.limit);
+}
+
+RC SqlEngine::openTable(const string& table, TableHandle*& t)
+{
+	RC rc;
+
+	if ((rc = Catalog::open(table, t)) < 0)
+		fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+	return rc;
+}
+
+RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond, const SelOrder& order,
+	const SelLimit& limit)
+{
+	TableHandle* t;
+	RC rc;
+
+	if ((rc = openTable(table, t)) < 0) return rc;
+	return selectTable(attr, *t, cond, order, limit);
+}
+
+RC SqlEngine::selectTable(int attr, TableHandle& t, const vector<SelCond>& cond, const SelOrder& order,
+	const SelLimit& limit)
+{
+	RecordFile& rf = t.rf;
+	BTreeIndex& index = t.index;
+	const string& table = t.name;
+
+	RC     rc;
+	int    count;
+
+	//The output drops the rows outside the LIMIT, and the scans ask it
+	//how many rows they still have to produce
+	output.setLimit(limit.offset, limit.count);
+
+	//check the index file
+	if (!t.indexed) return oldSelectFunction(attr, table, rf, cond, order, limit);
+
+	//Compile the conditions once. The key conditions are narrowed down
+	//to one range [keyMin, keyMax] and the keys excluded by NE conditions.
+	Predicate pred;
+	pred.compile(cond);
+
+	count = 0;
+	if (pred.empty)
+	{
+		plan.add(-1, "Empty Result", "(the conditions contradict each other)");
+		if (plan.describeOnly()) return 0;
+	}
+	else
+	{
+		bool indexOnly = !pred.hasValueTests() && (attr == 4 || (attr == 1 && order.attr != 2));
+		ScanType scan = chooseScan(t, pred, indexOnly, indexOnly && attr == 4);
+		//The index returns the tuples in key order, which saves sorting them
+		if (scan == TABLE_SCAN && order.attr == 1 && attr != 4)
+			scan = indexOnly ? INDEX_ONLY_SCAN : INDEX_SCAN;
+		if (scan == TABLE_SCAN)
+			return oldSelectFunction(attr, table, rf, cond, order, limit);
+
+		bool sorting = (order.attr == 2 && attr != 4);
+		int sortOp = -1, scanOp = -1;
+		if (plan.active())
+		{
+			const char* name = (scan == INDEX_COUNT) ? "Index Count"
+				: (scan == INDEX_ONLY_SCAN) ? "Index Only Scan" : "Index Scan";
+			string detail = describeScan(table, pred, cond, sorting ? NULL : &limit);
+			if (order.attr == 1 && attr != 4) detail += order.desc ? ", key order backward" : ", key order";
+			if (sorting) sortOp = plan.add(-1, "Sort", describeSort(order, limit));
+			scanOp = plan.add(sortOp, name, detail);
+		}
+		if (plan.describeOnly()) return 0;
+
+		plan.start(sortOp);
+		plan.start(scanOp);
+		if (scan == INDEX_COUNT)
+		{
+			//Add up the entry counts of the key ranges in the tree
+			rc = countRanges(index, pred, count);
+			plan.stop(scanOp);
+		}
+		else if (sorting)
+		{
+			//The index returns the tuples in key order, so ORDER BY value sorts them
+			TupleSorter sorter(order.attr, order.desc);
+			SelOrder any = { 0, false };
+			rc = scanIndexParallel(table, rf, index, attr, pred, indexOnly, any, &sorter, count);
+			plan.stop(scanOp);
+			if (rc == 0) rc = sorter.output(output, attr);
+			plan.stop(sortOp);
+			plan.setRows(sortOp, count, -1);
+		}
+		else
+		{
+			rc = scanIndexParallel(table, rf, index, attr, pred, indexOnly, order, NULL, count);
+			plan.stop(scanOp);
+		}
+		plan.setRows(scanOp, -1, count);
+		if (rc < 0)
+		{
+			fprintf(stderr, "Error: cannot read a tuple from table %s\n", table.c_str());
+			return rc;
+		}
+	}
+		
+	// print matching tuple count if "select count(*)"
+	if (attr == 4)
+	{
+		output.putCount(count);
+	}
+	return 0;
+}
+
+RC SqlEngine::aggregate(const vector<SelAggregate>& items, const string& table, const vector<SelCond>& cond,
+	int group, const SelLimit& limit)
+{
+	TableHandle* t;
+	RC rc;
+
+	if ((rc = openTable(table, t)) < 0) return rc;
+	return aggregateTable(items, *t, cond, group, limit);
+}
+
+RC SqlEngine::aggregateTable(const vector<SelAggregate>& items, TableHandle& t, const vector<SelCond>& cond,
+	int group, const SelLimit& limit)
+{
+	RecordFile& rf = t.rf;
+	BTreeIndex& index = t.index;
+	const string& table = t.name;
+	bool indexed = t.indexed;
+	Predicate pred;
+	ScalarAggregate scalar;
+	HashAggregate groups;
+
+	RC     rc = 0;
+	int    count = 0;
+
+	//Check the SELECT clause against the GROUP BY clause
+	if (group == 1)
+	{
+		fprintf(stderr, "Error: GROUP BY is only supported on the value column\n");
+		return RC_INVALID_ATTRIBUTE;
+	}
+	bool endpoints = true;  //true if the index entry counts and endpoints answer every item
+	for (unsigned i = 0; i < items.size(); i++)
+	{
+		SelAggregate::Function func = items[i].func;
+		if (func == SelAggregate::NONE && (items[i].attr != 2 || group != 2))
+		{
+			fprintf(stderr, "Error: only the value column of GROUP BY value can be selected with aggregates\n");
+			return RC_INVALID_ATTRIBUTE;
+		}
+		if (func != SelAggregate::NONE && func != SelAggregate::COUNT && items[i].attr != 1)
+		{
+			fprintf(stderr, "Error: MIN, MAX, SUM and AVG are only supported on the key column\n");
+			return RC_INVALID_ATTRIBUTE;
+		}
+		if (func == SelAggregate::NONE || func == SelAggregate::SUM || func == SelAggregate::AVG)
+			endpoints = false;
+	}
+
+	output.setLimit(limit.offset, limit.count);
+	pred.compile(cond);
+
+	int aggregateOp = -1, scanOp = -1;
+	if (plan.active())
+	{
+		string detail = group ? "by value" : "";
+		if (limit.count >= 0) detail += (group ? ", limit " : "limit ") + formatInt(limit.count);
+		if (limit.offset > 0) detail += " offset " + formatInt(limit.offset);
+		aggregateOp = plan.add(-1, group ? "Hash Aggregate" : "Aggregate", detail);
+	}
+
+	if (!pred.empty)
+	{
+		//Without GROUP BY and value conditions the keys in the index are all it takes
+		bool indexOnly = !pred.hasValueTests() && group == 0;
+		RowConsumer* consumer = group ? (RowConsumer*)&groups : (RowConsumer*)&scalar;
+		ScanType scan = TABLE_SCAN;
+		if (indexed && indexOnly && endpoints)
+			scan = INDEX_COUNT;
+		else if (indexed)
+			scan = chooseScan(t, pred, indexOnly, false);
+		if (plan.active())
+		{
+			const char* name = (scan == INDEX_COUNT) ? "Index Endpoints" : (scan == TABLE_SCAN) ? "Table Scan"
+				: (scan == INDEX_ONLY_SCAN) ? "Index Only Scan" : "Index Scan";
+			scanOp = plan.add(aggregateOp, name, describeScan(table, pred, cond, NULL));
+		}
+		if (plan.describeOnly()) return 0;
+
+		plan.start(aggregateOp);
+		plan.start(scanOp);
+		if (scan == INDEX_COUNT)
+		{
+			rc = readEndpoints(index, pred, scalar.state);
+			count = scalar.state.count;
+		}
+		else if (scan != TABLE_SCAN)
+		{
+			SelOrder any = { 0, false };
+			rc = scanIndexParallel(table, rf, index, 3, pred, indexOnly, any, consumer, count);
+		}
+		else
+			rc = scanTable(rf, pred, 3, consumer, count);
+		plan.stop(scanOp);
+		plan.setRows(scanOp, -1, count);
+	}
+	else
+	{
+		if (plan.describeOnly()) return 0;
+		plan.start(aggregateOp);
+	}
+	if (rc < 0)
+		fprintf(stderr, "Error: cannot read a tuple from table %s\n", table.c_str());
+	else if (group)
+		rc = groups.output(output, items);
+	else
+		scalar.state.output(output, items, NULL, 0);
+	plan.stop(aggregateOp);
+	plan.setRows(aggregateOp, count, group ? -1 : 1);
+	return rc;
+}
+
+// the table of the FROM clause of a join a column belongs to:
+// 0 - left, 1 - right, -1 if it is unqualified or not in the FROM clause
+static int findJoinTable(const char* name, const JoinTable* tables)
+{
+	if (name == NULL) return -1;
+	if (tables[0].name == name) return 0;
+	if (tables[1].name == name) return 1;
+	fprintf(stderr, "Error: table %s is not in the FROM clause\n", name);
+	return -1;
+}
+
+RC SqlEngine::join(const vector<SelAggregate>& items, const string& left, const string& right,
+	const vector<SelJoinCond>& cond, const SelLimit& limit)
+{
+	JoinTable tables[2];
+	vector<SelCond> conds[2];
+	vector<JoinOutput::Column> columns;
+	bool selected[2] = { false, false };  //true if the values of a table are selected
+	bool joined = false;
+	RC   rc = 0;
+
+	if (left == right)
+	{
+		fprintf(stderr, "Error: table %s cannot be joined with itself\n", left.c_str());
+		return RC_INVALID_ATTRIBUTE;
+	}
+	tables[0].name = left;
+	tables[1].name = right;
+
+	//Resolve the columns of the SELECT clause. Both tuples of a row
+	//have the same key, so an unqualified key is not ambiguous.
+	bool countOnly = (items.size() == 1 && items[0].func == SelAggregate::COUNT);
+	for (unsigned i = 0; i < items.size() && !countOnly; i++)
+	{
+		const SelAggregate& item = items[i];
+		int t = findJoinTable(item.table, tables);
+		if (item.func != SelAggregate::NONE)
+		{
+			fprintf(stderr, "Error: only columns, * or COUNT(*) alone can be selected from a join\n");
+			return RC_INVALID_ATTRIBUTE;
+		}
+		if (item.table && t < 0) return RC_INVALID_ATTRIBUTE;
+		if (item.attr == 1)
+			columns.push_back(JoinOutput::KEY);
+		else if (item.attr == 2 && t < 0)
+		{
+			fprintf(stderr, "Error: the value column is ambiguous in a join\n");
+			return RC_INVALID_ATTRIBUTE;
+		}
+		else if (item.attr == 2)
+		{
+			columns.push_back(t ? JoinOutput::RIGHT_VALUE : JoinOutput::LEFT_VALUE);
+			selected[t] = true;
+		}
+		else
+		{
+			columns.push_back(JoinOutput::KEY);
+			columns.push_back(JoinOutput::LEFT_VALUE);
+			columns.push_back(JoinOutput::KEY);
+			columns.push_back(JoinOutput::RIGHT_VALUE);
+			selected[0] = selected[1] = true;
+		}
+	}
+
+	//Sort the conditions out by table. A key condition holds for the
+	//keys of both tables, so both scans use it to narrow their range.
+	for (unsigned i = 0; i < cond.size(); i++)
+	{
+		const SelJoinCond& c = cond[i];
+		int t = findJoinTable(c.column.table, tables);
+		if (c.column.table && t < 0) return RC_INVALID_ATTRIBUTE;
+		if (c.value == NULL)
+		{
+			int o = findJoinTable(c.other.table, tables);
+			if (c.other.table && o < 0) return RC_INVALID_ATTRIBUTE;
+			if (c.comp != SelCond::EQ || c.column.attr != 1 || c.other.attr != 1 || (t >= 0 && t == o))
+			{
+				fprintf(stderr, "Error: the tables can only be joined on %s.key = %s.key\n", left.c_str(), right.c_str());
+				return RC_INVALID_ATTRIBUTE;
+			}
+			joined = true;
+			continue;
+		}
+		SelCond sc;
+		sc.attr = c.column.attr;
+		sc.comp = c.comp;
+		sc.value = c.value;
+		sc.disjunct = 0;
+		if (sc.attr == 1)
+		{
+			conds[0].push_back(sc);
+			conds[1].push_back(sc);
+		}
+		else if (t < 0)
+		{
+			fprintf(stderr, "Error: the value column is ambiguous in a join\n");
+			return RC_INVALID_ATTRIBUTE;
+		}
+		else conds[t].push_back(sc);
+	}
+	if (!joined)
+	{
+		fprintf(stderr, "Error: the WHERE clause must join the tables on %s.key = %s.key\n", left.c_str(), right.c_str());
+		return RC_INVALID_ATTRIBUTE;
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		JoinTable& t = tables[i];
+		if ((rc = openTable(t.name, t.table)) < 0) return rc;
+		t.pred.compile(conds[i]);
+		t.needValue = selected[i] || t.pred.hasValueTests();
+		t.rows = estimateRows(*t.table, t.pred);
+	}
+
+	output.setLimit(limit.offset, limit.count);
+	{
+		JoinOutput out(output, columns);
+		if (tables[0].pred.empty || tables[1].pred.empty)
+			plan.add(-1, "Empty Result", "(the conditions contradict each other)");
+		else
+		{
+			int outer;
+			JoinType type = chooseJoin(tables, outer);
+			int joinOp = -1;
+			if (plan.active())
+			{
+				static const char* names[] = { "Nested Loop Join", "Hash Join", "Merge Join" };
+				string detail = "on " + left + ".key = " + right + ".key";
+				if (type == HASH_JOIN) detail += ", build " + tables[1 - outer].name;
+				if (limit.count >= 0) detail += ", limit " + formatInt(limit.count);
+				if (limit.offset > 0) detail += " offset " + formatInt(limit.offset);
+				joinOp = plan.add(-1, names[type], detail);
+			}
+
+			plan.start(joinOp);
+			if (type == MERGE_JOIN)
+			{
+				//The merge join reads both indexes itself, so they are not measured apart
+				for (int i = 0; i < 2 && plan.active(); i++)
+					plan.add(joinOp, tables[i].needValue ? "Index Scan" : "Index Only Scan",
+						describeScan(tables[i].name, tables[i].pred, conds[i], NULL));
+				if (!plan.describeOnly()) rc = mergeJoin(tables[0], tables[1], out);
+			}
+			else if (type == NESTED_LOOP_JOIN)
+			{
+				IndexNestedLoopJoin nested(out, tables[1 - outer], outer == 1);
+				rc = scanJoinInput(tables[outer], conds[outer], &nested, joinOp);
+				plan.add(joinOp, "Index Lookup", describeScan(tables[1 - outer].name, tables[1 - outer].pred,
+					conds[1 - outer], NULL));
+			}
+			else
+			{
+				//The inner table is the build input, the outer one probes it
+				HashJoin hash(out, outer == 1);
+				if ((rc = scanJoinInput(tables[1 - outer], conds[1 - outer], &hash, joinOp)) == 0
+					&& (rc = hash.probe()) == 0
+					&& (rc = scanJoinInput(tables[outer], conds[outer], &hash, joinOp)) == 0)
+					rc = hash.finish();
+			}
+			plan.stop(joinOp);
+			plan.setRows(joinOp, -1, out.count);
+		}
+		if (plan.describeOnly()) return 0;
+		if (rc < 0)
+			fprintf(stderr, "Error: cannot join tables %s and %s\n", left.c_str(), right.c_str());
+		else if (countOnly)
+			output.putCount(out.count);
+	}
+	return rc;
+}
+
+SqlEngine::JoinType SqlEngine::chooseJoin(JoinTable* tables, int& outer)
 {
-	fprintf(stdout, "Bruinbase> ");
-	// set the command line input and start parsing user input
-	sqlin = commandline;
-	sqlparse(); // sqlparse() is defined in SqlParser.tab.c generated from
-	// SqlParser.y by bison (bison is GNU equivalent of yacc)
+	double scan[2];    //the cost of scanning the tuples of a table that meet its conditions
+	double fetch[2];   //the cost of reading the matching tuples of a table one by one
+	for (int i = 0; i < 2; i++)
+	{
+		const JoinTable& t = tables[i];
+		const RecordId& erid = t.table->rf.endRid();
+		scan[i] = erid.pid + (erid.sid > 0 ? 1 : 0);
+		if (t.table->indexed)
+			scan[i] = min(scan[i], indexScanCost(*t.table, t.rows, t.pred.ranges.size(), !t.needValue));
+		fetch[i] = t.needValue ? min(tables[0].rows, tables[1].rows) * RANDOM_PAGE_COST : 0;
+	}
+
+	//A hash join scans both tables once and builds on the smaller input.
+	//If that does not fit in memory, both inputs are written out to
+	//partitions and read back once more.
+	outer = (tables[0].rows <= tables[1].rows) ? 1 : 0;
+	JoinType best = HASH_JOIN;
+	double tupleBytes = PageFile::PAGE_SIZE / (double)RecordFile::RECORDS_PER_PAGE;
+	double bestCost = scan[0] + scan[1];
+	if (tables[1 - outer].rows * tupleBytes > HashJoin::MEMORY_BUDGET)
+		bestCost += 2 * (tables[0].rows + tables[1].rows) / RecordFile::RECORDS_PER_PAGE;
+
+	//A nested loop join scans the outer table and looks up every key in
+	//the index of the inner table, a random read of a leaf, and then
+	//reads the matching inner tuples if their values are needed
+	for (int o = 0; o < 2; o++)
+	{
+		if (!tables[1 - o].table->indexed) continue;
+		double cost = scan[o] + tables[o].rows * RANDOM_PAGE_COST + fetch[1 - o];
+		if (cost < bestCost)
+		{
+			best = NESTED_LOOP_JOIN;
+			bestCost = cost;
+			outer = o;
+		}
+	}
+
+	//A merge join reads the leaves of both indexes in the key range
+	//and the matching tuples whose values are needed
+	if (tables[0].table->indexed && tables[1].table->indexed)
+	{
+		double cost = 0;
+		for (int i = 0; i < 2; i++)
+			cost += indexScanCost(*tables[i].table, tables[i].rows, 1, true) + fetch[i];
+		if (cost < bestCost) best = MERGE_JOIN;
+	}
+	return best;
+}
+
+RC SqlEngine::scanJoinInput(JoinTable& t, const vector<SelCond>& conds, RowConsumer* consumer, int parent)
+{
+	RC rc;
+	int count = 0;
+	bool indexOnly = !t.needValue;
+	TableHandle& h = *t.table;
+	ScanType scan = TABLE_SCAN;
+	if (h.indexed && chooseScan(h, t.pred, indexOnly, false) != TABLE_SCAN)
+		scan = indexOnly ? INDEX_ONLY_SCAN : INDEX_SCAN;
+
+	int op = -1;
+	if (plan.active())
+	{
+		const char* name = (scan == TABLE_SCAN) ? "Table Scan" : indexOnly ? "Index Only Scan" : "Index Scan";
+		op = plan.add(parent, name, describeScan(h.name, t.pred, conds, NULL));
+	}
+	if (plan.describeOnly()) return 0;
+
+	plan.start(op);
+	if (scan != TABLE_SCAN)
+	{
+		SelOrder any = { 0, false };
+		rc = scanIndexParallel(h.name, h.rf, h.index, 3, t.pred, indexOnly, any, consumer, count);
+	}
+	else
+		rc = scanTable(h.rf, t.pred, 3, consumer, count);
+	plan.stop(op);
+	plan.setRows(op, -1, count);
+	return rc;
+}
+
+RC SqlEngine::readEndpoints(BTreeIndex& index, const Predicate& pred, AggregateState& state)
+{
+	RC rc;
+	int key;
+	RecordId rid;
+	IndexCursor cursor;
+
+	//COUNT(*) comes from the entry counts in the tree
+	if ((rc = countRanges(index, pred, state.count)) < 0) return rc;
+	if (state.count == 0) return 0;
 
+	//MIN(key) is the first key in the first range that holds one,
+	//and MAX(key) the last key in the last one
+	for (unsigned i = 0; i < pred.ranges.size(); i++)
+	{
+		index.locate(pred.ranges[i].lo, cursor);
+		if (index.readForward(cursor, key, rid) == 0 && key <= pred.ranges[i].hi) break;
+	}
+	state.min = key;
+	for (unsigned i = pred.ranges.size(); i-- > 0; )
+	{
+		index.locateLast(pred.ranges[i].hi, cursor);
+		if (index.readBackward(cursor, key, rid) == 0 && key >= pred.ranges[i].lo) break;
+	}
+	state.max = key;
 	return 0;
 }
 
-RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)//OK
+RC SqlEngine::countRanges(BTreeIndex& index, const Predicate& pred, int& count)
 {
-	RecordFile rf;   // RecordFile containing the table
-	RecordId   rid;  // record cursor for table scanning
-	BTreeIndex index;
-	vector<SelCond> condVec;
+	RC rc;
+	int n;
+	count = 0;
+	for (unsigned i = 0; i < pred.ranges.size(); i++)
+	{
+		if ((rc = index.countRange(pred.ranges[i].lo, pred.ranges[i].hi, n)) < 0) return rc;
+		count += n;
+	}
+	return 0;
+}
 
-	RC     rc;
-	int    key;
-	string value;
-	int    count;
-	int    diff;
+RC SqlEngine::scanIndexParallel(const string& table, const RecordFile& rf, BTreeIndex& index, int attr,
+	const Predicate& pred, bool indexOnly, const SelOrder& order, RowConsumer* consumer, int& count)
+{
+	RC rc;
+	IndexRangeScan scan;
 
-	// open the table file
-	if ((rc = rf.open(table + ".tbl", 'r')) < 0)
+	//Tuples for a consumer are handed over whole, in binary
+	int rowAttr = consumer ? 3 : attr;
+	ResultSink::Format format = consumer ? ResultSink::BINARY : output.getFormat();
+
+	//Cut the key range into partitions at separator keys of the tree.
+	//A range that fits in one partition, such as a point lookup, and a
+	//LIMIT that fits in one are scanned right here without any thread:
+	//the scan locates the first key and stops after the rows it needs
+	int limit = (attr == 4 || consumer) ? INT_MAX : output.rowsWanted();
+	vector<int> bounds;
+	if (limit > INDEX_PARTITION_SIZE &&
+		(rc = index.splitRange(pred.keyMin, pred.keyMax, INDEX_PARTITION_SIZE, bounds)) < 0) return rc;
+	if (bounds.empty())
 	{
-		fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+		string out;
+		rc = scanIndex(rf, index, rowAttr, pred, pred.keyMin, pred.keyMax, indexOnly, order, limit,
+			format, out, count);
+		if (consumer && rc == 0) rc = consumer->addRows(out.data(), out.size());
+		else if (!consumer) output.write(out.data(), out.size());
 		return rc;
 	}
+	scan.bounds.push_back(pred.keyMin);
+	scan.bounds.insert(scan.bounds.end(), bounds.begin(), bounds.end());
+	int partitions = scan.bounds.size();
 
-	//check the index file
-	if (index.open(table + ".idx", 'r') == 0)
+	scan.rf = &rf;
+	scan.indexFile = table + ".idx";
+	scan.pred = &pred;
+	scan.attr = rowAttr;
+	scan.format = format;
+	scan.indexOnly = indexOnly;
+	scan.order = order;
+	scan.limit = limit;
+	scan.results.resize(partitions);
+	int threads = workerCount();
+	initTasks(scan.queue, partitions, 2 * threads);
+	vector<pthread_t> ids;
+	int started = startWorkers(ids, threads, scanPartitions, &scan, scan.queue);
+
+	//The partitions are printed in the order they are scanned in, which is key order.
+	//For COUNT(*) only their counts are added up.
+	for (int t = 0; t < partitions && (rc = waitTask(scan.queue, t)) == 0; t++)
 	{
-		count = 0;
-		int keyMin = INT_MIN, keyMax = INT_MAX;
-		// check boundary condition
-		bool euqlasMin = false, equalsMax = false;
-		vector<int> NElist;
-		for (unsigned int i = 0; i < cond.size(); i++)
+		ScanResult& result = scan.results[t];
+		count += result.count;
+		if (consumer) rc = consumer->addRows(result.output.data(), result.output.size());
+		else output.write(result.output.data(), result.output.size());
+		string().swap(result.output);
+		releaseTask(scan.queue, t);
+		if (rc < 0)
 		{
-			if (cond[i].attr == 2) condVec.push_back(cond[i]);
-			else
-			{
-				int val = atoi(cond[i].value);
-				if (cond[i].comp == SelCond::EQ)
-				{
-					if (val > keyMin)
-					{
-						keyMin = val;
-						euqlasMin = true;
-					}
-					if (val < keyMax)
-					{
-						keyMax = val;
-						equalsMax = true;
-					}
-				}
-				else if (cond[i].comp == SelCond::GT)
-				{
-					if (val > keyMin || (val == keyMin && euqlasMin))
-					{
-						keyMin = val;
-						euqlasMin = false;
-					}
-				}
-				else if (cond[i].comp == SelCond::NE)
-				{
-					NElist.push_back(val);
-				}
-				else if (cond[i].comp == SelCond::LE)
-				{
-					if (val < keyMax)
-					{
-						keyMax = val;
-						equalsMax = true;
-					}
-				}
-				else if (cond[i].comp == SelCond::LT)
-				{
-					if (val < keyMax || (val == keyMax && euqlasMin))
-					{
-						keyMax = val;
-						equalsMax = false;
-					}
-				}
-				else if (cond[i].comp == SelCond::GE)
-				{
-					if (val > keyMin)
-					{
-						keyMin = val;
-						euqlasMin = true;
-					}
-				}
-			}
+			stopTasks(scan.queue);
+			break;
 		}
-		if (keyMin > keyMax || (keyMax == keyMin && !(euqlasMin && equalsMax)))
+		if (output.full())
 		{
-			rf.close();
-			return rc;
+			stopTasks(scan.queue);
+			break;
 		}
-		IndexCursor startCursor, endCursor, tempCursor, curCursor;
-		index.locate(keyMin, startCursor);
-		tempCursor = startCursor;
-		index.readForward(startCursor, key, rid);
-		if (key > keyMin || euqlasMin) startCursor = tempCursor;
+	}
+	for (int i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+	destroyTasks(scan.queue);
+	return rc;
+}
 
-		if (!index.locate(keyMax, endCursor))
-		{
-			tempCursor = endCursor;
-			index.readForward(endCursor, key, rid);
-			if (key < keyMax || !equalsMax) endCursor = tempCursor;
-		}
+void* SqlEngine::scanPartitions(void* arg)
+{
+	IndexRangeScan* scan = (IndexRangeScan*)arg;
+	int partitions = scan->bounds.size();
+	bool backward = (scan->order.attr == 1 && scan->order.desc);
 
-		curCursor = startCursor;
-		while (curCursor.pid != -1 && (curCursor.pid != endCursor.pid || curCursor.eid != endCursor.eid))
-		{
-			index.readForward(curCursor, key, rid);
-			int listIndex;
-			for (listIndex = 0; listIndex<NElist.size(); listIndex++)
-				if (key == NElist[listIndex])
-					break;
+	//A BTreeIndex caches the leaf it scans, so every worker needs its own
+	BTreeIndex index;
+	RC rc = index.open(scan->indexFile, 'r');
+	int t;
+	while ((t = nextTask(scan->queue)) >= 0)
+	{
+		//A descending scan takes the partitions from the last one
+		int p = backward ? partitions - 1 - t : t;
+		int lo = scan->bounds[p];
+		int hi = (p + 1 < partitions) ? scan->bounds[p + 1] - 1 : scan->pred->keyMax;
+		ScanResult& result = scan->results[t];
+		result.count = 0;
+		if (rc == 0)
+			rc = scanIndex(*scan->rf, index, scan->attr, *scan->pred, lo, hi, scan->indexOnly,
+				scan->order, scan->limit, scan->format, result.output, result.count);
+		finishTask(scan->queue, t, rc);
+	}
+	if (rc == 0) index.close();
+	return NULL;
+}
+
+RC SqlEngine::scanIndex(const RecordFile& rf, BTreeIndex& index, int attr, const Predicate& pred,
+	int lo, int hi, bool indexOnly, const SelOrder& order, int limit, ResultSink::Format format,
+	string& out, int& count)
+{
+	RC rc = 0;
+	int start = count;
+	int key;
+	RecordId rid;
+	bool keepOrder = (order.attr == 1);
+	bool backward = keepOrder && order.desc;
 
-			if (listIndex < NElist.size()) continue;
-			if (condVec.empty() && (attr == 1 || attr == 4))
+	//Qualifying RecordIds are collected in batches and fetched
+	//from the table in page order. A batch is never larger than the
+	//rows the LIMIT still needs, so no tuple past it is fetched.
+	//Every key range of the conditions in [lo, hi] is scanned from its
+	//own descent of the tree, so the keys between the ranges are skipped.
+	//A descending scan takes the ranges from the last one, starting at its
+	//largest key and following the backward leaf links.
+	IndexCursor cursor;
+	vector<RecordId> rids;
+	int ranges = pred.ranges.size();
+	for (int r = 0; r < ranges && count - start + (int)rids.size() < limit; r++)
+	{
+		const Predicate::KeyRange& range = pred.ranges[backward ? ranges - 1 - r : r];
+		int rlo = max(range.lo, lo);
+		int rhi = min(range.hi, hi);
+		if (rlo > rhi) continue;
+		if (backward) index.locateLast(rhi, cursor);
+		else index.locate(rlo, cursor);
+		while (count - start + (int)rids.size() < limit
+			&& (backward ? (index.readBackward(cursor, key, rid) == 0 && key >= rlo)
+			: (index.readForward(cursor, key, rid) == 0 && key <= rhi)))
+		{
+			if (indexOnly)
 			{
 				count++;
-				if (attr == 1) fprintf(stdout, "%d\n", key);
+				ResultSink::appendRow(out, format, attr, key, "");
+				continue;
 			}
-			else
+			rids.push_back(rid);
+			if (rids.size() >= HEAP_FETCH_BATCH || count - start + (int)rids.size() >= limit)
 			{
-				if ((rc = rf.read(rid, key, value)) < 0)
-				{
-					fprintf(stderr, "Error: cannot read a tuple from table %s\n", table.c_str());
-					rf.close();
-					return rc;
-				}
-				if (checkKeyValue(key, value, condVec))
-				{
-					// the condition is met for the tuple. 
-					// increase matching tuple counter
-					count++;
-
-					// print the tuple
-					switch (attr)
-					{
-					case 1:  // SELECT key
-						fprintf(stdout, "%d\n", key);
-						break;
-					case 2:  // SELECT value
-						fprintf(stdout, "%s\n", value.c_str());
-						break;
-					case 3:  // SELECT *
-						fprintf(stdout, "%d '%s'\n", key, value.c_str());
-						break;
-					}
-				}
+				if ((rc = fetchTuples(rf, rids, keepOrder, attr, pred, format, out, count)) < 0) return rc;
+				rids.clear();
 			}
 		}
-		
-		// print matching tuple count if "select count(*)"
-		if (attr == 4)
+	}
+	if (!rids.empty()) rc = fetchTuples(rf, rids, keepOrder, attr, pred, format, out, count);
+	return rc;
+}
+
+RC SqlEngine::fetchTuples(const RecordFile& rf, vector<RecordId>& rids, bool keepOrder,
+	int attr, const Predicate& pred, ResultSink::Format format, string& out, int& count)
+{
+	RC rc;
+	int key;
+	string value;
+
+	//Sort the RecordIds by page, remembering their position in the batch,
+	//and drop the duplicates so that every page is read once in file order
+	vector<pair<RecordId, int> > order(rids.size());
+	for (unsigned int i = 0; i < rids.size(); i++)
+		order[i] = make_pair(rids[i], i);
+	sort(order.begin(), order.end(), ridLess);
+
+	vector<pair<int, pair<int, string> > > tuples;
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		if (i > 0 && order[i].first == order[i - 1].first) continue;
+		if ((rc = rf.read(order[i].first, key, value)) < 0) return rc;
+		if (!pred.matchValue(key, value.c_str())) continue;
+		if (keepOrder)
+			tuples.push_back(make_pair(order[i].second, make_pair(key, value)));
+		else
 		{
-			fprintf(stdout, "%d\n", count);
+			count++;
+			ResultSink::appendRow(out, format, attr, key, value.c_str());
 		}
-		rf.close();
+	}
+
+	//Put the tuples back in the order of the index if the query needs it
+	sort(tuples.begin(), tuples.end());
+	for (unsigned int i = 0; i < tuples.size(); i++)
+	{
+		count++;
+		ResultSink::appendRow(out, format, attr, tuples[i].second.first, tuples[i].second.second.c_str());
+	}
+	return 0;
+}
+
+SqlEngine::ScanType SqlEngine::chooseScan(TableHandle& t, const Predicate& pred, bool indexOnly, bool countOnly)
+{
+	//Counting a range takes two descents of the tree, whatever its size
+	if (countOnly) return INDEX_COUNT;
+
+	const RecordId& erid = t.rf.endRid();
+	double pages = erid.pid + (erid.sid > 0 ? 1 : 0);
+	double rows = estimateRows(t, pred);
+	if (indexScanCost(t, rows, pred.ranges.size(), indexOnly) > pages) return TABLE_SCAN;
+	return indexOnly ? INDEX_ONLY_SCAN : INDEX_SCAN;
+}
+
+double SqlEngine::estimateRows(const TableHandle& t, const Predicate& pred)
+{
+	const TableStats& stats = t.stats;
+	const RecordId& erid = t.rf.endRid();
+	double total = (double)erid.pid * RecordFile::RECORDS_PER_PAGE + erid.sid;
+	double rows = 0;
+
+	//Estimate the number of index entries in the key ranges.
+	//Without statistics, fall back on fixed selectivities.
+	bool known = t.hasStats;
+	if (!known && !pred.keyRange) return total;
+	for (unsigned i = 0; i < pred.ranges.size(); i++)
+	{
+		const Predicate::KeyRange& r = pred.ranges[i];
+		if (known) rows += stats.estimateRange(r.lo, r.hi);
+		else rows += (r.lo == r.hi) ? 1 : total * DEFAULT_RANGE_SELECTIVITY;
+	}
+	return min(rows, known ? (double)stats.rowCount : total);
+}
+
+double SqlEngine::indexScanCost(TableHandle& t, double rows, int ranges, bool indexOnly)
+{
+	const RecordId& erid = t.rf.endRid();
+	double pages = erid.pid + (erid.sid > 0 ? 1 : 0);
+
+	//How many entries a leaf holds depends on how well they compress.
+	//Leaves make up nearly all pages of the index, so take the average.
+	int entries = Catalog::entryCount(t);
+	double leafEntries = BTLeafNode::MAX_KEY_NUMBER;
+	if (entries > 0)
+		leafEntries = entries / (double)max(t.index.getPageCount() - 1, 1);
+
+	//An index scan descends the tree once per range and reads the leaves in it.
+	//The tuples are then fetched in page order, so each table page holding
+	//one of them costs a random read (estimated with Cardenas' formula).
+	double indexCost = (double)t.index.getTreeHeight() * ranges + rows / leafEntries + 1;
+	if (indexOnly) return indexCost;
+	double heapPages = (pages > 0) ? pages * (1 - pow(1 - 1 / pages, rows)) : 0;
+	return indexCost + heapPages * RANDOM_PAGE_COST;
+}
+
+RC SqlEngine::analyze(const string& table)
+{
+	RecordFile rf;
+	RecordId   rid;
+	TableStats stats;
+	vector<int> keys;
+
+	RC     rc;
+	int    key;
+	string value;
+
+	if ((rc = rf.open(table + ".tbl", 'r')) < 0)
+	{
+		fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
 		return rc;
 	}
-	else
-		return oldSelectFunction(attr, table, cond);
+
+	//Collect every key of the table
+	for (rid.pid = rid.sid = 0; rid < rf.endRid(); ++rid)
+	{
+		if ((rc = rf.read(rid, key, value)) < 0)
+		{
+			fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+			rf.close();
+			return rc;
+		}
+		keys.push_back(key);
+	}
+	stats.build(keys, rf.endRid().pid + (rf.endRid().sid > 0 ? 1 : 0));
+	rf.close();
+
+	//The queries plan with the new statistics from now on
+	Catalog::invalidate(table);
+	if ((rc = stats.save(table)) < 0)
+		fprintf(stderr, "Error: cannot write the statistics of table %s\n", table.c_str());
+	return rc;
 }
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+RC SqlEngine::load(const string& table, const string& loadfile, bool index, bool buffered)
 {
 	/* your code here */
+	RC rc;
+
+	//The queries must not go on with the old files of the table
+	Catalog::invalidate(table);
+
 	//Open the table file
 	RecordFile newRF;
 	string curTable = table + ".tbl";
@@ -208,257 +1457,324 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
 		return RC_FILE_OPEN_FAILED;
 	}
 
-	//Open the loadfile
-	ifstream loadFile(loadfile.c_str());
-	if (!loadFile.is_open())
+	//Map the loadfile into memory
+	LoadFile loadFile;
+	if (loadFile.open(loadfile))
 	{
 		fprintf(stderr, "Error: file %s doesn't exist or cannot open\n", loadfile.c_str());
 		return RC_FILE_OPEN_FAILED;
 	}
 
 	BTreeIndex indexTree;
-	if (index && indexTree.open(curIndex, 'w'))
+	BufferedBTreeIndex bufferedTree;
+	if (index && (buffered ? bufferedTree.open(curIndex, 'w') : indexTree.open(curIndex, 'w')))
 	{
 		fprintf(stderr, "Error: file %s doesn't exist or cannot be created\n", table.c_str());
 		return RC_FILE_OPEN_FAILED;
 	}
 
-	//If the loadfile exist, read the data and append them in the new table file
-	int key;
-	string value;
-	string nextLine;
-	RecordId rId = newRF.endRid();
-	while (getline(loadFile, nextLine))
+	//Split the loadfile into chunks at line boundaries
+	LoadPipeline pipe;
+	pipe.file = &loadFile;
+	pipe.bounds.push_back(0);
+	for (size_t offset = LOAD_CHUNK_SIZE; offset < loadFile.size(); offset += LOAD_CHUNK_SIZE)
 	{
-		//If use the following code in the while loop body above,
-		//then the answer we get is bigger than the correct answer,
-		//but don't know why
-		//loadFile.good()
+		size_t start = loadFile.lineStart(offset);
+		if (start > pipe.bounds.back() && start < loadFile.size()) pipe.bounds.push_back(start);
+	}
+	pipe.bounds.push_back(loadFile.size());
+	int chunks = pipe.bounds.size() - 1;
+	pipe.chunks.resize(chunks);
+	pipe.sortKeys = index && !buffered;
 
-		//Append the new line
-		//getline(loadFile, nextLine);
-		
-		parseLoadLine(nextLine, key, value);
-		if(newRF.append(key, value, rId))
+	//The chunks are parsed by several threads, appended to the table file
+	//by this thread in order, and their index entries sorted into runs by
+	//the index stage. The parsers stay at most a window of chunks ahead of
+	//the last chunk the index stage, or without it this thread, is done with.
+	int threads = workerCount();
+	initTasks(pipe.parsed, chunks, 2 * threads);
+	initTasks(pipe.written, chunks, chunks);
+	pthread_t indexThread;
+	bool indexStarted = pipe.sortKeys && pthread_create(&indexThread, NULL, buildLoadRuns, &pipe) == 0;
+	if (pipe.sortKeys && !indexStarted) pipe.parsed.window = chunks;
+	vector<pthread_t> ids;
+	int started = startWorkers(ids, threads, parseLoadChunks, &pipe, pipe.parsed);
+
+	vector<int> keys;        // keys of the new tuples for the table statistics
+	bool newTable = (newRF.endRid().pid == 0 && newRF.endRid().sid == 0);
+	const char* lastValue = "";
+	int lastLen = 0;
+	rc = 0;
+	for (int t = 0; t < chunks && rc == 0; t++)
+	{
+		waitTask(pipe.parsed, t);
+		LoadChunk& chunk = pipe.chunks[t];
+		int n = chunk.keys.size();
+		for (int i = 0; i < n && !chunk.values[i]; i++)
 		{
-			fprintf(stderr, "Error: cannot append the key=%d value=%s into file %s \n", 
-				key, value.c_str(), table.c_str());
-			return RC_FILE_WRITE_FAILED;
+			chunk.values[i] = lastValue;
+			chunk.lens[i] = lastLen;
+		}
+		if (n > 0)
+		{
+			lastValue = chunk.values[n - 1];
+			lastLen = chunk.lens[n - 1];
 		}
-		if (index && indexTree.insert(key, rId))
+
+		chunk.first = newRF.endRid();
+		if (n > 0 && newRF.appendBatch(&chunk.keys[0], &chunk.values[0], &chunk.lens[0], n, chunk.first))
+		{
+			fprintf(stderr, "Error: cannot append %d tuples into file %s \n", n, table.c_str());
+			rc = RC_FILE_WRITE_FAILED;
+		}
+		if (rc == 0 && newTable) keys.insert(keys.end(), chunk.keys.begin(), chunk.keys.end());
+		for (int i = 0; rc == 0 && index && buffered && i < n; i++)
+		{
+			if (bufferedTree.insert(chunk.keys[i], chunk.first + i))
+			{
+				fprintf(stderr, "Error: cannot insert key=%d into B+ index tree file %s \n", chunk.keys[i], table.c_str());
+				rc = RC_FILE_WRITE_FAILED;
+			}
+		}
+
+		//From here on the chunk belongs to the index stage, if there is one
+		if (rc < 0) stopTasks(pipe.parsed);
+		finishTask(pipe.written, t, rc);
+		if (!pipe.sortKeys)
+		{
+			chunk = LoadChunk();
+			releaseTask(pipe.parsed, t);
+		}
+	}
+	for (int i = 0; i < started; i++) pthread_join(ids[i], NULL);
+	if (indexStarted) pthread_join(indexThread, NULL);
+	else if (pipe.sortKeys && rc == 0) buildLoadRuns(&pipe);
+	destroyTasks(pipe.parsed);
+	destroyTasks(pipe.written);
+	if (rc < 0)
+	{
+		//The buffered index entries of the tuples written so far are kept
+		if (index && buffered) bufferedTree.close();
+		return rc;
+	}
+
+	//Build the index from the merged runs. an index that has entries
+	//already gets the new ones inserted instead.
+	if (pipe.sortKeys)
+	{
+		mergeRuns(pipe.runs);
+		int n = pipe.runs.empty() ? 0 : pipe.runs[0].size();
+		if (n > 0 && indexTree.build(&pipe.runs[0][0], n))
 		{
-			fprintf(stderr, "Error: cannot append the key=%d value=%s into B+ index tree file %s \n", key, value.c_str(), table.c_str());
+			fprintf(stderr, "Error: cannot insert %d keys into B+ index tree file %s \n", n, table.c_str());
 			return RC_FILE_WRITE_FAILED;
 		}
 	}
+
 	//Close the load file, record file and B+ tree index file.
 	loadFile.close();
+	RecordId erid = newRF.endRid();
 	newRF.close();
-	if (index) indexTree.close();
+	if (index && buffered && bufferedTree.close())
+	{
+		fprintf(stderr, "Error: cannot flush the buffered index entries into file %s \n", curIndex.c_str());
+		return RC_FILE_WRITE_FAILED;
+	}
+	if (index && !buffered) indexTree.close();
+
+	//Gather the statistics from the loaded keys. When the tuples were
+	//appended to an existing table, the whole table has to be analyzed.
+	if (!newTable) return analyze(table);
+	TableStats stats;
+	stats.build(keys, erid.pid + (erid.sid > 0 ? 1 : 0));
+	if (stats.save(table))
+		fprintf(stderr, "Error: cannot write the statistics of table %s\n", table.c_str());
 	return 0;
 }
 
-RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
+RC SqlEngine::createIndex(const string& table)
 {
-	const char* s;
-	char c;
-	string::size_type loc;
+	RC rc;
+	RecordFile rf;
+	BTreeIndex indexTree;
+	string curIndex = table + ".idx";
 
-	// ignore beginning white spaces
-	c = *(s = line.c_str());
-	while (c == ' ' || c == '\t')
+	Catalog::invalidate(table);
+	if ((rc = rf.open(table + ".tbl", 'r')) < 0)
 	{
-		c = *++s;
+		fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+		return rc;
 	}
 
-	// get the integer key value
-	key = atoi(s);
-
-	// look for comma
-	s = strchr(s, ',');
-	if (s == NULL)
+	//Every thread collects and sorts the index entries of a range of pages
+	int pages = rf.endRid().pid + (rf.endRid().sid > 0 ? 1 : 0);
+	int threads = workerCount();
+	if (threads > pages) threads = pages;
+	if (threads < 1) threads = 1;
+	vector<IndexScanTask> scans(threads);
+	vector<pthread_t> ids(threads);
+	vector<bool> started(threads);
+	for (int i = 0; i < threads; i++)
 	{
-		return RC_INVALID_FILE_FORMAT;
+		scans[i].rf = &rf;
+		scans[i].first = (PageId)((long long)pages * i / threads);
+		scans[i].last = (PageId)((long long)pages * (i + 1) / threads);
+		started[i] = startThread(ids[i], scanIndexEntries, &scans[i]);
 	}
-
-	// ignore white spaces
-	do
+	rc = 0;
+	for (int i = 0; i < threads; i++)
 	{
-		c = *++s;
+		if (started[i]) pthread_join(ids[i], NULL);
+		if (scans[i].rc < 0) rc = scans[i].rc;
 	}
-	while (c == ' ' || c == '\t');
-
-	// if there is nothing left, set the value to empty string
-	if (c == 0)
+	rf.close();
+	if (rc < 0)
 	{
-		value.erase();
-		return 0;
+		fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+		return rc;
 	}
 
-	// is the value field delimited by ' or "?
-	if (c == '\'' || c == '"')
-	{
-		s++;
-	}
-	else
-	{
-		c = '\n';
-	}
+	//Merge the sorted runs into one
+	vector<vector<IndexEntry> > runs(threads);
+	for (int i = 0; i < threads; i++) runs[i].swap(scans[i].entries);
+	mergeRuns(runs);
 
-	// get the value string
-	value.assign(s);
-	loc = value.find(c, 0);
-	if (loc != string::npos)
+	//Replace the old index, if any, by a tree built bottom-up from the run
+	unlink(curIndex.c_str());
+	if (indexTree.open(curIndex, 'w'))
 	{
-		value.erase(loc);
+		fprintf(stderr, "Error: file %s doesn't exist or cannot be created\n", curIndex.c_str());
+		return RC_FILE_OPEN_FAILED;
 	}
+	if ((rc = indexTree.build(runs[0].empty() ? NULL : &runs[0][0], runs[0].size())) < 0)
+		fprintf(stderr, "Error: cannot insert %d keys into B+ index tree file %s \n", (int)runs[0].size(), curIndex.c_str());
+	indexTree.close();
+	return rc;
+}
 
-	return 0;
+RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
+{
+	const char* v;
+	int len;
+	RC rc = LoadFile::parseLine(line.data(), line.data() + line.size(), key, v, len);
+	if (rc == 0) value.assign(v, len);
+	return rc;
 }
 
-bool SqlEngine::checkKeyValue(const int key, const std::string& value, const std::vector<SelCond>& cond)
+RC SqlEngine::scanTable(const RecordFile& rf, const Predicate& pred, int attr, RowConsumer* consumer, int& count)
 {
-	int diff = 0;
-	// check the conditions on the tuple
-	for (unsigned i = 0; i < cond.size(); i++)
+	RC rc = 0;
+	TableScan scan;   // the state shared with the scan workers
+	int pages = rf.endRid().pid + (rf.endRid().sid > 0 ? 1 : 0);
+	count = 0;
+
+	// a LIMIT that one morsel can meet is looked for in the first morsel
+	// right here, a page at a time, so that the scan stops at the page
+	// that meets it. the workers are started only if it is not met there
+	PageId first = 0;
+	if (!consumer && attr != 4 && output.rowsWanted() <= TupleBatch::CAPACITY)
 	{
-		// compute the difference between the tuple value and the condition value
-		switch (cond[i].attr)
+		TupleBatch* batch = new TupleBatch;
+		while (first < pages && first < TupleBatch::PAGE_COUNT && !output.full())
 		{
-		case 1:
-			diff = key - atoi(cond[i].value);
-			break;
-		case 2:
-			diff = strcmp(value.c_str(), cond[i].value);
-			break;
+			if ((rc = batch->read(rf, first, 1)) < 0) break;
+			batch->filter(pred);
+			count += batch->selCount;
+			for (int j = 0; j < batch->selCount; j++)
+			{
+				int row = batch->sel[j];
+				output.put(attr, batch->keys[row], batch->values[row]);
+			}
 		}
+		delete batch;
+		if (rc < 0 || output.full() || first >= pages) return rc;
+	}
 
-		// skip the tuple if any condition is not met
-		switch (cond[i].comp)
+	// split the rest of the table into morsels of TupleBatch::PAGE_COUNT
+	// pages, which the workers take one after the other
+	int morsels = (pages - first + TupleBatch::PAGE_COUNT - 1) / TupleBatch::PAGE_COUNT;
+	int threads = workerCount();
+	scan.rf = &rf;
+	scan.pred = &pred;
+	scan.attr = consumer ? 3 : attr;
+	scan.format = consumer ? ResultSink::BINARY : output.getFormat();
+	scan.first = first;
+	scan.results.resize(morsels);
+	// under a LIMIT the workers stay only one morsel ahead each,
+	// so that little is read past the morsel that completes it
+	bool limited = (output.rowsWanted() < INT_MAX && !consumer);
+	initTasks(scan.queue, morsels, limited ? threads : 4 * threads);
+	vector<pthread_t> ids;
+	int started = startWorkers(ids, threads, scanMorsels, &scan, scan.queue);
+
+	// take the results of the morsels in table order, so that the
+	// output does not depend on which worker scanned which morsel
+	for (int m = 0; m < morsels && (rc = waitTask(scan.queue, m)) == 0; m++)
+	{
+		ScanResult& result = scan.results[m];
+		count += result.count;
+		if (consumer) rc = consumer->addRows(result.output.data(), result.output.size());
+		else output.write(result.output.data(), result.output.size());
+		string().swap(result.output);
+		releaseTask(scan.queue, m);
+		if (rc < 0 || output.full())
 		{
-		case SelCond::EQ:
-			if (diff != 0) return false;
-			break;
-		case SelCond::NE:
-			if (diff == 0) return false;
-			break;
-		case SelCond::GT:
-			if (diff <= 0) return false;
-			break;
-		case SelCond::LT:
-			if (diff >= 0) return false;
-			break;
-		case SelCond::GE:
-			if (diff < 0) return false;
-			break;
-		case SelCond::LE:
-			if (diff > 0) return false;
+			stopTasks(scan.queue);
 			break;
 		}
 	}
-	return true;
+	for (int i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+	destroyTasks(scan.queue);
+	return rc;
 }
 
-RC SqlEngine::oldSelectFunction(int attr, const std::string& table, const std::vector<SelCond>& cond)
+RC SqlEngine::oldSelectFunction(int attr, const std::string& table, const RecordFile& rf,
+	const std::vector<SelCond>& cond, const SelOrder& order, const SelLimit& limit)
 {
-	RecordFile rf;   // RecordFile containing the table
-	RecordId   rid;  // record cursor for table scanning
+	Predicate   pred;   // the compiled conditions
 
 	RC     rc;
-	int    key;
-	string value;
 	int    count;
-	int    diff;
 
-	// open the table file
-	if ((rc = rf.open(table + ".tbl", 'r')) < 0)
+	// the matching tuples are sorted for ORDER BY, unless only counted
+	bool sorting = (order.attr != 0 && attr != 4);
+	TupleSorter sorter(order.attr, order.desc);
+
+	pred.compile(cond);
+	int sortOp = -1, scanOp = -1;
+	if (plan.active())
 	{
-		fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
-		return rc;
+		if (sorting) sortOp = plan.add(-1, "Sort", describeSort(order, limit));
+		scanOp = plan.add(sortOp, "Table Scan", describeScan(table, pred, cond, sorting ? NULL : &limit));
 	}
+	if (plan.describeOnly()) return 0;
 
-	// scan the table file from the beginning
-	rid.pid = rid.sid = 0;
-	count = 0;
-	while (rid < rf.endRid())
+	plan.start(sortOp);
+	plan.start(scanOp);
+	rc = scanTable(rf, pred, attr, sorting ? &sorter : NULL, count);
+	plan.stop(scanOp);
+	plan.setRows(scanOp, -1, count);
+	if (rc < 0)
 	{
-		// read the tuple
-		if ((rc = rf.read(rid, key, value)) < 0)
-		{
-			fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-			goto exit_select;
-		}
-
-		// check the conditions on the tuple
-		for (unsigned i = 0; i < cond.size(); i++)
-		{
-			// compute the difference between the tuple value and the condition value
-			switch (cond[i].attr)
-			{
-			case 1:
-				diff = key - atoi(cond[i].value);
-				break;
-			case 2:
-				diff = strcmp(value.c_str(), cond[i].value);
-				break;
-			}
-
-			// skip the tuple if any condition is not met
-			switch (cond[i].comp)
-			{
-			case SelCond::EQ:
-				if (diff != 0) goto next_tuple;
-				break;
-			case SelCond::NE:
-				if (diff == 0) goto next_tuple;
-				break;
-			case SelCond::GT:
-				if (diff <= 0) goto next_tuple;
-				break;
-			case SelCond::LT:
-				if (diff >= 0) goto next_tuple;
-				break;
-			case SelCond::GE:
-				if (diff < 0) goto next_tuple;
-				break;
-			case SelCond::LE:
-				if (diff > 0) goto next_tuple;
-				break;
-			}
-		}
-
-		// the condition is met for the tuple. 
-		// increase matching tuple counter
-		count++;
+		fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+		return rc;
+	}
 
-		// print the tuple 
-		switch (attr)
-		{
-		case 1:  // SELECT key
-			fprintf(stdout, "%d\n", key);
-			break;
-		case 2:  // SELECT value
-			fprintf(stdout, "%s\n", value.c_str());
-			break;
-		case 3:  // SELECT *
-			fprintf(stdout, "%d '%s'\n", key, value.c_str());
-			break;
-		}
-		
-	// move to the next tuple
-	next_tuple:
-		++rid;
+	// print the sorted tuples for ORDER BY
+	rc = sorting ? sorter.output(output, attr) : 0;
+	plan.stop(sortOp);
+	plan.setRows(sortOp, count, -1);
+	if (rc < 0)
+	{
+		fprintf(stderr, "Error: cannot sort the tuples of table %s\n", table.c_str());
+		return rc;
 	}
 
 	// print matching tuple count if "select count(*)"
 	if (attr == 4)
 	{
-		fprintf(stdout, "%d\n", count);
+		output.putCount(count);
 	}
-	rc = 0;
-
-// close the table file and return
-exit_select:
-	rf.close();
-	return rc;
+	return 0;
 }
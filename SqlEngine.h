@@ -10,10 +10,19 @@
 #ifndef SQLENGINE_H
 #define SQLENGINE_H
 
+#include <string>
 #include <vector>
 #include "Bruinbase.h"
 #include "BTreeIndex.h"
+#include "Catalog.h"
 #include "RecordFile.h"
+#include "ResultSink.h"
+
+class Predicate;
+class QueryPlan;
+class RowConsumer;
+struct AggregateState;
+struct JoinTable;
 
 /**
  * data structure to represent a condition in the WHERE clause
@@ -21,9 +30,83 @@
 struct SelCond {
   int attr;     // attribute: 1 - key column,  2 - value column
   enum Comparator { EQ, NE, LT, GT, LE, GE } comp;
-  char* value;  // the value to compare
+  char* value;  // the value to compare. NULL for a parameter until it is bound
+  int disjunct; // the conditions of a disjunct are ANDed, and the disjuncts ORed
+  int param;    // the number of the parameter "?" compared with, from 1. 0 for a value
+};
+
+/**
+ * data structure to represent the ORDER BY clause
+ */
+struct SelOrder {
+  int attr;     // attribute: 0 - no ORDER BY, 1 - key column, 2 - value column
+  bool desc;    // true if DESC was specified
+};
+
+/**
+ * data structure to represent an item of the SELECT clause
+ */
+struct SelAggregate {
+  enum Function { NONE, COUNT, MIN, MAX, SUM, AVG } func;  // NONE for a plain column
+  int attr;     // attribute: 1 - key column, 2 - value column, 3 - *. 0 for COUNT(*)
+  char* table;  // the table of a column written as "table.attr". NULL if unqualified
+};
+
+/**
+ * data structure to represent a column in the WHERE clause of a join
+ */
+struct SelColumn {
+  char* table;  // the table of the column. NULL if unqualified
+  int attr;     // attribute: 1 - key column,  2 - value column
+};
+
+/**
+ * data structure to represent a condition in the WHERE clause of a join.
+ * a column is compared either with a value or with another column.
+ */
+struct SelJoinCond {
+  SelColumn column;
+  SelCond::Comparator comp;
+  char* value;      // the value to compare. NULL if compared with other or a parameter
+  int param;        // the number of the parameter "?" compared with, from 1. 0 otherwise
+  SelColumn other;  // the column to compare with if value is NULL and param is 0
 };
 
+/**
+ * data structure to represent the LIMIT clause
+ */
+struct SelLimit {
+  int count;    // the most rows to return. -1 if there is no LIMIT
+  int offset;   // # rows to skip before the first one returned
+};
+
+/**
+ * data structure to represent a SELECT statement, on one table or a join of two
+ */
+struct SelStatement {
+  std::vector<SelAggregate> items;     // the items of the SELECT clause
+  std::string table;                   // the table in the FROM clause. the left table of a join
+  std::string right;                   // the right table of a join. empty for one table
+  std::vector<SelCond> conds;          // the WHERE clause on one table
+  std::vector<SelJoinCond> joinConds;  // the WHERE clause of a join
+  int group;                           // the attribute in the GROUP BY clause. 0 if there is none
+  SelOrder order;
+  SelLimit limit;
+  int params;                          // # parameters "?" in the WHERE clause
+};
+
+/**
+ * copy a SELECT statement with its strings.
+ * @return the copy. free it with freeStatement()
+ */
+SelStatement* copyStatement(const SelStatement& stmt);
+
+/**
+ * free the strings of a SELECT statement and the statement itself.
+ * @param stmt[IN] a statement of the parser or of copyStatement()
+ */
+void freeStatement(SelStatement* stmt);
+
 /**
  * the class that takes, parses, and executes the user commands.
  */
@@ -39,26 +122,146 @@ class SqlEngine {
    */
   static RC run(FILE* commandline);
 
+  /**
+   * executes a SELECT statement of the command line. a statement with
+   * aggregates or GROUP BY goes to aggregate(), one on two tables to join(),
+   * and any other to select().
+   * @param stmt[IN] the statement. it must not have parameters
+   * @return error code. 0 if no error
+   */
+  static RC query(const SelStatement& stmt);
+
+  /**
+   * print the plan of a SELECT statement instead of its rows: the operators
+   * with the scans they chose, their key ranges and residual conditions.
+   * with analyze the statement runs and every operator also shows its
+   * time, rows and page reads, cache hits and writes (see QueryPlan).
+   * @param stmt[IN] the statement. it must not have parameters
+   * @param analyze[IN] true for EXPLAIN ANALYZE
+   * @return error code. 0 if no error
+   */
+  static RC explain(const SelStatement& stmt, bool analyze);
+
+  /**
+   * store a SELECT statement under a name for EXECUTE, replacing any
+   * statement of that name. the statement is kept parsed, so EXECUTE only
+   * binds its parameters and runs it on the tables of the Catalog.
+   * @param name[IN] the name in the PREPARE command
+   * @param stmt[IN] the statement. it is copied
+   * @return error code. 0 if no error
+   */
+  static RC prepare(const std::string& name, const SelStatement& stmt);
+
+  /**
+   * execute a prepared statement with its parameters bound to values.
+   * @param name[IN] the name in the EXECUTE command
+   * @param params[IN] the value of every parameter, in the order of the "?"s
+   * @return error code. 0 if no error
+   */
+  static RC execute(const std::string& name, const std::vector<char*>& params);
+
   /**
    * executes a SELECT statement.
-   * all conditions in conds must be ANDed together.
-   * the result of the SELECT is printed on screen.
+   * the conditions in conds are ANDed within a disjunct (SelCond::disjunct),
+   * and the disjuncts are ORed.
+   * the result of the SELECT is written to the session output
+   * in the format chosen with setOutputFormat().
    * @param attr[IN] attribute in the SELECT clause
    * (1: key, 2: value, 3: *, 4: count(*))
    * @param table[IN] the table name in the FROM clause
    * @param conds[IN] list of conditions in the WHERE clause
+   * @param order[IN] the ORDER BY clause
+   * @param limit[IN] the LIMIT clause. the scans stop as soon as
+   *                  enough rows have been returned
+   * @return error code. 0 if no error
+   */
+  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds,
+                   const SelOrder& order, const SelLimit& limit);
+
+  /**
+   * executes a SELECT statement with aggregates or GROUP BY value.
+   * MIN, MAX, SUM and AVG take the key column. Without GROUP BY the query
+   * returns one row, and COUNT(*), MIN(key) and MAX(key) are answered from
+   * the index alone when there is no value condition. With GROUP BY value
+   * the tuples are aggregated in a HashAggregate and one row is returned
+   * per value, in no particular order.
+   * @param items[IN] the items of the SELECT clause
+   * @param table[IN] the table name in the FROM clause
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @param group[IN] the attribute in the GROUP BY clause. 0 if there is none
+   * @param limit[IN] the LIMIT clause
    * @return error code. 0 if no error
    */
-  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
+  static RC aggregate(const std::vector<SelAggregate>& items, const std::string& table,
+                      const std::vector<SelCond>& conds, int group, const SelLimit& limit);
+
+  /**
+   * executes a SELECT statement over two tables joined on their keys.
+   * the WHERE clause must hold "left.key = right.key"; its other conditions
+   * compare a column with a value and are checked on the table of the
+   * column before the join (an unqualified key on both tables). The join
+   * is evaluated by an index nested-loop join, a hash join or a merge join
+   * of the two indexes, whichever chooseJoin() estimates to be cheapest.
+   * the rows come in no particular order.
+   * @param items[IN] the items of the SELECT clause: columns, * or COUNT(*)
+   * @param left[IN] the first table in the FROM clause
+   * @param right[IN] the second table in the FROM clause
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @param limit[IN] the LIMIT clause
+   * @return error code. 0 if no error
+   */
+  static RC join(const std::vector<SelAggregate>& items, const std::string& left, const std::string& right,
+                 const std::vector<SelJoinCond>& conds, const SelLimit& limit);
+
+  /**
+   * choose the format of the rows SELECT returns for the rest of the session.
+   * in BINARY format rows are length-prefixed (see ResultSink) and no
+   * prompt is printed, so that stdout carries nothing but the rows.
+   * @param format[IN] ResultSink::TEXT or ResultSink::BINARY
+   */
+  static void setOutputFormat(ResultSink::Format format);
+
+  /**
+   * @return the format of the rows SELECT returns
+   */
+  static ResultSink::Format getOutputFormat();
+
+  /**
+   * write the buffered rows of the session output to stdout.
+   * @return error code. 0 if no error
+   */
+  static RC flushOutput();
+
+  /**
+   * gather the statistics of a table (# tuples, key range and key
+   * histogram) and store them in the ".stat" file of the table.
+   * SqlEngine::select() uses them to choose between the index and a table scan.
+   * @param table[IN] the table name in the ANALYZE command
+   * @return error code. 0 if no error
+   */
+  static RC analyze(const std::string& table);
 
   /**
    * load a table from a load file.
    * @param table[IN] the table name in the LOAD command
    * @param loadfile[IN] the file name of the load file
    * @param index[IN] true if "WITH INDEX" option was specified
+   * @param buffered[IN] true if "WITH BUFFERED INDEX" was specified.
+   * the index is then built through the buffers of a BufferedBTreeIndex
+   * @return error code. 0 if no error
+   */
+  static RC load(const std::string& table, const std::string& loadfile, bool index, bool buffered);
+
+  /**
+   * build the index of a table from the tuples already in its table file.
+   * the pages of the table are split among as many threads as there are
+   * processors. every thread sorts the index entries of its pages, the
+   * sorted runs are merged in parallel and the tree is built bottom-up.
+   * an existing index of the table is replaced.
+   * @param table[IN] the table name in the CREATE INDEX command
    * @return error code. 0 if no error
    */
-  static RC load(const std::string& table, const std::string& loadfile, bool index);
+  static RC createIndex(const std::string& table);
 
   /**
    * parse a line from the load file into the (key, value) pair.
@@ -71,18 +274,222 @@ class SqlEngine {
 
 private:
 	/**
-	* A part of the old SqlEngine::select function code,
-	* which is used to check the conditions on the tuple 
-	* and skip the tuple if any condition is not met
-	* @return a boolean type to show whether the tuple meet any conditions. true if meet, otherwise false
+	* the # bytes of the load file in a chunk, the unit of work
+	* that the threads of LOAD parse and write
+	*/
+	static const unsigned LOAD_CHUNK_SIZE = 1024 * 1024;
+
+	/**
+	* the number of RecordIds an index scan collects before it
+	* fetches the tuples from the table in page order
+	*/
+	static const unsigned HEAP_FETCH_BATCH = 4096;
+
+	/**
+	* the number of index entries in one partition of a parallel index scan
+	*/
+	static const int INDEX_PARTITION_SIZE = 16384;
+
+	/**
+	* Look up a table in the Catalog, which opens it on first use.
+	* @param t[OUT] the handle of the table
+	* @return error code. 0 if no error
+	*/
+	static RC openTable(const std::string& table, TableHandle*& t);
+
+	/**
+	* executes a SELECT statement with its parameters bound.
+	* @return error code. 0 if no error
+	*/
+	static RC runQuery(const SelStatement& stmt);
+
+	/**
+	* select() on the open files of a table.
+	*/
+	static RC selectTable(int attr, TableHandle& t, const std::vector<SelCond>& conds,
+		const SelOrder& order, const SelLimit& limit);
+
+	/**
+	* aggregate() on the open files of a table.
+	*/
+	static RC aggregateTable(const std::vector<SelAggregate>& items, TableHandle& t,
+		const std::vector<SelCond>& conds, int group, const SelLimit& limit);
+
+	/**
+	* Scan the index entries in the key ranges of pred in parallel and print
+	* the tuples that meet the conditions. The span of the ranges is cut into
+	* partitions at separator keys of the tree (BTreeIndex::splitRange()),
+	* which worker threads scan with scanIndex() and their own BTreeIndex.
+	* The partitions are printed in key order, so the output is the same as
+	* that of one scan over the whole range; COUNT(*) only adds up their counts.
+	* A range that is not split, such as a point lookup or a short range,
+	* and a LIMIT that one partition can satisfy are scanned in this thread
+	* instead, reading only the leaves and pages the rows need.
+	* @param table[IN] the table name. the workers open table + ".idx"
+	* @param consumer[IN] if not NULL, the tuples are handed to it instead of printed
+	* @param count[IN/OUT] incremented for every tuple that meets the conditions
+	* @return error code. 0 if no error
+	*/
+	static RC scanIndexParallel(const std::string& table, const RecordFile& rf, BTreeIndex& index, int attr,
+		const Predicate& pred, bool indexOnly, const SelOrder& order, RowConsumer* consumer, int& count);
+
+	/**
+	* the worker of scanIndexParallel(). arg is the state of the scan.
+	*/
+	static void* scanPartitions(void* arg);
+
+	/**
+	* Scan the index entries in the key ranges of pred within [lo, hi] and
+	* append the tuples that meet the conditions to out.
+	* The scan stops once limit tuples have been appended.
+	* @param lo[IN] the smallest key to scan. at least pred.keyMin
+	* @param hi[IN] the largest key to scan. at most pred.keyMax
+	* @param indexOnly[IN] true if the query is answered from the index entries alone
+	* @param order[IN] if order.attr is 1, output the tuples in key order,
+	*                  scanning the leaves backward for DESC
+	* @param limit[IN] the most tuples to append
+	* @param format[IN] the format of the rows appended to out
+	* @param out[IN/OUT] the printed tuples are appended to it
+	* @param count[IN/OUT] incremented for every tuple that meets the conditions
+	* @return error code. 0 if no error
+	*/
+	static RC scanIndex(const RecordFile& rf, BTreeIndex& index, int attr, const Predicate& pred,
+		int lo, int hi, bool indexOnly, const SelOrder& order, int limit, ResultSink::Format format,
+		std::string& out, int& count);
+
+	/**
+	* Fetch the tuples of a batch of RecordIds from the table.
+	* The RecordIds are sorted by page and deduplicated first, so that every
+	* page is read once and in file order. Tuples that meet the conditions
+	* are appended to out in page order, or in the order of rids if keepOrder is set.
+	* @param rids[IN] the RecordIds to fetch
+	* @param keepOrder[IN] true if the tuples must be output in the order of rids
+	* @param attr[IN] attribute in the SELECT clause
+	* @param pred[IN] the conditions to check on each tuple. the index scan
+	*                 has checked the key conditions already
+	* @param format[IN] the format of the rows appended to out
+	* @param out[IN/OUT] the printed tuples are appended to it
+	* @param count[IN/OUT] incremented for every tuple that meets the conditions
+	* @return error code. 0 if no error
+	*/
+	static RC fetchTuples(const RecordFile& rf, std::vector<RecordId>& rids, bool keepOrder,
+		int attr, const Predicate& pred, ResultSink::Format format, std::string& out, int& count);
+
+	/**
+	* the session output all SELECT rows go through
+	*/
+	static ResultSink output;
+
+	/**
+	* the plan EXPLAIN describes. the operators add themselves to it while it is active
+	*/
+	static QueryPlan plan;
+
+	/**
+	* the ways SqlEngine::select() can evaluate a query
+	*/
+	enum ScanType {
+		TABLE_SCAN,      // read the whole table file sequentially
+		INDEX_SCAN,      // read the key range from the index and fetch each tuple
+		INDEX_ONLY_SCAN, // answer the query from the index entries alone
+		INDEX_COUNT      // answer COUNT(*) from the entry counts of the tree
+	};
+
+	/**
+	* Estimate the page reads of every way to evaluate a query on an
+	* indexed table from the table statistics and pick the cheapest.
+	* @param pred[IN] the conditions of the query
+	* @param indexOnly[IN] true if the query can be answered from the index entries
+	* @param countOnly[IN] true if the query only counts the index entries in the ranges
+	* @return the chosen ScanType
+	*/
+	static ScanType chooseScan(TableHandle& t, const Predicate& pred, bool indexOnly, bool countOnly);
+
+	/**
+	* Estimate the number of tuples with keys in the key ranges of pred from
+	* the table statistics, or from fixed selectivities if there are none.
+	* @return the estimated number of tuples
+	*/
+	static double estimateRows(const TableHandle& t, const Predicate& pred);
+
+	/**
+	* Estimate the page reads of an index scan, in units of a page read by a table scan.
+	* @param rows[IN] the estimated number of index entries in the ranges
+	* @param ranges[IN] # key ranges, each of which takes a descent of the tree
+	* @param indexOnly[IN] true if the tuples are not fetched from the table
+	* @return the estimated cost
+	*/
+	static double indexScanCost(TableHandle& t, double rows, int ranges, bool indexOnly);
+
+	/**
+	* the ways SqlEngine::join() can join two tables
+	*/
+	enum JoinType {
+		NESTED_LOOP_JOIN, // scan the outer table and look up its keys in the index of the other
+		HASH_JOIN,        // hash the table with fewer tuples and probe it with the other
+		MERGE_JOIN        // read the indexes of both tables side by side in key order
+	};
+
+	/**
+	* Estimate the page reads of every way to join two tables from their
+	* estimated tuples (JoinTable::rows) and pick the cheapest. A nested
+	* loop join needs an index on the inner table and a merge join on both.
+	* @param tables[IN] the left and the right table
+	* @param outer[OUT] the outer table of a nested loop join, or the probe
+	*                   input of a hash join: 0 - left, 1 - right
+	* @return the chosen JoinType
+	*/
+	static JoinType chooseJoin(JoinTable* tables, int& outer);
+
+	/**
+	* Scan the tuples of a table of a join that meet its conditions and
+	* hand them to a consumer, through the index if chooseScan() prefers it.
+	* The values are left out if the join does not need them.
+	* @param conds[IN] the conditions of the table, which EXPLAIN prints
+	* @param parent[IN] the join operator of the plan. -1 without EXPLAIN
+	* @return error code. 0 if no error
+	*/
+	static RC scanJoinInput(JoinTable& table, const std::vector<SelCond>& conds, RowConsumer* consumer, int parent);
+
+	/**
+	* Answer COUNT(*), MIN(key) and MAX(key) over the key conditions of pred
+	* from the index: the count from the entry counts of the tree, MIN and
+	* MAX from the first and the last entry in the range.
+	* @param state[OUT] count, min and max are set. sum is not
+	* @return error code. 0 if no error
+	*/
+	static RC readEndpoints(BTreeIndex& index, const Predicate& pred, AggregateState& state);
+
+	/**
+	* Count the index entries in the key ranges of pred from the entry counts of the tree.
+	* @param count[OUT] # entries
+	* @return error code. 0 if no error
+	*/
+	static RC countRanges(BTreeIndex& index, const Predicate& pred, int& count);
+
+	/**
+	* Scan the whole table and print the tuples that meet the conditions.
+	* The table is split into morsels of TupleBatch::PAGE_COUNT pages, which
+	* one worker thread per processor scans and filters in parallel. Their
+	* results are merged in table order, so the output is the same as that
+	* of a sequential scan. The scan stops at the morsel that completes a LIMIT.
+	* A LIMIT that one morsel can meet is first looked for in the first
+	* morsel by this thread alone, checking it after every page.
+	* @param consumer[IN] if not NULL, the tuples are handed to it instead of printed
+	* @param count[OUT] # tuples that meet the conditions
+	* @return error code. 0 if no error
 	*/
-	static bool checkKeyValue(const int key, const std::string& value, const std::vector<SelCond>& cond);
+	static RC scanTable(const RecordFile& rf, const Predicate& pred, int attr, RowConsumer* consumer, int& count);
 
 	/**
 	* The copy of old SqlEngine::select function code,
 	* the function will be called when the B+ tree cannot open the table file.
+	* It scans the table with scanTable().
+	* With an ORDER BY clause, the matching tuples are sorted by a TupleSorter,
+	* which spills them to temporary files when they do not fit in memory.
 	*/
-	static RC oldSelectFunction(int attr, const std::string& table, const std::vector<SelCond>& conds);
+	static RC oldSelectFunction(int attr, const std::string& table, const RecordFile& rf,
+		const std::vector<SelCond>& conds, const SelOrder& order, const SelLimit& limit);
 };
 
 #endif /* SQLENGINE_H */
@@ -1,7 +1,8 @@
 %{
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <sys/times.h>
+#include <time.h>
 #include <unistd.h>
 #include <climits>
 #include <string>
@@ -11,41 +12,138 @@
 
 int  sqllex(void);  
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
+
+// a WHERE clause as an OR of disjuncts, each of which ANDs its conditions
+typedef std::vector<std::vector<SelCond> > Disjuncts;
+
+// the most disjuncts "AND" may multiply a WHERE clause into
+static const unsigned MAX_DISJUNCTS = 100000;
+
+static void freeDisjuncts(Disjuncts* d)
+{
+  for (unsigned i = 0; i < d->size(); i++)
+    for (unsigned j = 0; j < (*d)[i].size(); j++) free((*d)[i][j].value);
+  delete d;
+}
+
+// AND two WHERE clauses: every disjunct of a is ANDed with every disjunct of b.
+// a and b are freed. NULL if there would be more than MAX_DISJUNCTS disjuncts
+static Disjuncts* andDisjuncts(Disjuncts* a, Disjuncts* b)
+{
+  Disjuncts* d = NULL;
+  if ((double)a->size() * b->size() <= MAX_DISJUNCTS) {
+    d = new Disjuncts;
+    for (unsigned i = 0; i < a->size(); i++) {
+      for (unsigned j = 0; j < b->size(); j++) {
+        std::vector<SelCond> conj = (*a)[i];
+        conj.insert(conj.end(), (*b)[j].begin(), (*b)[j].end());
+        for (unsigned k = 0; k < conj.size(); k++)
+          if (conj[k].value) conj[k].value = strdup(conj[k].value);
+        d->push_back(conj);
+      }
+    }
+  }
+  freeDisjuncts(a);
+  freeDisjuncts(b);
+  return d;
+}
+
+// number the disjuncts of a WHERE clause and list their conditions in conds.
+// the values now belong to conds
+static void flattenDisjuncts(Disjuncts* d, std::vector<SelCond>& conds)
+{
+  for (unsigned i = 0; i < d->size(); i++) {
+    for (unsigned j = 0; j < (*d)[i].size(); j++) {
+      conds.push_back((*d)[i][j]);
+      conds.back().disjunct = i;
+    }
+  }
+  delete d;
+}
 extern "C" { int  sqlwrap() { return 1; } }
 
-static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
+// print the prompt, unless the rows are output in binary
+static void prompt()
 {
-  struct tms tmsbuf;
-  clock_t btime, etime;
+  if (SqlEngine::getOutputFormat() == ResultSink::TEXT) fprintf(stdout, "Bruinbase> ");
+}
+
+// how runSelect() runs a SELECT statement
+enum SelectMode { RUN_SELECT, EXPLAIN_SELECT, EXPLAIN_ANALYZE_SELECT };
+
+// the time of the monotonic clock in seconds
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// run a SELECT statement, or the prepared statement name with params if
+// stmt is NULL, and report the time it took and the pages it read
+static void runSelect(const SelStatement* stmt, const char* name, const std::vector<char*>& params,
+  SelectMode mode)
+{
+  double  btime, etime;
   int     bpagecnt, epagecnt;
 
-  btime = times(&tmsbuf);
+  btime = now();
   bpagecnt = PageFile::getPageReadCount();
-  SqlEngine::select(attr, table, conds);
-  etime = times(&tmsbuf);
+  if (!stmt) SqlEngine::execute(name, params);
+  else if (mode == RUN_SELECT) SqlEngine::query(*stmt);
+  else SqlEngine::explain(*stmt, mode == EXPLAIN_ANALYZE_SELECT);
+  SqlEngine::flushOutput();
+  etime = now();
   epagecnt = PageFile::getPageReadCount();
 
-  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+  fprintf(stderr, "  -- %.6f seconds to run the select command. Read %d pages\n", etime - btime, epagecnt - bpagecnt);
 }
 
+// # parameters "?" of the statement being parsed
+static int paramCount = 0;
+
 %}
 
 %union {
   int integer;
   char* string;
-  SelCond* cond;
-  std::vector<SelCond>* conds;
+  std::vector<std::vector<SelCond> >* disjuncts;
+  SelCond cond;
+  std::vector<SelCond>* values;
+  SelOrder order;
+  SelLimit limit;
+  SelAggregate item;
+  std::vector<SelAggregate>* items;
+  SelColumn column;
+  SelJoinCond* joinCond;
+  std::vector<SelJoinCond>* joinConds;
+  SelStatement* statement;
 }
 
-%token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT AND OR 
-%token COMMA STAR LF
+%token SELECT FROM WHERE LOAD WITH INDEX BUFFERED QUIT COUNT AND OR IN ANALYZE
+%token MIN MAX SUM AVG GROUP LPAREN RPAREN
+%token CREATE ON
+%token PREPARE EXECUTE AS PARAM EXPLAIN
+%token SET OUTPUT
+%token LIMIT OFFSET
+%token ORDER BY ASC DESC
+%token COMMA STAR DOT LF
 %token <string> INTEGER STRING ID
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
 
-%type <integer> attributes attribute comparator
-%type <string> table value
-%type <cond> condition
-%type <conds> conditions
+%type <integer> attribute comparator direction function group_clause
+%type <item> select_item
+%type <items> select_list
+%type <column> column
+%type <joinCond> join_condition
+%type <joinConds> join_conditions
+%type <string> table
+%type <cond> value
+%type <disjuncts> where_clause conditions conjunction condition
+%type <values> value_list
+%type <order> order_clause
+%type <limit> limit_clause
+%type <statement> select_statement
 %%
 
 commands:
@@ -54,11 +152,17 @@ commands:
 	;
 
 command:
-        load_command { fprintf(stdout, "Bruinbase> "); }
-	| select_command { fprintf(stdout, "Bruinbase> "); }
+        load_command { prompt(); }
+	| analyze_command { prompt(); }
+	| create_command { prompt(); }
+	| select_command { prompt(); }
+	| prepare_command { prompt(); }
+	| execute_command { prompt(); }
+	| explain_command { prompt(); }
+	| set_command { prompt(); }
 	| quit_command
-	| error LF { fprintf(stdout, "Bruinbase> "); }
-	| LF { fprintf(stdout, "Bruinbase> "); }
+	| error LF { paramCount = 0; prompt(); }
+	| LF { prompt(); }
 	;
 
 quit_command:
@@ -67,61 +171,280 @@ quit_command:
 
 load_command:
 	LOAD table FROM STRING LF { 
-	  SqlEngine::load(std::string($2), std::string($4), false); 
+	  SqlEngine::load(std::string($2), std::string($4), false, false); 
 	  free($2);
 	  free($4);
 	}
 	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	  SqlEngine::load(std::string($2), std::string($4), true, false); 
+	  free($2);
+	  free($4);
+	}
+	| LOAD table FROM STRING WITH BUFFERED INDEX LF { 
+	  SqlEngine::load(std::string($2), std::string($4), true, true); 
 	  free($2);
 	  free($4);
 	}
 	;
 
+analyze_command:
+	ANALYZE table LF {
+	  SqlEngine::analyze(std::string($2));
+	  free($2);
+	}
+	;
+
+create_command:
+	CREATE INDEX ON table LF {
+	  SqlEngine::createIndex(std::string($4));
+	  free($4);
+	}
+	;
+
+set_command:
+	SET OUTPUT ID LF {
+	  if (strcasecmp($3, "text") == 0) SqlEngine::setOutputFormat(ResultSink::TEXT);
+	  else if (strcasecmp($3, "binary") == 0) SqlEngine::setOutputFormat(ResultSink::BINARY);
+	  else sqlerror("wrong output format. neither text or binary");
+	  free($3);
+	}
+	;
+
 select_command:
-	SELECT attributes FROM table LF {
-   	        std::vector<SelCond> conds;
-		runSelect($2, $4, conds);
-		free($4);
+	select_statement LF {
+	  std::vector<char*> params;
+	  runSelect($1, NULL, params, RUN_SELECT);
+	  freeStatement($1);
+	}
+	;
+
+explain_command:
+	EXPLAIN select_statement LF {
+	  std::vector<char*> params;
+	  runSelect($2, NULL, params, EXPLAIN_SELECT);
+	  freeStatement($2);
 	}
-	| SELECT attributes FROM table WHERE conditions LF {
-	        runSelect($2, $4, *$6);
-	  	free($4);
-	  	for (unsigned i = 0; i < $6->size(); i++) {
-		    free((*$6)[i].value);
-		}
-	  	delete $6;
+	| EXPLAIN ANALYZE select_statement LF {
+	  std::vector<char*> params;
+	  runSelect($3, NULL, params, EXPLAIN_ANALYZE_SELECT);
+	  freeStatement($3);
 	}
 	;
 
-conditions:
-	condition {
-	  std::vector<SelCond>* v = new std::vector<SelCond>;
-	  v->push_back(*$1);
-	  $$ = v;
-          delete $1;
+prepare_command:
+	PREPARE ID AS select_statement LF {
+	  SqlEngine::prepare($2, *$4);
+	  free($2);
+	  freeStatement($4);
 	}
-	| conditions AND condition {
-	  $1->push_back(*$3);
+	;
+
+execute_command:
+	EXECUTE ID LF {
+	  std::vector<char*> params;
+	  runSelect(NULL, $2, params, RUN_SELECT);
+	  free($2);
+	}
+	| EXECUTE ID LPAREN value_list RPAREN LF {
+	  std::vector<char*> params;
+	  for (unsigned i = 0; i < $4->size(); i++) params.push_back((*$4)[i].value);
+	  if (paramCount > 0) sqlerror("the parameters of EXECUTE must be values");
+	  else runSelect(NULL, $2, params, RUN_SELECT);
+	  paramCount = 0;
+	  for (unsigned i = 0; i < params.size(); i++) free(params[i]);
+	  delete $4;
+	  free($2);
+	}
+	;
+
+select_statement:
+	SELECT select_list FROM table where_clause group_clause order_clause limit_clause {
+	  $$ = new SelStatement;
+	  $$->items.swap(*$2);
+	  $$->table = $4;
+	  if ($5) flattenDisjuncts($5, $$->conds);
+	  $$->group = $6;
+	  $$->order = $7;
+	  $$->limit = $8;
+	  $$->params = paramCount;
+	  paramCount = 0;
+	  free($4);
+	  delete $2;
+	}
+	| SELECT select_list FROM table COMMA table WHERE join_conditions limit_clause {
+	  $$ = new SelStatement;
+	  $$->items.swap(*$2);
+	  $$->table = $4;
+	  $$->right = $6;
+	  $$->joinConds.swap(*$8);
+	  $$->group = 0;
+	  $$->order.attr = 0;
+	  $$->order.desc = false;
+	  $$->limit = $9;
+	  $$->params = paramCount;
+	  paramCount = 0;
+	  free($4);
+	  free($6);
+	  delete $2;
+	  delete $8;
+	}
+	;
+
+where_clause:
+	WHERE conditions { $$ = $2; }
+	| { $$ = NULL; }
+	;
+
+group_clause:
+	GROUP BY attribute { $$ = $3; }
+	| { $$ = 0; }
+	;
+
+order_clause:
+	ORDER BY attribute direction { $$.attr = $3; $$.desc = $4; }
+	| { $$.attr = 0; $$.desc = false; }
+	;
+
+limit_clause:
+	LIMIT INTEGER {
+	  $$.count = atoi($2);
+	  $$.offset = 0;
+	  free($2);
+	  if ($$.count < 0) { sqlerror("LIMIT must not be negative"); YYERROR; }
+	}
+	| LIMIT INTEGER OFFSET INTEGER {
+	  $$.count = atoi($2);
+	  $$.offset = atoi($4);
+	  free($2);
+	  free($4);
+	  if ($$.count < 0 || $$.offset < 0) { sqlerror("LIMIT and OFFSET must not be negative"); YYERROR; }
+	}
+	| { $$.count = -1; $$.offset = 0; }
+	;
+
+direction:
+	ASC    { $$ = 0; }
+	| DESC { $$ = 1; }
+	|      { $$ = 0; }
+	;
+
+conditions:
+	conjunction { $$ = $1; }
+	| conditions OR conjunction {
+	  $1->insert($1->end(), $3->begin(), $3->end());
 	  $$ = $1;
-          delete $3;
+	  delete $3;
+	}
+	;
+
+conjunction:
+	condition { $$ = $1; }
+	| conjunction AND condition {
+	  $$ = andDisjuncts($1, $3);
+	  if ($$ == NULL) { sqlerror("too many ORed conditions after expanding AND"); YYERROR; }
 	}
 	;
 
 condition:
 	attribute comparator value { 
-	  SelCond* c = new SelCond;
-	  c->attr = $1;
-	  c->comp = static_cast<SelCond::Comparator>($2);
-	  c->value = $3;
-	  $$ = c;
+	  SelCond c;
+	  c.attr = $1;
+	  c.comp = static_cast<SelCond::Comparator>($2);
+	  c.value = $3.value;
+	  c.disjunct = 0;
+	  c.param = $3.param;
+	  $$ = new Disjuncts(1, std::vector<SelCond>(1, c));
         }
+	| attribute IN LPAREN value_list RPAREN {
+	  // one disjunct per value
+	  $$ = new Disjuncts;
+	  for (unsigned i = 0; i < $4->size(); i++) {
+	    SelCond c = (*$4)[i];
+	    c.attr = $1;
+	    c.comp = SelCond::EQ;
+	    $$->push_back(std::vector<SelCond>(1, c));
+	  }
+	  delete $4;
+	}
+	| LPAREN conditions RPAREN { $$ = $2; }
+	;
+
+value_list:
+	value {
+	  $$ = new std::vector<SelCond>;
+	  $$->push_back($1);
+	}
+	| value_list COMMA value {
+	  $1->push_back($3);
+	  $$ = $1;
+	}
+	;
+
+join_conditions:
+	join_condition {
+	  $$ = new std::vector<SelJoinCond>;
+	  $$->push_back(*$1);
+	  delete $1;
+	}
+	| join_conditions AND join_condition {
+	  $1->push_back(*$3);
+	  $$ = $1;
+	  delete $3;
+	}
+	;
+
+join_condition:
+	column comparator value {
+	  $$ = new SelJoinCond;
+	  $$->column = $1;
+	  $$->comp = static_cast<SelCond::Comparator>($2);
+	  $$->value = $3.value;
+	  $$->param = $3.param;
+	  $$->other.table = NULL;
+	  $$->other.attr = 0;
+	}
+	| column comparator column {
+	  $$ = new SelJoinCond;
+	  $$->column = $1;
+	  $$->comp = static_cast<SelCond::Comparator>($2);
+	  $$->value = NULL;
+	  $$->param = 0;
+	  $$->other = $3;
+	}
+	;
+
+column:
+	attribute { $$.table = NULL; $$.attr = $1; }
+	| ID DOT attribute { $$.table = $1; $$.attr = $3; }
+	;
+
+select_list:
+	select_item {
+	  $$ = new std::vector<SelAggregate>;
+	  $$->push_back($1);
+	}
+	| select_list COMMA select_item {
+	  $1->push_back($3);
+	  $$ = $1;
+	}
+	;
+
+select_item:
+	column { $$.func = SelAggregate::NONE; $$.attr = $1.attr; $$.table = $1.table; }
+	| STAR  { $$.func = SelAggregate::NONE; $$.attr = 3; $$.table = NULL; }
+	| COUNT { $$.func = SelAggregate::COUNT; $$.attr = 0; $$.table = NULL; }
+	| function LPAREN column RPAREN {
+	  $$.func = static_cast<SelAggregate::Function>($1);
+	  $$.attr = $3.attr;
+	  $$.table = $3.table;
+	}
 	;
 
-attributes:
-	attribute { $$ = $1; }
-	| STAR  { $$ = 3; }
-	| COUNT { $$ = 4; }
+function:
+	MIN   { $$ = SelAggregate::MIN; }
+	| MAX { $$ = SelAggregate::MAX; }
+	| SUM { $$ = SelAggregate::SUM; }
+	| AVG { $$ = SelAggregate::AVG; }
 	;
 
 attribute:
@@ -133,8 +456,9 @@ attribute:
 	}
 
 value:
-	INTEGER  { $$ = $1; }
-        | STRING { $$ = $1; }
+	INTEGER  { $$.value = $1; $$.param = 0; $$.disjunct = 0; }
+        | STRING { $$.value = $1; $$.param = 0; $$.disjunct = 0; }
+	| PARAM  { $$.value = NULL; $$.param = ++paramCount; $$.disjunct = 0; }
 	;
 
 table:
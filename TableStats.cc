@@ -0,0 +1,105 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "TableStats.h"
+
+using std::string;
+using std::vector;
+
+// build() hands it to std::min() by reference
+const int TableStats::MAX_BUCKETS;
+
+TableStats::TableStats()
+{
+  rowCount = pageCount = 0;
+  keyMin = keyMax = 0;
+  bucketCount = 0;
+}
+
+RC TableStats::load(const string& table)
+{
+  RC       rc;
+  PageFile pf;
+  int      page[PageFile::PAGE_SIZE / sizeof(int)];
+
+  if ((rc = pf.open(table + ".stat", 'r')) < 0) return rc;
+  rc = pf.read(0, page);
+  pf.close();
+  if (rc < 0) return rc;
+
+  // the page stores the five counters followed by the bucket bounds
+  rowCount = page[0];
+  pageCount = page[1];
+  keyMin = page[2];
+  keyMax = page[3];
+  bucketCount = page[4];
+  if (bucketCount < 0 || bucketCount > MAX_BUCKETS) {
+    bucketCount = 0;
+    return RC_INVALID_FILE_FORMAT;
+  }
+  memcpy(bounds, page + 5, (bucketCount + 1) * sizeof(int));
+  return 0;
+}
+
+RC TableStats::save(const string& table) const
+{
+  RC       rc;
+  PageFile pf;
+  int      page[PageFile::PAGE_SIZE / sizeof(int)];
+
+  memset(page, 0, sizeof(page));
+  page[0] = rowCount;
+  page[1] = pageCount;
+  page[2] = keyMin;
+  page[3] = keyMax;
+  page[4] = bucketCount;
+  memcpy(page + 5, bounds, (bucketCount + 1) * sizeof(int));
+
+  if ((rc = pf.open(table + ".stat", 'w')) < 0) return rc;
+  rc = pf.write(0, page);
+  pf.close();
+  return rc;
+}
+
+void TableStats::build(vector<int>& keys, int pages)
+{
+  rowCount = keys.size();
+  pageCount = pages;
+  bucketCount = 0;
+  if (keys.empty()) return;
+
+  std::sort(keys.begin(), keys.end());
+  keyMin = keys.front();
+  keyMax = keys.back();
+
+  // the bounds of an equi-depth histogram are evenly spaced quantiles
+  bucketCount = std::min(MAX_BUCKETS, rowCount);
+  for (int i = 0; i < bucketCount; i++) {
+    bounds[i] = keys[(long long)i * rowCount / bucketCount];
+  }
+  bounds[bucketCount] = keyMax;
+}
+
+double TableStats::estimateRange(int lo, int hi) const
+{
+  if (bucketCount == 0 || lo > hi || hi < keyMin || lo > keyMax) return 0;
+
+  // assume the keys are spread uniformly over the integers in each bucket
+  double depth = (double)rowCount / bucketCount;
+  double rows = 0;
+  for (int i = 0; i < bucketCount; i++) {
+    // bucket i holds the keys in [bounds[i], bounds[i+1]) and the last one
+    // keyMax as well, so that a bound two buckets share is counted once.
+    // a bucket whose bounds are equal holds only that key
+    long long blo = bounds[i], bhi = bounds[i + 1];
+    if (i < bucketCount - 1 && bhi > blo) bhi--;
+    long long olo = std::max<long long>(lo, blo), ohi = std::min<long long>(hi, bhi);
+    if (olo > ohi) continue;
+    rows += depth * (ohi - olo + 1) / (bhi - blo + 1);
+  }
+  return std::min<double>(rows, rowCount);
+}
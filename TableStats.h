@@ -0,0 +1,68 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef TABLESTATS_H
+#define TABLESTATS_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * Statistics of a table used by the cost model of SqlEngine::select().
+ * They are gathered by LOAD or by the ANALYZE command and are stored
+ * in a single page of the file table + ".stat".
+ */
+class TableStats {
+ public:
+  // maximum number of buckets in the key histogram
+  static const int MAX_BUCKETS = 100;
+
+  TableStats();
+
+  /**
+   * read the statistics of a table from its ".stat" file.
+   * @param table[IN] the table name
+   * @return error code. 0 if no error
+   */
+  RC load(const std::string& table);
+
+  /**
+   * write the statistics of a table to its ".stat" file.
+   * @param table[IN] the table name
+   * @return error code. 0 if no error
+   */
+  RC save(const std::string& table) const;
+
+  /**
+   * compute the statistics from all keys of the table.
+   * @param keys[IN/OUT] every key of the table. sorted by this function.
+   * @param pages[IN] the number of pages in the table file
+   */
+  void build(std::vector<int>& keys, int pages);
+
+  /**
+   * estimate the number of tuples whose key is in [lo, hi].
+   * @param lo[IN] the smallest key of the range (inclusive)
+   * @param hi[IN] the largest key of the range (inclusive)
+   * @return the estimated number of tuples in the range
+   */
+  double estimateRange(int lo, int hi) const;
+
+  int rowCount;   // # tuples in the table
+  int pageCount;  // # pages in the table file
+  int keyMin;     // the smallest key in the table
+  int keyMax;     // the largest key in the table
+
+ private:
+  // equi-depth histogram: bucket i holds about rowCount/bucketCount
+  // tuples with keys in [bounds[i], bounds[i+1]). the last bucket
+  // holds the tuples with key bounds[bucketCount] as well
+  int bucketCount;
+  int bounds[MAX_BUCKETS + 1];
+};
+
+#endif // TABLESTATS_H
@@ -0,0 +1,145 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <climits>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "TupleBatch.h"
+
+//
+// the predicate kernels. every kernel writes the positions of the
+// matching tuples to a selection vector and returns their number.
+// a position is always written and only counted if it matches,
+// so that the loops do not branch on the outcome.
+//
+
+// keep the positions in sel[0..n-1] whose key is in one of the ranges of pred
+static int refineKeys(const int* keys, int* sel, int n, const Predicate& pred)
+{
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    int row = sel[i];
+    sel[m] = row;
+    m += pred.matchKey(keys[row]);
+  }
+  return m;
+}
+
+// select the positions of keys[0..n-1] in [lo, hi]
+static int selectRange(const int* keys, int n, int lo, int hi, int* sel)
+{
+  int m = 0;
+  int i = 0;
+  unsigned width = (unsigned)hi - (unsigned)lo;
+#ifdef __SSE2__
+  // SSE2 only compares signed integers. flipping the sign bit of both
+  // sides turns the unsigned comparison of key - lo and width into one.
+  __m128i bias = _mm_set1_epi32(INT_MIN);
+  __m128i low = _mm_set1_epi32(lo);
+  __m128i w = _mm_xor_si128(_mm_set1_epi32((int)width), bias);
+  for (; i + 4 <= n; i += 4) {
+    __m128i k = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(keys + i)), low);
+    int mask = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_xor_si128(k, bias), w)));
+    sel[m] = i;     m += mask & 1;
+    sel[m] = i + 1; m += (mask >> 1) & 1;
+    sel[m] = i + 2; m += (mask >> 2) & 1;
+    sel[m] = i + 3; m += (mask >> 3) & 1;
+  }
+#endif
+  for (; i < n; i++) {
+    sel[m] = i;
+    m += ((unsigned)keys[i] - (unsigned)lo <= width);
+  }
+  return m;
+}
+
+// keep the positions in sel[0..n-1] whose key is in [lo, hi]
+static int refineRange(const int* keys, int* sel, int n, int lo, int hi)
+{
+  int m = 0;
+  unsigned width = (unsigned)hi - (unsigned)lo;
+  for (int i = 0; i < n; i++) {
+    int row = sel[i];
+    sel[m] = row;
+    m += ((unsigned)keys[row] - (unsigned)lo <= width);
+  }
+  return m;
+}
+
+// keep the positions in sel[0..n-1] whose value passes a compiled value condition
+static int refineValues(const char* const* values, int* sel, int n, const Predicate::ValueTest& t)
+{
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    int row = sel[i];
+    sel[m] = row;
+    m += t.test(values[row], t.literal);
+  }
+  return m;
+}
+
+// keep the positions in sel[0..n-1] whose tuple meets the value conditions
+// of a disjunct of pred that holds its key
+static int refineValues(const int* keys, const char* const* values, int* sel, int n, const Predicate& pred)
+{
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    int row = sel[i];
+    sel[m] = row;
+    m += pred.matchValue(keys[row], values[row]);
+  }
+  return m;
+}
+
+TupleBatch::TupleBatch()
+{
+  count = selCount = 0;
+}
+
+RC TupleBatch::read(const RecordFile& rf, PageId& pid, int pageCount)
+{
+  RC  rc;
+  int n;
+  PageId endPid = rf.endRid().pid + (rf.endRid().sid > 0 ? 1 : 0);
+
+  count = 0;
+  for (int i = 0; i < pageCount && pid < endPid; i++, pid++) {
+    if ((rc = rf.readPage(pid, pages[i], keys + count, values + count, n)) < 0) return rc;
+    count += n;
+  }
+
+  // every tuple is selected until a condition is checked
+  for (int i = 0; i < count; i++) sel[i] = i;
+  selCount = count;
+  return 0;
+}
+
+void TupleBatch::filter(const Predicate& pred)
+{
+  if (pred.empty) {
+    selCount = 0;
+    return;
+  }
+
+  // the keys of a batch nobody filtered yet are contiguous and can be
+  // compared with SIMD against the span of the ranges. the gaps between
+  // the ranges are then taken out of the tuples selected.
+  if (pred.keyMin != INT_MIN || pred.keyMax != INT_MAX) {
+    if (selCount == count) selCount = selectRange(keys, count, pred.keyMin, pred.keyMax, sel);
+    else selCount = refineRange(keys, sel, selCount, pred.keyMin, pred.keyMax);
+  }
+  if (pred.ranges.size() > 1) selCount = refineKeys(keys, sel, selCount, pred);
+
+  // the value conditions come last, since comparing strings costs the most
+  if (!pred.hasValueTests()) return;
+  if (pred.disjuncts.size() == 1) {
+    const std::vector<Predicate::ValueTest>& tests = pred.disjuncts[0].values;
+    for (unsigned i = 0; i < tests.size(); i++)
+      selCount = refineValues(values, sel, selCount, tests[i]);
+  }
+  else selCount = refineValues(keys, values, sel, selCount, pred);
+}
@@ -0,0 +1,61 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef TUPLEBATCH_H
+#define TUPLEBATCH_H
+
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "Predicate.h"
+
+/**
+ * A batch of about 1024 tuples read from consecutive pages of a table,
+ * for the vectorized table scan of SqlEngine.
+ *
+ * The keys are copied into one array, and the values point into the
+ * page buffers of the batch. The tuples that met every condition so far
+ * are listed in the selection vector sel. filter() checks the conditions
+ * of a Predicate one after the other, each on the selected tuples only.
+ * Key conditions on a full batch are compared four keys at a time
+ * with SSE2 where the compiler supports it.
+ */
+class TupleBatch {
+ public:
+  /// # pages read into one batch
+  static const int PAGE_COUNT = (1024 + RecordFile::RECORDS_PER_PAGE - 1) / RecordFile::RECORDS_PER_PAGE;
+
+  /// the maximum # tuples in a batch
+  static const int CAPACITY = PAGE_COUNT * RecordFile::RECORDS_PER_PAGE;
+
+  int         count;              // # tuples in the batch
+  int         keys[CAPACITY];     // the keys of the tuples
+  const char* values[CAPACITY];   // the values of the tuples
+  int         sel[CAPACITY];      // the positions of the selected tuples
+  int         selCount;           // # selected tuples
+
+  TupleBatch();
+
+  /**
+   * read the tuples of the next pageCount pages of a table, and select all of them.
+   * count is 0 when there are no pages left.
+   * @param rf[IN] the table file
+   * @param pid[IN/OUT] the first page to read. moved behind the pages read
+   * @param pageCount[IN] # pages to read, at most PAGE_COUNT
+   * @return error code. 0 if no error
+   */
+  RC read(const RecordFile& rf, PageId& pid, int pageCount = PAGE_COUNT);
+
+  /**
+   * deselect the tuples that do not meet the conditions.
+   * @param pred[IN] the compiled conditions of the WHERE clause
+   */
+  void filter(const Predicate& pred);
+
+ private:
+  char pages[PAGE_COUNT][PageFile::PAGE_SIZE];  // the pages the values point into
+};
+
+#endif /* TUPLEBATCH_H */
@@ -0,0 +1,214 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "TupleSorter.h"
+
+using std::string;
+using std::vector;
+
+// the merge passes of finish() take it as an argument of std::min()
+const int TupleSorter::MERGE_FANIN;
+
+// compare two tuples on the key (attr 1) or on the value (attr 2)
+static int compareTuples(int attr, int key1, const char* value1, int len1,
+                         int key2, const char* value2, int len2)
+{
+  if (attr == 1) return (key1 < key2) ? -1 : (key1 > key2);
+  int c = memcmp(value1, value2, std::min(len1, len2));
+  return c ? c : len1 - len2;
+}
+
+// appends the merged tuples to a run
+class RunOutput {
+ public:
+  RunOutput(SpillFile& run) : writer(run) {}
+  RC put(int key, const char* value, int len) { return writer.put(key, value, len); }
+  bool full() const { return false; }
+  RC finish() { return writer.finish(); }
+
+ private:
+  SpillWriter writer;
+};
+
+// hands the merged tuples to a ResultSink
+class SinkOutput {
+ public:
+  SinkOutput(ResultSink& sink, int attr) : sink(sink) { this->attr = attr; }
+  RC put(int key, const char* value, int len) { sink.put(attr, key, value, len); return 0; }
+  bool full() const { return sink.full(); }
+
+ private:
+  ResultSink& sink;
+  int attr;
+};
+
+// orders the in-memory tuples of a sorter
+class TupleLess {
+ public:
+  TupleLess(int attr, const char* arena) { this->attr = attr; this->arena = arena; }
+  template <class T>
+  bool operator()(const T& a, const T& b) const
+  {
+    return compareTuples(attr, a.key, arena + a.offset, a.len, b.key, arena + b.offset, b.len) < 0;
+  }
+
+ private:
+  int attr;
+  const char* arena;
+};
+
+// orders the readers of a merge so that the heap top is the next tuple.
+// ties go to the earlier run, or to the later one for DESC, which keeps
+// the merge stable.
+class ReaderAfter {
+ public:
+  ReaderAfter(int attr, bool desc, const vector<SpillReader*>& readers) : readers(readers)
+  { this->attr = attr; this->desc = desc; }
+  bool operator()(int a, int b) const
+  {
+    const SpillReader* x = readers[a];
+    const SpillReader* y = readers[b];
+    int c = compareTuples(attr, x->key, x->value, x->len, y->key, y->value, y->len);
+    if (desc) return c ? c < 0 : a < b;
+    return c ? c > 0 : a > b;
+  }
+
+ private:
+  int attr;
+  bool desc;
+  const vector<SpillReader*>& readers;
+};
+
+TupleSorter::TupleSorter(int attr, bool desc)
+{
+  this->attr = attr;
+  this->desc = desc;
+}
+
+TupleSorter::~TupleSorter()
+{
+  for (unsigned i = 0; i < runs.size(); i++) delete runs[i];
+}
+
+RC TupleSorter::add(int key, const char* value, int len)
+{
+  Tuple t;
+  t.key = key;
+  t.offset = arena.size();
+  t.len = len;
+  arena.append(value, len);
+  tuples.push_back(t);
+
+  if (arena.size() + tuples.size() * sizeof(Tuple) >= (unsigned)MEMORY_BUDGET) return spill();
+  return 0;
+}
+
+void TupleSorter::sortTuples()
+{
+  // the reverse of a stable ascending sort is a stable descending one
+  std::stable_sort(tuples.begin(), tuples.end(), TupleLess(attr, arena.data()));
+  if (desc) std::reverse(tuples.begin(), tuples.end());
+}
+
+RC TupleSorter::spill()
+{
+  RC rc;
+  SpillFile* run = new SpillFile;
+  runs.push_back(run);
+  if ((rc = run->create()) < 0) return rc;
+
+  sortTuples();
+  SpillWriter writer(*run);
+  for (unsigned i = 0; i < tuples.size(); i++)
+    if ((rc = writer.put(tuples[i].key, arena.data() + tuples[i].offset, tuples[i].len)) < 0) return rc;
+  if ((rc = writer.finish()) < 0) return rc;
+
+  tuples.clear();
+  arena.clear();
+  return 0;
+}
+
+template <class Out>
+RC TupleSorter::merge(int first, int count, Out& out)
+{
+  RC rc = 0;
+  vector<SpillReader*> readers(count);
+  vector<int> heap;
+  ReaderAfter after(attr, desc, readers);
+
+  for (int i = 0; i < count; i++) {
+    readers[i] = new SpillReader(*runs[first + i]);
+    if (readers[i]->next()) heap.push_back(i);
+  }
+  std::make_heap(heap.begin(), heap.end(), after);
+
+  while (!heap.empty() && !out.full()) {
+    std::pop_heap(heap.begin(), heap.end(), after);
+    SpillReader* r = readers[heap.back()];
+    if ((rc = out.put(r->key, r->value, r->len)) < 0) break;
+    if (r->next()) std::push_heap(heap.begin(), heap.end(), after);
+    else heap.pop_back();
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (rc == 0) rc = readers[i]->rc;
+    delete readers[i];
+  }
+  return rc;
+}
+
+RC TupleSorter::mergeRuns(int first, int count, SpillFile*& merged)
+{
+  RC rc;
+  merged = new SpillFile;
+  if ((rc = merged->create()) == 0) {
+    RunOutput out(*merged);
+    if ((rc = merge(first, count, out)) == 0) rc = out.finish();
+  }
+  if (rc < 0) {
+    delete merged;
+    merged = NULL;
+  }
+  return rc;
+}
+
+RC TupleSorter::output(ResultSink& sink, int attr)
+{
+  RC rc;
+
+  // everything fit in memory: no file is touched
+  if (runs.empty()) {
+    sortTuples();
+    for (unsigned i = 0; i < tuples.size() && !sink.full(); i++)
+      sink.put(attr, tuples[i].key, arena.data() + tuples[i].offset, tuples[i].len);
+    return 0;
+  }
+
+  if (!tuples.empty() && (rc = spill()) < 0) return rc;
+
+  // merge groups of consecutive runs until one pass can merge the rest
+  while ((int)runs.size() > MERGE_FANIN) {
+    vector<SpillFile*> merged;
+    for (int first = 0; first < (int)runs.size(); first += MERGE_FANIN) {
+      int count = std::min(MERGE_FANIN, (int)runs.size() - first);
+      SpillFile* run;
+      if ((rc = mergeRuns(first, count, run)) < 0) {
+        for (unsigned i = 0; i < merged.size(); i++) delete merged[i];
+        return rc;
+      }
+      merged.push_back(run);
+      for (int i = first; i < first + count; i++) {
+        delete runs[i];
+        runs[i] = NULL;
+      }
+    }
+    runs.swap(merged);
+  }
+
+  SinkOutput out(sink, attr);
+  return merge(0, runs.size(), out);
+}
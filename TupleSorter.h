@@ -0,0 +1,101 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef TUPLESORTER_H
+#define TUPLESORTER_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "ResultSink.h"
+#include "SpillFile.h"
+
+/**
+ * Sorts the tuples of a SELECT ... ORDER BY that the index cannot return
+ * in order.
+ *
+ * Tuples are collected in memory until they take MEMORY_BUDGET bytes.
+ * Then they are sorted into a run, which is written to a SpillFile.
+ * output() merges the runs MERGE_FANIN at a time, so that
+ * the tuples are returned in one pass when the input fits in memory,
+ * and after about log_MERGE_FANIN(#runs) passes over the spill files
+ * otherwise.
+ *
+ * The sort is stable: tuples with equal sort keys are returned in the
+ * order they were added. DESC returns the exact reverse of ASC.
+ */
+class TupleSorter : public RowConsumer {
+ public:
+  /// the most bytes of tuples kept in memory before a run is spilled
+  static const int MEMORY_BUDGET = 16 * 1024 * 1024;
+
+  /// the most runs merged at once
+  static const int MERGE_FANIN = 64;
+
+  /**
+   * @param attr[IN] the column to sort on. 1: key, 2: value
+   * @param desc[IN] true to sort in descending order
+   */
+  TupleSorter(int attr, bool desc);
+  ~TupleSorter();
+
+  /**
+   * add a tuple.
+   * @param key[IN] the key of the tuple
+   * @param value[IN] the value of the tuple
+   * @param len[IN] the length of value
+   * @return error code. 0 if no error
+   */
+  RC add(int key, const char* value, int len);
+
+  /**
+   * output the tuples in sorted order. stops as soon as the sink is full.
+   * @param sink[IN] the destination of the rows
+   * @param attr[IN] attribute in the SELECT clause (1: key, 2: value, 3: *)
+   * @return error code. 0 if no error
+   */
+  RC output(ResultSink& sink, int attr);
+
+ private:
+  /// a tuple kept in memory. the value is stored in the arena
+  struct Tuple {
+    int      key;
+    unsigned offset;   // the offset of the value in the arena
+    int      len;      // the length of the value
+  };
+
+  int  attr;                  // the column to sort on
+  bool desc;                  // true if the order is descending
+  std::vector<Tuple> tuples;  // the tuples in memory
+  std::string arena;          // the values of the tuples in memory
+  std::vector<SpillFile*> runs;  // the spilled runs, in the order they were written
+
+  /**
+   * sort the tuples in memory into the order of the output.
+   */
+  void sortTuples();
+
+  /**
+   * sort the tuples in memory and write them out as a new run.
+   * @return error code. 0 if no error
+   */
+  RC spill();
+
+  /**
+   * merge runs[first..first+count-1] into one new run.
+   * @return error code. 0 if no error
+   */
+  RC mergeRuns(int first, int count, SpillFile*& merged);
+
+  /**
+   * merge runs[first..first+count-1] and hand every tuple to out.put()
+   * in sorted order until out.full().
+   * @return error code. 0 if no error
+   */
+  template <class Out>
+  RC merge(int first, int count, Out& out);
+};
+
+#endif /* TUPLESORTER_H */
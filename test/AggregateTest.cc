@@ -0,0 +1,137 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Group random tuples by their value with HashAggregate, in memory and
+ * spilled to partitions, and check the COUNT, MIN, MAX and SUM of every
+ * group against a std::map.
+ *
+ * usage: AggregateTest [random seed]
+ */
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "Test.h"
+#include "Aggregate.h"
+
+using namespace std;
+
+/// the aggregates of a group in the reference
+struct Group {
+  int       count;
+  int       min;
+  int       max;
+  long long sum;
+};
+
+/// the row of a group: COUNT(key), MIN(key), MAX(key), SUM(key), value
+static vector<SelAggregate> selectClause()
+{
+  static const SelAggregate::Function funcs[] = { SelAggregate::COUNT, SelAggregate::MIN,
+    SelAggregate::MAX, SelAggregate::SUM, SelAggregate::NONE };
+  vector<SelAggregate> items;
+  for (unsigned i = 0; i < sizeof(funcs) / sizeof(funcs[0]); i++) {
+    SelAggregate item;
+    item.func = funcs[i];
+    item.attr = (funcs[i] == SelAggregate::NONE) ? 2 : 1;
+    item.table = NULL;
+    items.push_back(item);
+  }
+  return items;
+}
+
+/**
+ * read the rows of selectClause() a ResultSink wrote to file in BINARY format.
+ */
+static map<string, Group> readRows(FILE* file, int& rows)
+{
+  map<string, Group> groups;
+  int len;
+  rows = 0;
+  rewind(file);
+  while (fread(&len, sizeof(int), 1, file) == 1) {
+    Group g;
+    int size = 3 * sizeof(int) + sizeof(long long);
+    vector<char> value(len - size + 1);
+    if (fread(&g.count, sizeof(int), 1, file) != 1 || fread(&g.min, sizeof(int), 1, file) != 1 ||
+        fread(&g.max, sizeof(int), 1, file) != 1 || fread(&g.sum, sizeof(long long), 1, file) != 1) break;
+    if ((int)fread(&value[0], 1, len - size, file) != len - size) break;
+    string v(&value[0], len - size);
+    CHECK(groups.find(v) == groups.end());
+    groups[v] = g;
+    rows++;
+  }
+  return groups;
+}
+
+/**
+ * aggregate n random tuples into about groupCount groups, and check the
+ * rows. with a LIMIT only the number of rows can be checked, besides
+ * the aggregates of every row.
+ */
+static void testAggregate(int n, int groupCount, int limit)
+{
+  map<string, Group> expected;
+  HashAggregate aggregate;
+  char value[32];
+  for (int i = 0; i < n; i++) {
+    int key = randomInt(-1000000000, 1000000000);
+    int len = snprintf(value, sizeof(value), "%d", rand() % groupCount);
+    // a group of the empty value, and values that only differ in length
+    if (i % 1000 == 0) len = 0;
+    if (rand() % 2) value[len++] = 'x';
+
+    CHECK(aggregate.add(key, value, len) == 0);
+    string v(value, len);
+    map<string, Group>::iterator it = expected.find(v);
+    if (it == expected.end()) {
+      Group g = { 1, key, key, key };
+      expected[v] = g;
+    }
+    else {
+      Group& g = it->second;
+      g.count++;
+      g.sum += key;
+      if (key < g.min) g.min = key;
+      if (key > g.max) g.max = key;
+    }
+  }
+
+  FILE* file = tmpfile();
+  ResultSink sink(file);
+  sink.setFormat(ResultSink::BINARY);
+  sink.setLimit(0, limit);
+  CHECK(aggregate.output(sink, selectClause()) == 0);
+  CHECK(sink.flush() == 0);
+  int rows;
+  map<string, Group> groups = readRows(file, rows);
+  fclose(file);
+
+  CHECK(rows == ((limit < 0) ? (int)expected.size() : min(limit, (int)expected.size())));
+  for (map<string, Group>::iterator it = groups.begin(); it != groups.end(); ++it) {
+    map<string, Group>::iterator e = expected.find(it->first);
+    CHECK(e != expected.end());
+    if (e == expected.end()) continue;
+    CHECK(it->second.count == e->second.count && it->second.sum == e->second.sum);
+    CHECK(it->second.min == e->second.min && it->second.max == e->second.max);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned seed = seedTest(argc, argv, 1);
+
+  // in memory
+  for (int i = 0; i < 20; i++) testAggregate(1 + rand() % 20000, 1 + rand() % 2000, -1);
+  testAggregate(10000, 1000, 100);
+
+  // about 1M groups outgrow the memory budget and are spilled
+  testAggregate(1500000, 500000, -1);
+  testAggregate(1500000, 500000, 700000);
+
+  return finishTest("AggregateTest", seed);
+}
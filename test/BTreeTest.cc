@@ -0,0 +1,165 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Fill BTreeIndex with random entries through insert(), insertBatch()
+ * and build(), and check every way of reading the tree against the
+ * sorted entries. The keys range from dense and sparse ones to a few
+ * keys whose posting lists span overflow pages.
+ *
+ * usage: BTreeTest [random seed]
+ */
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+#include <unistd.h>
+#include "Test.h"
+#include "BTreeIndex.h"
+
+using namespace std;
+
+static const char* INDEX_FILE = "btreetest.idx";
+
+/// how the entries are put into the tree
+enum Method { INSERT, INSERT_BATCH, BUILD };
+
+static bool keyLess(const IndexEntry& e, int key) { return e.key < key; }
+static bool lessKey(int key, const IndexEntry& e) { return key < e.key; }
+
+static bool sameEntry(int key, const RecordId& rid, const IndexEntry& e)
+{
+  return key == e.key && rid == e.rid;
+}
+
+// a key of the tree or, half of the time, any key in [lo, hi]
+static int probeKey(const vector<IndexEntry>& entries, int lo, int hi)
+{
+  if (!entries.empty() && rand() % 2) return entries[rand() % entries.size()].key;
+  return randomInt(lo, hi);
+}
+
+// check every way of reading the tree against the sorted entries
+static void checkTree(BTreeIndex& tree, const vector<IndexEntry>& entries, int lo, int hi)
+{
+  IndexCursor cursor;
+  int key;
+  RecordId rid;
+
+  // a forward scan over the whole tree
+  unsigned n = 0;
+  tree.locate(INT_MIN, cursor);
+  while (n <= entries.size() && tree.readForward(cursor, key, rid) == 0) {
+    CHECK(n < entries.size() && sameEntry(key, rid, entries[n]));
+    n++;
+  }
+  CHECK(n == entries.size());
+
+  // a backward scan over the whole tree
+  n = 0;
+  tree.locateLast(INT_MAX, cursor);
+  while (n <= entries.size() && tree.readBackward(cursor, key, rid) == 0) {
+    CHECK(n < entries.size() && sameEntry(key, rid, entries[entries.size() - 1 - n]));
+    n++;
+  }
+  CHECK(n == entries.size());
+
+  for (int i = 0; i < 200; i++) {
+    // locate() stops at the first entry not smaller than the key
+    int k = probeKey(entries, lo, hi);
+    vector<IndexEntry>::const_iterator first = lower_bound(entries.begin(), entries.end(), k, keyLess);
+    tree.locate(k, cursor);
+    if (tree.readForward(cursor, key, rid) == 0) CHECK(first != entries.end() && sameEntry(key, rid, *first));
+    else CHECK(first == entries.end());
+
+    // locateLast() stops at the last entry not larger than the key
+    vector<IndexEntry>::const_iterator last = upper_bound(entries.begin(), entries.end(), k, lessKey);
+    tree.locateLast(k, cursor);
+    if (tree.readBackward(cursor, key, rid) == 0) CHECK(last != entries.begin() && sameEntry(key, rid, *(last - 1)));
+    else CHECK(last == entries.begin());
+
+    // countRange() and splitRange() over a random range
+    int k2 = probeKey(entries, lo, hi);
+    int rlo = min(k, k2), rhi = max(k, k2);
+    int count;
+    int expected = upper_bound(entries.begin(), entries.end(), rhi, lessKey)
+                 - lower_bound(entries.begin(), entries.end(), rlo, keyLess);
+    CHECK(tree.countRange(rlo, rhi, count) == 0 && count == expected);
+
+    vector<int> bounds;
+    CHECK(tree.splitRange(rlo, rhi, 1 + rand() % 2000, bounds) == 0);
+    for (unsigned b = 0; b < bounds.size(); b++) {
+      CHECK(bounds[b] > rlo && bounds[b] <= rhi);
+      CHECK(b == 0 || bounds[b] > bounds[b - 1]);
+    }
+  }
+}
+
+/**
+ * fill a new tree with n random entries whose keys are in [lo, hi], and check it.
+ * the RecordIds follow each other, as LOAD assigns them.
+ */
+static void testTree(Method method, int n, int lo, int hi)
+{
+  vector<IndexEntry> entries(n);
+  RecordId rid = { 0, 0 };
+  for (int i = 0; i < n; i++, ++rid) {
+    entries[i].key = randomInt(lo, hi);
+    entries[i].rid = rid;
+  }
+
+  unlink(INDEX_FILE);
+  BTreeIndex tree;
+  CHECK(tree.open(INDEX_FILE, 'w') == 0);
+  switch (method) {
+  case INSERT:
+    // in random order, so that entries go into the middle of posting lists
+    random_shuffle(entries.begin(), entries.end());
+    for (int i = 0; i < n; i++) CHECK(tree.insert(entries[i].key, entries[i].rid) == 0);
+    break;
+  case INSERT_BATCH:
+    // batches of random sizes, each sorted as LOAD hands them over
+    for (int i = 0; i < n; ) {
+      int size = min(n - i, 1 + rand() % 5000);
+      sort(entries.begin() + i, entries.begin() + i + size);
+      CHECK(tree.insertBatch(&entries[i], size) == 0);
+      i += size;
+    }
+    break;
+  case BUILD:
+    sort(entries.begin(), entries.end());
+    CHECK(tree.build(entries.empty() ? NULL : &entries[0], n) == 0);
+    break;
+  }
+  sort(entries.begin(), entries.end());
+  checkTree(tree, entries, lo, hi);
+
+  // and once more after the tree is read back from the file
+  tree.close();
+  CHECK(tree.open(INDEX_FILE, 'r') == 0);
+  checkTree(tree, entries, lo, hi);
+  tree.close();
+  unlink(INDEX_FILE);
+}
+
+int main(int argc, char** argv)
+{
+  unsigned seed = seedTest(argc, argv, 1);
+
+  for (int method = INSERT; method <= BUILD; method++) {
+    // dense keys, as the compressed leaves pack them best
+    testTree((Method)method, 30000, 0, 40000);
+    // sparse keys, with deltas too wide to pack
+    testTree((Method)method, 20000, INT_MIN, INT_MAX);
+    // heavy duplicates, whose posting lists fill overflow pages
+    testTree((Method)method, 12000, 1, 3);
+    // one key
+    testTree((Method)method, 4000, 7, 7);
+    // a small tree that fits in one leaf
+    testTree((Method)method, 50, -100, 100);
+  }
+
+  return finishTest("BTreeTest", seed);
+}
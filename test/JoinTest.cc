@@ -0,0 +1,292 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Join random tables with HashJoin, in memory and spilled to partitions,
+ * and with mergeJoin over their indexes, and check the rows against a
+ * nested loop join.
+ *
+ * usage: JoinTest [random seed]
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "Test.h"
+#include "Join.h"
+
+using namespace std;
+
+/// a tuple of a table
+struct Tuple {
+  int    key;
+  string value;
+};
+
+/// a row of the join: SELECT key, left value, right value
+struct Row {
+  int    key;
+  string left;
+  string right;
+
+  bool operator<(const Row& r) const
+  {
+    if (key != r.key) return key < r.key;
+    if (left != r.left) return left < r.left;
+    return right < r.right;
+  }
+  bool operator==(const Row& r) const { return key == r.key && left == r.left && right == r.right; }
+};
+
+static const char* VALUE_LITERALS[] = { "a", "b", "c" };
+
+/**
+ * @return n random tuples with keys in [0, keys) and short values
+ */
+static vector<Tuple> randomTable(int n, int keys, int valueLen)
+{
+  vector<Tuple> tuples(n);
+  for (int i = 0; i < n; i++) {
+    tuples[i].key = rand() % keys;
+    int len = 1 + rand() % valueLen;
+    for (int j = 0; j < len; j++) tuples[i].value += (char)('a' + rand() % 3);
+  }
+  return tuples;
+}
+
+/**
+ * read the rows a JoinOutput of KEY, LEFT_VALUE and RIGHT_VALUE wrote to
+ * file in BINARY format: the key, the length of the left value, and the
+ * two values.
+ */
+static vector<Row> readRows(FILE* file)
+{
+  vector<Row> rows;
+  int len, leftLen;
+  rewind(file);
+  while (fread(&len, sizeof(int), 1, file) == 1) {
+    Row r;
+    vector<char> data(len + 1);
+    if ((int)fread(&data[0], 1, len, file) != len) break;
+    memcpy(&r.key, &data[0], sizeof(int));
+    memcpy(&leftLen, &data[sizeof(int)], sizeof(int));
+    r.left.assign(&data[2 * sizeof(int)], leftLen);
+    r.right.assign(&data[2 * sizeof(int) + leftLen], len - 2 * sizeof(int) - leftLen);
+    rows.push_back(r);
+  }
+  return rows;
+}
+
+/**
+ * @return the rows of the join of the tuples of left and right that meet their conditions
+ */
+static vector<Row> nestedLoopJoin(const vector<Tuple>& left, const Predicate& lpred,
+                                  const vector<Tuple>& right, const Predicate& rpred)
+{
+  vector<Row> rows;
+  for (unsigned i = 0; i < left.size(); i++) {
+    if (!lpred.match(left[i].key, left[i].value.c_str())) continue;
+    for (unsigned j = 0; j < right.size(); j++) {
+      if (right[j].key != left[i].key || !rpred.match(right[j].key, right[j].value.c_str())) continue;
+      Row r = { left[i].key, left[i].value, right[j].value };
+      rows.push_back(r);
+    }
+  }
+  sort(rows.begin(), rows.end());
+  return rows;
+}
+
+/**
+ * @return the rows of the join of left and right, hashed in buckets of
+ *         their key so that a large join is not quadratic
+ */
+static vector<Row> bucketJoin(const vector<Tuple>& left, const vector<Tuple>& right, int keys)
+{
+  vector<vector<int> > buckets(keys);
+  for (unsigned j = 0; j < right.size(); j++) buckets[right[j].key].push_back(j);
+  vector<Row> rows;
+  for (unsigned i = 0; i < left.size(); i++) {
+    const vector<int>& b = buckets[left[i].key];
+    for (unsigned j = 0; j < b.size(); j++) {
+      Row r = { left[i].key, left[i].value, right[b[j]].value };
+      rows.push_back(r);
+    }
+  }
+  sort(rows.begin(), rows.end());
+  return rows;
+}
+
+/**
+ * @return the columns of every row: SELECT key, left value, right value
+ */
+static vector<JoinOutput::Column> joinColumns()
+{
+  vector<JoinOutput::Column> columns;
+  columns.push_back(JoinOutput::KEY);
+  columns.push_back(JoinOutput::LEFT_VALUE);
+  columns.push_back(JoinOutput::RIGHT_VALUE);
+  return columns;
+}
+
+/**
+ * join left and right with a HashJoin that builds on one of them, and check the rows.
+ */
+static void testHashJoin(const vector<Tuple>& left, const vector<Tuple>& right, bool buildLeft,
+                         const vector<Row>& expected)
+{
+  FILE* file = tmpfile();
+  ResultSink sink(file);
+  sink.setFormat(ResultSink::BINARY);
+  sink.setLimit(0, -1);
+  JoinOutput out(sink, joinColumns());
+  out.count = 0;
+
+  HashJoin join(out, buildLeft);
+  const vector<Tuple>& build = buildLeft ? left : right;
+  const vector<Tuple>& probe = buildLeft ? right : left;
+  for (unsigned i = 0; i < build.size(); i++)
+    CHECK(join.add(build[i].key, build[i].value.data(), build[i].value.size()) == 0);
+  CHECK(join.probe() == 0);
+  for (unsigned i = 0; i < probe.size(); i++)
+    CHECK(join.add(probe[i].key, probe[i].value.data(), probe[i].value.size()) == 0);
+  CHECK(join.finish() == 0);
+  CHECK(sink.flush() == 0);
+
+  vector<Row> rows = readRows(file);
+  fclose(file);
+  sort(rows.begin(), rows.end());
+  CHECK(out.count == (int)expected.size());
+  CHECK(rows == expected);
+}
+
+/**
+ * store the tuples of a table in a record file and an index.
+ */
+static void createTable(const char* name, const vector<Tuple>& tuples, TableHandle& t)
+{
+  string tbl = string(name) + ".tbl", idx = string(name) + ".idx";
+  unlink(tbl.c_str());
+  unlink(idx.c_str());
+  RecordId rid;
+  CHECK(t.rf.open(tbl, 'w') == 0);
+  CHECK(t.index.open(idx, 'w') == 0);
+  for (unsigned i = 0; i < tuples.size(); i++) {
+    CHECK(t.rf.append(tuples[i].key, tuples[i].value, rid) == 0);
+    CHECK(t.index.insert(tuples[i].key, rid) == 0);
+  }
+  t.name = name;
+  t.indexed = true;
+  t.hasStats = false;
+  t.entryCount = -1;
+}
+
+static void dropTable(const char* name, TableHandle& t)
+{
+  t.rf.close();
+  t.index.close();
+  unlink((string(name) + ".tbl").c_str());
+  unlink((string(name) + ".idx").c_str());
+}
+
+/**
+ * add a random condition on the key, or on the value, to cond.
+ */
+static void randomCondition(vector<SelCond>& cond, int attr, int keys, vector<string>& literals)
+{
+  SelCond c;
+  c.attr = attr;
+  c.comp = (SelCond::Comparator)(rand() % 6);
+  c.disjunct = 0;
+  c.param = 0;
+  if (attr == 1) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", rand() % keys);
+    literals.push_back(buf);
+    c.value = (char*)literals.back().c_str();
+  }
+  else c.value = (char*)VALUE_LITERALS[rand() % 3];
+  cond.push_back(c);
+}
+
+/**
+ * join two small indexed tables with mergeJoin under random conditions,
+ * and check the rows. as in a query, the key conditions apply to both
+ * tables and the value conditions to one of them.
+ */
+static void testMergeJoin(int keys)
+{
+  vector<Tuple> left = randomTable(1 + rand() % 2000, keys, 3);
+  vector<Tuple> right = randomTable(1 + rand() % 2000, keys, 3);
+
+  vector<string> literals;
+  literals.reserve(8);
+  vector<SelCond> keyCond, lcond, rcond;
+  for (int n = rand() % 3; n > 0; n--) randomCondition(keyCond, 1, keys, literals);
+  lcond = rcond = keyCond;
+  for (int n = rand() % 2; n > 0; n--) randomCondition(lcond, 2, keys, literals);
+  for (int n = rand() % 2; n > 0; n--) randomCondition(rcond, 2, keys, literals);
+
+  TableHandle lt, rt;
+  createTable("jointest-left", left, lt);
+  createTable("jointest-right", right, rt);
+  JoinTable lj, rj;
+  lj.name = "jointest-left";
+  lj.table = &lt;
+  lj.pred.compile(lcond);
+  lj.needValue = true;
+  rj.name = "jointest-right";
+  rj.table = &rt;
+  rj.pred.compile(rcond);
+  rj.needValue = true;
+
+  FILE* file = tmpfile();
+  ResultSink sink(file);
+  sink.setFormat(ResultSink::BINARY);
+  sink.setLimit(0, -1);
+  JoinOutput out(sink, joinColumns());
+  out.count = 0;
+  CHECK(mergeJoin(lj, rj, out) == 0);
+  CHECK(sink.flush() == 0);
+
+  vector<Row> rows = readRows(file);
+  fclose(file);
+  vector<Row> expected = nestedLoopJoin(left, lj.pred, right, rj.pred);
+  sort(rows.begin(), rows.end());
+  CHECK(out.count == (int)expected.size());
+  CHECK(rows == expected);
+
+  dropTable("jointest-left", lt);
+  dropTable("jointest-right", rt);
+}
+
+int main(int argc, char** argv)
+{
+  unsigned seed = seedTest(argc, argv, 1);
+  Predicate all;
+
+  // hash joins in memory, building on either table
+  for (int i = 0; i < 20; i++) {
+    int keys = 1 + rand() % 500;
+    vector<Tuple> left = randomTable(rand() % 2000, keys, 8);
+    vector<Tuple> right = randomTable(rand() % 2000, keys, 8);
+    vector<Row> expected = nestedLoopJoin(left, all, right, all);
+    testHashJoin(left, right, true, expected);
+    testHashJoin(left, right, false, expected);
+  }
+
+  // about 30MB of build tuples are partitioned
+  int keys = 1000000;
+  vector<Tuple> left = randomTable(700000, keys, 24);
+  vector<Tuple> right = randomTable(700000, keys, 24);
+  vector<Row> expected = bucketJoin(left, right, keys);
+  testHashJoin(left, right, true, expected);
+
+  // merge joins with conditions
+  for (int i = 0; i < 30; i++) testMergeJoin(1 + rand() % 300);
+
+  return finishTest("JoinTest", seed);
+}
@@ -0,0 +1,259 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Parse random load files with LoadFile, mapped and read from a pipe,
+ * split into chunks at random offsets, and check the lines and the
+ * (key, value) pairs against getline() and the parser LOAD used before
+ * LoadFile, which read the key with atoi() and searched with strchr().
+ * Then LOAD files of several chunks into tables with and without an
+ * index, and check the tuples and index entries against that parser.
+ *
+ * usage: LoadTest [random seed]
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Test.h"
+#include "LoadFile.h"
+#include "SqlEngine.h"
+
+using namespace std;
+
+static const char* LOAD_FILE = "loadtest.del";
+static const char* FIFO = "loadtest.fifo";
+static const char* TABLE = "loadtest";
+
+/**
+ * parse a line the way LOAD did before LoadFile.
+ */
+static RC referenceParse(const string& line, int& key, string& value)
+{
+  const char* s = line.c_str();
+  while (*s == ' ' || *s == '\t') s++;
+  key = atoi(s);
+
+  s = strchr(s, ',');
+  if (s == NULL) return RC_INVALID_FILE_FORMAT;
+  do s++; while (*s == ' ' || *s == '\t');
+
+  char quote = '\n';
+  if (*s == '\'' || *s == '"') quote = *s++;
+  value.assign(s);
+  string::size_type loc = value.find(quote);
+  if (loc != string::npos) value.erase(loc);
+  return 0;
+}
+
+/**
+ * @return a random line without a line break. the pieces are the ones a
+ *         parser can trip over: signs, white spaces, long numbers, commas
+ *         and quotes
+ */
+static string randomLine()
+{
+  static const char* pieces[] = { "0", "7", "-", "+", " ", "\t", "\r", "\v", ",", "'", "\"",
+    "a", "xyz", "2147483647", "2147483648", "-2147483649", "99999999999999999999", "12,'ab'" };
+  static const int count = sizeof(pieces) / sizeof(pieces[0]);
+  string line;
+  if (rand() % 2) {
+    // a well-formed line now and then
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%d,%s", randomInt(-1000000, 1000000), rand() % 2 ? "'value'" : "value");
+    line = buf;
+  }
+  for (int n = rand() % 8; n > 0; n--) line += pieces[rand() % count];
+  return line;
+}
+
+// check parseLine() on a line against the reference
+static void checkLine(const char* line, const char* end)
+{
+  int key, refKey;
+  const char* value;
+  int len;
+  string refValue;
+  string s(line, end - line);
+  RC rc = LoadFile::parseLine(line, end, key, value, len);
+  RC refRc = referenceParse(s, refKey, refValue);
+  CHECK(rc == refRc);
+  if (rc == 0 && refRc == 0) CHECK(key == refKey && string(value, len) == refValue);
+}
+
+/**
+ * check the lines of a load file split into chunks at random offsets,
+ * as the threads of LOAD split it: every chunk starts at lineStart()
+ * of its offset and ends where the next chunk starts.
+ */
+static void checkChunks(const LoadFile& lf, const vector<string>& lines)
+{
+  vector<size_t> offsets;
+  offsets.push_back(0);
+  for (int n = rand() % 20; n > 0; n--) offsets.push_back(lf.size() ? rand() % (lf.size() + 1) : 0);
+  offsets.push_back(lf.size());
+  sort(offsets.begin(), offsets.end());
+
+  unsigned n = 0;
+  for (unsigned c = 0; c + 1 < offsets.size(); c++) {
+    size_t start = lf.lineStart(offsets[c]);
+    size_t stop = lf.lineStart(offsets[c + 1]);
+    CHECK(start == 0 || start == lf.size() || lf.data()[start - 1] == '\n');
+    const char* end = lf.data() + stop;
+    for (const char* line = lf.data() + start; line < end; n++) {
+      const char* e = LoadFile::lineEnd(line, end);
+      CHECK(n < lines.size() && string(line, e - line) == lines[n]);
+      checkLine(line, e);
+      line = (e < end) ? e + 1 : e;
+    }
+  }
+  CHECK(n == lines.size());
+}
+
+/**
+ * write random lines to a file. the last line lacks its line break now and then.
+ * @return the lines, as getline() would return them
+ */
+static vector<string> writeFile(const char* name, int n)
+{
+  vector<string> lines;
+  string data;
+  for (int i = 0; i < n; i++) {
+    lines.push_back(randomLine());
+    data += lines.back();
+    // an empty last line is only a line if its line break is there
+    if (i < n - 1 || lines.back().empty() || rand() % 2) data += '\n';
+  }
+  FILE* file = fopen(name, "w");
+  fwrite(data.data(), 1, data.size(), file);
+  fclose(file);
+  return lines;
+}
+
+/**
+ * @return the tuples LOAD appended for the lines of a file, parsed one
+ *         by one. a line without a comma keeps the value of the line
+ *         before it, as it did when LOAD parsed a line at a time.
+ */
+static void referenceLoad(const vector<string>& lines, vector<IndexEntry>& entries,
+                          vector<string>& values, RecordId& rid)
+{
+  int key;
+  string value;
+  for (unsigned i = 0; i < lines.size(); i++, ++rid) {
+    referenceParse(lines[i], key, value);
+    // a record holds at most MAX_VALUE_LENGTH - 1 bytes of the value
+    values.push_back(value.substr(0, RecordFile::MAX_VALUE_LENGTH - 1));
+    IndexEntry e = { key, rid };
+    entries.push_back(e);
+  }
+}
+
+/**
+ * LOAD random files of several chunks into a table, twice so that the
+ * second LOAD appends, and check its tuples and index entries.
+ * @param lines[IN] # lines of each file
+ */
+static void testLoad(bool index, bool buffered, int lines)
+{
+  string tbl = string(TABLE) + ".tbl", idx = string(TABLE) + ".idx";
+  unlink(tbl.c_str());
+  unlink(idx.c_str());
+  vector<IndexEntry> entries;
+  vector<string> values;
+  RecordId rid = { 0, 0 };
+  for (int load = 0; load < 2; load++) {
+    vector<string> l = writeFile(LOAD_FILE, lines);
+    referenceLoad(l, entries, values, rid);
+    CHECK(SqlEngine::load(TABLE, LOAD_FILE, index, buffered) == 0);
+  }
+
+  // the tuples in the order of the lines
+  RecordFile rf;
+  CHECK(rf.open(tbl, 'r') == 0);
+  CHECK(rf.endRid() == rid);
+  int key;
+  string value;
+  for (unsigned i = 0; i < entries.size(); i++) {
+    CHECK(rf.read(entries[i].rid, key, value) == 0);
+    CHECK(key == entries[i].key && value == values[i]);
+  }
+  rf.close();
+
+  // the index entries in the order of (key, RecordId)
+  if (index) {
+    BTreeIndex tree;
+    IndexCursor cursor;
+    CHECK(tree.open(idx, 'r') == 0);
+    sort(entries.begin(), entries.end());
+    tree.locate(INT_MIN, cursor);
+    unsigned n = 0;
+    while (n <= entries.size() && tree.readForward(cursor, key, rid) == 0) {
+      CHECK(n < entries.size() && key == entries[n].key && rid == entries[n].rid);
+      n++;
+    }
+    CHECK(n == entries.size());
+    tree.close();
+  }
+
+  unlink(tbl.c_str());
+  unlink(idx.c_str());
+  unlink(LOAD_FILE);
+}
+
+int main(int argc, char** argv)
+{
+  unsigned seed = seedTest(argc, argv, 1);
+
+  // single lines, without the file
+  for (int i = 0; i < 100000; i++) {
+    string line = randomLine();
+    checkLine(line.data(), line.data() + line.size());
+  }
+
+  // mapped files, from empty ones to one of a few MB
+  for (int i = 0; i < 50; i++) {
+    int n = (i == 0) ? 0 : (i == 1) ? 200000 : rand() % 1000;
+    vector<string> lines = writeFile(LOAD_FILE, n);
+    LoadFile lf;
+    CHECK(lf.open(LOAD_FILE) == 0);
+    checkChunks(lf, lines);
+  }
+
+  // a pipe, which is read into memory instead
+  unlink(FIFO);
+  CHECK(mkfifo(FIFO, 0600) == 0);
+  vector<string> lines = writeFile(LOAD_FILE, 50000);
+  pid_t child = fork();
+  if (child == 0) {
+    FILE* in = fopen(LOAD_FILE, "r");
+    FILE* out = fopen(FIFO, "w");
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) fwrite(buf, 1, n, out);
+    fclose(out);
+    _exit(0);
+  }
+  LoadFile lf;
+  CHECK(lf.open(FIFO) == 0);
+  waitpid(child, NULL, 0);
+  checkChunks(lf, lines);
+  lf.close();
+
+  unlink(FIFO);
+  unlink(LOAD_FILE);
+
+  // LOAD files of about 3MB, which are parsed in several chunks
+  testLoad(false, false, 150000);
+  testLoad(true, false, 150000);
+  testLoad(true, true, 150000);
+
+  return finishTest("LoadTest", seed);
+}
@@ -0,0 +1,123 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Compile random WHERE clauses into a Predicate, and check its key
+ * ranges, match() and TupleBatch::filter() against evaluating every
+ * condition of the clause one by one.
+ *
+ * usage: PredicateTest [random seed]
+ */
+
+#include <climits>
+#include <cstring>
+#include <vector>
+#include "Test.h"
+#include "Predicate.h"
+#include "TupleBatch.h"
+
+using namespace std;
+
+// the literals of the conditions. keys are drawn around them
+static const char* KEY_LITERALS[] = { "-3", "0", "1", "2", "5", "7", "-2147483648", "2147483647", "2147483646" };
+static const char* VALUE_LITERALS[] = { "", "a", "ab", "b", "ba", "c" };
+
+static const int KEY_LITERAL_COUNT = sizeof(KEY_LITERALS) / sizeof(KEY_LITERALS[0]);
+static const int VALUE_LITERAL_COUNT = sizeof(VALUE_LITERALS) / sizeof(VALUE_LITERALS[0]);
+
+// a key near one of the literals, or any key
+static int randomKey()
+{
+  if (rand() % 4 == 0) return randomInt(INT_MIN, INT_MAX);
+  int k = atoi(KEY_LITERALS[rand() % KEY_LITERAL_COUNT]);
+  int delta = rand() % 5 - 2;
+  if ((delta > 0 && k > INT_MAX - delta) || (delta < 0 && k < INT_MIN - delta)) return k;
+  return k + delta;
+}
+
+// check the compiled ranges of a clause
+static void checkRanges(const Predicate& pred, const vector<SelCond>& cond, int disjuncts)
+{
+  const vector<Predicate::KeyRange>& ranges = pred.ranges;
+  CHECK(pred.empty == ranges.empty());
+  for (unsigned i = 0; i < ranges.size(); i++) {
+    CHECK(ranges[i].lo <= ranges[i].hi);
+    // disjoint and not adjacent
+    CHECK(i == 0 || (long long)ranges[i - 1].hi + 1 < ranges[i].lo);
+  }
+  if (!ranges.empty()) CHECK(pred.keyMin == ranges.front().lo && pred.keyMax == ranges.back().hi);
+
+  // a key is in the ranges if the key conditions of some disjunct hold
+  for (int i = 0; i < 200; i++) {
+    int key = randomKey();
+    CHECK(pred.matchKey(key) == meets(cond, disjuncts, key, NULL, false));
+  }
+}
+
+// check filter() on a batch of random tuples, all of them or some of them selected
+static void checkFilter(const Predicate& pred, const vector<SelCond>& cond, int disjuncts, TupleBatch& batch)
+{
+  batch.count = 1 + rand() % TupleBatch::CAPACITY;
+  for (int i = 0; i < batch.count; i++) {
+    batch.keys[i] = randomKey();
+    batch.values[i] = VALUE_LITERALS[rand() % VALUE_LITERAL_COUNT];
+  }
+  bool all = rand() % 2;
+  batch.selCount = 0;
+  for (int i = 0; i < batch.count; i++)
+    if (all || rand() % 3) batch.sel[batch.selCount++] = i;
+
+  vector<int> expected;
+  for (int i = 0; i < batch.selCount; i++) {
+    int t = batch.sel[i];
+    if (meets(cond, disjuncts, batch.keys[t], batch.values[t], true)) expected.push_back(t);
+  }
+
+  batch.filter(pred);
+  CHECK(batch.selCount == (int)expected.size());
+  for (int i = 0; i < batch.selCount && i < (int)expected.size(); i++) CHECK(batch.sel[i] == expected[i]);
+}
+
+int main(int argc, char** argv)
+{
+  unsigned seed = seedTest(argc, argv, 1);
+  TupleBatch* batch = new TupleBatch;
+
+  for (int clause = 0; clause < 3000; clause++) {
+    // a random clause of up to four disjuncts of up to four conditions each,
+    // or now and then no WHERE clause
+    int disjuncts = 1 + rand() % 4;
+    vector<SelCond> cond;
+    if (clause % 50 != 0) {
+      for (int d = 0; d < disjuncts; d++) {
+        for (int n = 1 + rand() % 4; n > 0; n--) {
+          SelCond c;
+          c.attr = (rand() % 3 == 0) ? 2 : 1;
+          c.comp = (SelCond::Comparator)(rand() % 6);
+          if (c.attr == 1) c.value = (char*)KEY_LITERALS[rand() % KEY_LITERAL_COUNT];
+          else c.value = (char*)VALUE_LITERALS[rand() % VALUE_LITERAL_COUNT];
+          c.disjunct = d;
+          c.param = 0;
+          cond.push_back(c);
+        }
+      }
+    }
+
+    Predicate pred;
+    pred.compile(cond);
+    checkRanges(pred, cond, disjuncts);
+
+    for (int i = 0; i < 200; i++) {
+      int key = randomKey();
+      const char* value = VALUE_LITERALS[rand() % VALUE_LITERAL_COUNT];
+      CHECK(pred.match(key, value) == meets(cond, disjuncts, key, value, true));
+    }
+
+    if (clause % 5 == 0) checkFilter(pred, cond, disjuncts, *batch);
+  }
+
+  delete batch;
+  return finishTest("PredicateTest", seed);
+}
@@ -0,0 +1,235 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Load random tables through SqlEngine, with and without an index, and
+ * run SELECT, COUNT(*) and MIN/MAX with random WHERE clauses of ORed
+ * disjuncts on them. The rows are checked against evaluating every
+ * condition on every tuple.
+ *
+ * usage: SelectTest [random seed]
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "Test.h"
+#include "SqlEngine.h"
+
+using namespace std;
+
+static const char* LOAD_FILE = "selecttest.del";
+static const char* VALUE_LITERALS[] = { "a", "ab", "b", "ba", "c" };
+static const int VALUE_LITERAL_COUNT = sizeof(VALUE_LITERALS) / sizeof(VALUE_LITERALS[0]);
+
+/// a tuple of a table
+struct Tuple {
+  int    key;
+  string value;
+
+  bool operator<(const Tuple& t) const { return key != t.key ? key < t.key : value < t.value; }
+  bool operator==(const Tuple& t) const { return key == t.key && value == t.value; }
+};
+
+/**
+ * redirects the session output of SqlEngine to a temporary file from its
+ * construction until finish().
+ */
+class Capture {
+ public:
+  Capture()
+  {
+    file = tmpfile();
+    fflush(stdout);
+    saved = dup(1);
+    dup2(fileno(file), 1);
+  }
+
+  /**
+   * @return the file with the rows, rewound. the caller closes it
+   */
+  FILE* finish()
+  {
+    SqlEngine::flushOutput();
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    rewind(file);
+    return file;
+  }
+
+ private:
+  FILE* file;
+  int   saved;
+};
+
+/**
+ * @return the SELECT * rows in file
+ */
+static vector<Tuple> readRows(FILE* file)
+{
+  vector<Tuple> rows;
+  int len;
+  while (fread(&len, sizeof(int), 1, file) == 1) {
+    Tuple t;
+    vector<char> value(len + 1);
+    if (fread(&t.key, sizeof(int), 1, file) != 1) break;
+    if ((int)fread(&value[0], 1, len - sizeof(int), file) != len - (int)sizeof(int)) break;
+    t.value.assign(&value[0], len - sizeof(int));
+    rows.push_back(t);
+  }
+  fclose(file);
+  return rows;
+}
+
+/**
+ * @return a random WHERE clause of up to four disjuncts. the key literals are kept in literals
+ */
+static vector<SelCond> randomClause(int keys, int& disjuncts, vector<string>& literals)
+{
+  vector<SelCond> cond;
+  disjuncts = 1 + rand() % 4;
+  literals.clear();
+  literals.reserve(64);
+  bool in = (rand() % 3 == 0);     // key IN (...) AND value conditions
+  int valueConds = rand() % 2;
+  for (int d = 0; d < disjuncts; d++) {
+    for (int n = in ? 1 : 1 + rand() % 3; n > 0; n--) {
+      SelCond c;
+      c.attr = (!in && rand() % 3 == 0) ? 2 : 1;
+      c.comp = in ? SelCond::EQ : (SelCond::Comparator)(rand() % 6);
+      c.disjunct = d;
+      c.param = 0;
+      if (c.attr == 1) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d", rand() % (keys + 2) - 1);
+        literals.push_back(buf);
+        c.value = (char*)literals.back().c_str();
+      }
+      else c.value = (char*)VALUE_LITERALS[rand() % VALUE_LITERAL_COUNT];
+      cond.push_back(c);
+    }
+    // the arms of an IN share their value conditions
+    for (int n = 0; in && n < valueConds; n++) {
+      SelCond c = { 2, SelCond::NE, (char*)VALUE_LITERALS[0], d, 0 };
+      cond.push_back(c);
+    }
+  }
+  return cond;
+}
+
+/**
+ * check SELECT * with and without ORDER BY key and a LIMIT, COUNT(*),
+ * MIN(key) and MAX(key) under a random WHERE clause.
+ */
+static void checkQueries(const string& table, const vector<Tuple>& tuples, int keys)
+{
+  vector<string> literals;
+  int disjuncts;
+  vector<SelCond> cond = randomClause(keys, disjuncts, literals);
+
+  vector<Tuple> expected;
+  for (unsigned i = 0; i < tuples.size(); i++)
+    if (meets(cond, disjuncts, tuples[i].key, tuples[i].value.c_str(), true)) expected.push_back(tuples[i]);
+  sort(expected.begin(), expected.end());
+
+  // SELECT *
+  SelOrder none = { 0, false };
+  SelLimit all = { -1, 0 };
+  Capture capture;
+  CHECK(SqlEngine::select(3, table, cond, none, all) == 0);
+  vector<Tuple> rows = readRows(capture.finish());
+  sort(rows.begin(), rows.end());
+  CHECK(rows == expected);
+
+  // SELECT * ORDER BY key, with a LIMIT now and then
+  SelOrder order = { 1, rand() % 2 == 1 };
+  SelLimit limit = { -1, 0 };
+  if (rand() % 2) {
+    limit.count = rand() % 50;
+    limit.offset = rand() % 20;
+  }
+  Capture ordered;
+  CHECK(SqlEngine::select(3, table, cond, order, limit) == 0);
+  rows = readRows(ordered.finish());
+  int first = min(limit.offset, (int)expected.size());
+  int last = (limit.count < 0) ? expected.size() : min((int)expected.size(), first + limit.count);
+  CHECK((int)rows.size() == last - first);
+  for (int i = 0; i < (int)rows.size() && first + i < last; i++) {
+    int k = order.desc ? expected[expected.size() - 1 - first - i].key : expected[first + i].key;
+    CHECK(rows[i].key == k);
+  }
+
+  // COUNT(*)
+  Capture counted;
+  CHECK(SqlEngine::select(4, table, cond, none, all) == 0);
+  FILE* file = counted.finish();
+  int len, count;
+  CHECK(fread(&len, sizeof(int), 1, file) == 1 && len == sizeof(int));
+  CHECK(fread(&count, sizeof(int), 1, file) == 1 && count == (int)expected.size());
+  fclose(file);
+
+  // MIN(key), MAX(key)
+  vector<SelAggregate> items(2);
+  items[0].func = SelAggregate::MIN;
+  items[1].func = SelAggregate::MAX;
+  items[0].attr = items[1].attr = 1;
+  items[0].table = items[1].table = NULL;
+  Capture aggregated;
+  CHECK(SqlEngine::aggregate(items, table, cond, 0, all) == 0);
+  file = aggregated.finish();
+  int range[2];
+  CHECK(fread(&len, sizeof(int), 1, file) == 1 && len == sizeof(range));
+  CHECK(fread(range, sizeof(int), 2, file) == 2);
+  // a NULL is output as zero bytes
+  if (expected.empty()) CHECK(range[0] == 0 && range[1] == 0);
+  else CHECK(range[0] == expected.front().key && range[1] == expected.back().key);
+  fclose(file);
+}
+
+/**
+ * load n random tuples with keys in [0, keys) into a table, and query it.
+ */
+static void testTable(const string& table, int n, int keys, bool index, bool analyze)
+{
+  vector<Tuple> tuples(n);
+  FILE* file = fopen(LOAD_FILE, "w");
+  for (int i = 0; i < n; i++) {
+    tuples[i].key = rand() % keys;
+    tuples[i].value = VALUE_LITERALS[rand() % VALUE_LITERAL_COUNT];
+    fprintf(file, "%d,'%s'\n", tuples[i].key, tuples[i].value.c_str());
+  }
+  fclose(file);
+
+  unlink((table + ".tbl").c_str());
+  unlink((table + ".idx").c_str());
+  unlink((table + ".stat").c_str());
+  CHECK(SqlEngine::load(table, LOAD_FILE, index, false) == 0);
+  if (analyze) CHECK(SqlEngine::analyze(table) == 0);
+  unlink(LOAD_FILE);
+
+  for (int i = 0; i < 100; i++) checkQueries(table, tuples, keys);
+
+  unlink((table + ".tbl").c_str());
+  unlink((table + ".idx").c_str());
+  unlink((table + ".stat").c_str());
+}
+
+int main(int argc, char** argv)
+{
+  unsigned seed = seedTest(argc, argv, 1);
+  SqlEngine::setOutputFormat(ResultSink::BINARY);
+
+  // table scans, index scans, and those the statistics choose from
+  testTable("selecttest-scan", 20000, 1000, false, false);
+  testTable("selecttest-index", 20000, 1000, true, false);
+  testTable("selecttest-stats", 50000, 100000, true, true);
+  testTable("selecttest-small", 300, 50, true, true);
+
+  return finishTest("SelectTest", seed);
+}
@@ -0,0 +1,106 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Sort random tuples with TupleSorter, in memory and spilled to runs,
+ * and check the rows it outputs against std::stable_sort.
+ *
+ * usage: SortTest [random seed]
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Test.h"
+#include "TupleSorter.h"
+
+using namespace std;
+
+/// a tuple of the reference
+struct Tuple {
+  int    key;
+  string value;
+};
+
+static bool keyLess(const Tuple& a, const Tuple& b) { return a.key < b.key; }
+static bool valueLess(const Tuple& a, const Tuple& b) { return a.value < b.value; }
+
+/**
+ * read the SELECT * rows a ResultSink wrote to file in BINARY format.
+ */
+static vector<Tuple> readRows(FILE* file)
+{
+  vector<Tuple> rows;
+  int len;
+  rewind(file);
+  while (fread(&len, sizeof(int), 1, file) == 1) {
+    Tuple t;
+    vector<char> value(len - sizeof(int) + 1);
+    if (fread(&t.key, sizeof(int), 1, file) != 1) break;
+    if (fread(&value[0], 1, len - sizeof(int), file) != len - sizeof(int)) break;
+    t.value.assign(&value[0], len - sizeof(int));
+    rows.push_back(t);
+  }
+  return rows;
+}
+
+/**
+ * sort n random tuples and check the first count rows after offset.
+ * keys and values repeat, so that the order of ties is checked too.
+ * @param valueLen[IN] the values are up to this long
+ */
+static void testSort(int attr, bool desc, int n, int valueLen, int offset, int count)
+{
+  vector<Tuple> tuples(n);
+  int keys = 1 + rand() % n;
+  for (int i = 0; i < n; i++) {
+    tuples[i].key = randomInt(-keys, keys);
+    int len = rand() % (valueLen + 1);
+    for (int j = 0; j < len; j++) tuples[i].value += (char)('a' + rand() % 3);
+  }
+
+  TupleSorter sorter(attr, desc);
+  for (int i = 0; i < n; i++)
+    CHECK(sorter.add(tuples[i].key, tuples[i].value.data(), tuples[i].value.size()) == 0);
+
+  FILE* file = tmpfile();
+  ResultSink sink(file);
+  sink.setFormat(ResultSink::BINARY);
+  sink.setLimit(offset, count);
+  CHECK(sorter.output(sink, 3) == 0);
+  CHECK(sink.flush() == 0);
+  vector<Tuple> rows = readRows(file);
+  fclose(file);
+
+  // DESC is the exact reverse of the stable ASC order
+  stable_sort(tuples.begin(), tuples.end(), attr == 1 ? keyLess : valueLess);
+  if (desc) reverse(tuples.begin(), tuples.end());
+  int first = min(offset, n);
+  int last = (count < 0) ? n : min(n, first + count);
+  CHECK((int)rows.size() == last - first);
+  for (int i = 0; i < (int)rows.size() && first + i < last; i++)
+    CHECK(rows[i].key == tuples[first + i].key && rows[i].value == tuples[first + i].value);
+}
+
+int main(int argc, char** argv)
+{
+  unsigned seed = seedTest(argc, argv, 1);
+
+  for (int attr = 1; attr <= 2; attr++) {
+    for (int desc = 0; desc <= 1; desc++) {
+      // in memory, with and without a LIMIT
+      for (int i = 0; i < 20; i++) testSort(attr, desc, 1 + rand() % 5000, 8, 0, -1);
+      testSort(attr, desc, 3000, 8, rand() % 100, rand() % 100);
+    }
+  }
+
+  // about 25MB of tuples spill into two runs
+  testSort(1, false, 500000, 80, 0, -1);
+  testSort(2, true, 500000, 80, 0, -1);
+  testSort(1, true, 500000, 80, 400000, 1000);
+
+  return finishTest("SortTest", seed);
+}
@@ -0,0 +1,116 @@
+/*
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * The checks the randomized tests of test/ are written with. A test
+ * compares a module against a simple reference on random input, and
+ * exits with 1 if any check failed.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "SqlEngine.h"
+
+/// a test gives up after this many failed checks
+static const int MAX_FAILURES = 20;
+
+/// # checks that failed so far
+static int failures = 0;
+
+/**
+ * check a condition. a failure is reported with its line, and the test
+ * goes on unless MAX_FAILURES checks have failed.
+ */
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      if (++failures >= MAX_FAILURES) exit(1); \
+    } \
+  } while (0)
+
+/**
+ * seed rand() with the first command line argument, or with seed.
+ * @return the seed, to report with a failure
+ */
+static inline unsigned seedTest(int argc, char** argv, unsigned seed)
+{
+  if (argc > 1) seed = atoi(argv[1]);
+  srand(seed);
+  return seed;
+}
+
+/**
+ * report the result of a test.
+ * @return the exit code of the test
+ */
+static inline int finishTest(const char* name, unsigned seed)
+{
+  if (failures == 0) {
+    fprintf(stdout, "%s: passed\n", name);
+    return 0;
+  }
+  fprintf(stdout, "%s: %d checks failed with seed %u\n", name, failures, seed);
+  return 1;
+}
+
+/**
+ * @return a random number in [lo, hi]
+ */
+static inline int randomInt(int lo, int hi)
+{
+  // rand() has at least 15 random bits. three calls cover any span of int
+  unsigned long long r = ((unsigned long long)rand() << 30) ^ ((unsigned long long)rand() << 15) ^ rand();
+  return (int)(lo + (long long)(r % (unsigned long long)((long long)hi - lo + 1)));
+}
+
+//
+// the reference evaluation of a WHERE clause, which checks every
+// condition of every disjunct on its own
+//
+
+// @return true if "a comp b"
+static inline bool compare(int a, SelCond::Comparator comp, int b)
+{
+  switch (comp) {
+  case SelCond::EQ: return a == b;
+  case SelCond::NE: return a != b;
+  case SelCond::LT: return a < b;
+  case SelCond::GT: return a > b;
+  case SelCond::LE: return a <= b;
+  case SelCond::GE: return a >= b;
+  }
+  return false;
+}
+
+// @return true if the key conditions of disjunct d hold for key, and,
+// if values is true, its value conditions hold for value as well
+static inline bool meetsDisjunct(const std::vector<SelCond>& cond, int d, int key, const char* value, bool values)
+{
+  for (unsigned i = 0; i < cond.size(); i++) {
+    const SelCond& c = cond[i];
+    if (c.disjunct != d) continue;
+    if (c.attr == 1 && !compare(key, c.comp, atoi(c.value))) return false;
+    if (c.attr == 2 && values && !compare(strcmp(value, c.value), c.comp, 0)) return false;
+  }
+  return true;
+}
+
+// @return true if a disjunct of the clause, ORed disjuncts of ANDed
+// conditions, holds for the tuple. no clause holds for every tuple
+static inline bool meets(const std::vector<SelCond>& cond, int disjuncts, int key, const char* value, bool values)
+{
+  if (cond.empty()) return true;
+  for (int d = 0; d < disjuncts; d++)
+    if (meetsDisjunct(cond, d, key, value, values)) return true;
+  return false;
+}
+
+#endif /* TEST_H */